@@ -8,21 +8,45 @@
 */
 #include "statusnotifieritem.h"
 #include "statusnotifieritem_p.h"
+#include "statusnotifieritembadge_p.hpp"
+#include "statusnotifieritembandwidth_p.hpp"
 #include "statusnotifieritemdbus_p.hpp"
 #include "statusnotifieritemdbus_p_p.hpp"
-#include "statusnotifieritemadaptor.h"
-
-#include <QtEndian>
+#include "statusnotifieritemiconcache_p.hpp"
+#include "statusnotifieritempixel_p.hpp"
+#include "statusnotifieritempool_p.hpp"
+#include "statusnotifieritemlatency_p.hpp"
+#include "statusnotifieritemtrace_p.hpp"
+#include "statusnotifieritemtransport_p.hpp"
+
+#include <QtAlgorithms>
+#include <QAtomicInt>
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
 #include <QIcon>
 #include <QMenu>
-
+#include <QMutex>
+#include <QPainter>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTimer>
+
+#include <cstring>
 #include <utility>
 
 StatusNotifierItem::StatusNotifierItem(QString id, QObject* parent)
+    : StatusNotifierItem(std::move(id), true, parent)
+{
+}
+
+StatusNotifierItem::StatusNotifierItem(QString id, bool visible, QObject* parent)
     : QObject(parent)
     , d(new StatusNotifierItemPrivate(this))
 {
-    d->init(id);
+    d->init(std::move(id), visible);
 }
 
 StatusNotifierItem::~StatusNotifierItem()
@@ -36,6 +60,8 @@ QString StatusNotifierItem::id() const
 
 void StatusNotifierItem::setCategory(SNICategory category)
 {
+    d->record(SNITrace::SetCategory, int(category));
+
     if (d->category == category)
         return;
 
@@ -49,15 +75,18 @@ StatusNotifierItem::SNICategory StatusNotifierItem::category() const
 
 void StatusNotifierItem::setStatus(SNIStatus status)
 {
+    d->record(SNITrace::SetStatus, int(status));
+
     if (d->status == status)
         return;
 
     d->status = status;
 
 #ifdef QT_DBUS_LIB
-    Q_EMIT d->dbus->d->adaptor->NewStatus(QString::fromLatin1(
-        metaObject()->enumerator(metaObject()->indexOfEnumerator("SNIStatus")).valueToKey(d->status))
-    );
+    if (d->passiveDeferral && status != Passive && d->deferredUpdates)
+        d->flushPassiveUpdates();
+
+    d->notifyChange(SNILatencyTracker::Status);
 #endif
 }
 
@@ -68,13 +97,15 @@ StatusNotifierItem::SNIStatus StatusNotifierItem::status() const
 
 void StatusNotifierItem::setTitle(const QString &title)
 {
+    d->record(SNITrace::SetTitle, title);
+
     if (d->title == title)
         return;
 
     d->title = title;
 
 #ifdef QT_DBUS_LIB
-    Q_EMIT d->dbus->d->adaptor->NewTitle();
+    d->notifyChange(SNILatencyTracker::Title);
 #endif
 }
 
@@ -85,199 +116,479 @@ QString StatusNotifierItem::title() const
 
 void StatusNotifierItem::setIconByName(const QString &name)
 {
-    if (d->iconName == name)
+    d->record(SNITrace::SetIconByName, name);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Main];
+
+    if (slot.name == name)
         return;
 
-    d->iconName = name;
+    slot.name = StatusNotifierItemPrivate::intern(name);
 
 #ifdef QT_DBUS_LIB
-    d->serializedIcon = SNIIconList();
-    Q_EMIT d->dbus->d->adaptor->NewIcon();
+    slot.stale = true;
+    d->notifyChange(SNILatencyTracker::Icon);
 #endif
 }
 
 QString StatusNotifierItem::iconName() const
 {
-    return d->iconName;
+    return d->icons[SNIIconSlot::Main].name;
+}
+
+void StatusNotifierItem::setIconThemePath(const QString &path)
+{
+    d->record(SNITrace::SetIconThemePath, path);
+
+    if (d->iconThemePath == path)
+        return;
+
+    d->iconThemePath = StatusNotifierItemPrivate::intern(path);
+
+#ifdef QT_DBUS_LIB
+    d->notifyChange(SNILatencyTracker::IconThemePath);
+    d->notify(SNILatencyTracker::Icon);
+#endif
+}
+
+QString StatusNotifierItem::iconThemePath() const
+{
+    return d->iconThemePath;
+}
+
+bool StatusNotifierItem::exportIcons(const QHash<QString, QIcon> &icons)
+{
+    bool ok = true;
+    for (auto it = icons.cbegin(); it != icons.cend(); ++it)
+        ok = d->exportIcon(it.key(), it.value()) && ok;
+
+    ok = d->writeIconThemeIndex() && ok;
+
+    setIconThemePath(d->exportedIconThemePath());
+    return ok;
 }
 
 void StatusNotifierItem::setIconByPixmap(const QIcon &icon)
 {
-    if (d->iconName.isEmpty() && d->iconCacheKey == icon.cacheKey())
+    d->record(SNITrace::SetIconByPixmap, icon);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Main];
+
+    if (slot.name.isEmpty() && slot.cacheKey == icon.cacheKey())
         return;
 
-    d->iconCacheKey = icon.cacheKey();
-    d->iconName.clear();
-    d->icon = icon;
+#ifdef QT_DBUS_LIB
+    const SNIIconList before = d->currentPixmaps(SNIIconSlot::Main);
+#endif
+    slot.cacheKey = icon.cacheKey();
+    slot.name.clear();
+    slot.icon = icon;
 
 #ifdef QT_DBUS_LIB
-    d->serializedIcon = d->iconToPixmapList(icon);
-    Q_EMIT d->dbus->d->adaptor->NewIcon();
+    slot.stale = true;
+    d->notifyPixmapChange(SNIIconSlot::Main, SNILatencyTracker::Icon, before);
 #endif
 }
 
 QIcon StatusNotifierItem::iconPixmap() const
 {
-    return d->icon;
+    return d->sourceIcon(SNIIconSlot::Main);
+}
+
+void StatusNotifierItem::setProgress(double progress)
+{
+    d->record(SNITrace::SetProgress, progress);
+
+#ifdef QT_DBUS_LIB
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Main];
+
+    // frames are drawn over the current icon, and restore it when done
+    d->serialized(SNIIconSlot::Main);
+
+    if (progress < 0.0) {
+        if (!d->isProgressActive())
+            return;
+
+        d->progress->value = -1.0;
+        d->progress->frame = -1;
+
+        const SNIIconList previous = std::exchange(slot.serialized, d->progress->restore);
+        d->iconChanged(previous);
+        d->notifyChange(SNILatencyTracker::Icon);
+        return;
+    }
+    if (!d->progress)
+        d->progress.reset(new SNIProgressState);
+
+    if (!d->isProgressActive())
+        d->progress->restore = slot.serialized;
+
+    d->progress->value = qMin(progress, 1.0);
+
+    const SNIIconList previous = slot.serialized;
+    if (d->showProgressFrame()) {
+        d->iconChanged(previous);
+        d->trackChange(SNILatencyTracker::Icon);
+        d->scheduleProgressEmission();
+    }
+#else
+    Q_UNUSED(progress)
+#endif
+}
+
+double StatusNotifierItem::progress() const
+{
+#ifdef QT_DBUS_LIB
+    return d->isProgressActive() ? d->progress->value : -1.0;
+#else
+    return -1.0;
+#endif
+}
+
+void StatusNotifierItem::setProgressSteps(int steps)
+{
+    d->record(SNITrace::SetProgressSteps, steps);
+
+#ifdef QT_DBUS_LIB
+    steps = qMax(1, steps);
+
+    if (!d->progress)
+        d->progress.reset(new SNIProgressState);
+
+    if (d->progress->steps == steps)
+        return;
+
+    d->progress->steps = steps;
+    d->progress->frames.clear();
+
+    if (d->isProgressActive()) {
+        const SNIIconList previous = d->serialized(SNIIconSlot::Main);
+        d->progress->frame = -1;
+        d->showProgressFrame();
+        d->iconChanged(previous);
+        d->trackChange(SNILatencyTracker::Icon);
+        d->scheduleProgressEmission();
+    }
+#else
+    Q_UNUSED(steps)
+#endif
+}
+
+int StatusNotifierItem::progressSteps() const
+{
+#ifdef QT_DBUS_LIB
+    return d->progress ? d->progress->steps : 100;
+#else
+    return 100;
+#endif
+}
+
+void StatusNotifierItem::setProgressUpdateInterval(int msec)
+{
+    d->record(SNITrace::SetProgressUpdateInterval, msec);
+
+#ifdef QT_DBUS_LIB
+    if (!d->progress)
+        d->progress.reset(new SNIProgressState);
+
+    d->progress->interval = qMax(0, msec);
+#else
+    Q_UNUSED(msec)
+#endif
+}
+
+int StatusNotifierItem::progressUpdateInterval() const
+{
+#ifdef QT_DBUS_LIB
+    return d->progress ? d->progress->interval : 100;
+#else
+    return 100;
+#endif
+}
+
+void StatusNotifierItem::setIconDeltaUpdatesEnabled(bool enabled)
+{
+#ifdef QT_DBUS_LIB
+    if (enabled == bool(d->iconRevisionLog))
+        return;
+
+    d->iconRevisionLog.reset(enabled ? new SNIIconRevisionLog : nullptr);
+#else
+    Q_UNUSED(enabled)
+#endif
+}
+
+bool StatusNotifierItem::isIconDeltaUpdatesEnabled() const
+{
+#ifdef QT_DBUS_LIB
+    return bool(d->iconRevisionLog);
+#else
+    return false;
+#endif
 }
 
 void StatusNotifierItem::setOverlayIconByName(const QString &name)
 {
-    if (d->overlayIconName == name)
+    d->record(SNITrace::SetOverlayIconByName, name);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Overlay];
+
+    if (slot.name == name && d->badgeText.isEmpty())
         return;
 
-    d->overlayIconName = name;
+    slot.name = StatusNotifierItemPrivate::intern(name);
+
+    d->badgeText.clear();
+    d->badgeCount = 0;
 
 #ifdef QT_DBUS_LIB
-    Q_EMIT d->dbus->d->adaptor->NewOverlayIcon();
+    slot.stale = true;
+    d->notifyChange(SNILatencyTracker::OverlayIcon);
 #endif
 }
 
 QString StatusNotifierItem::overlayIconName() const
 {
-    return d->overlayIconName;
+    return d->icons[SNIIconSlot::Overlay].name;
 }
 
 void StatusNotifierItem::setOverlayIconByPixmap(const QIcon &icon)
 {
-    if (d->overlayIconName.isEmpty() && d->overlayIconCacheKey == icon.cacheKey())
+    d->record(SNITrace::SetOverlayIconByPixmap, icon);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Overlay];
+
+    if (slot.name.isEmpty() && d->badgeText.isEmpty() && slot.cacheKey == icon.cacheKey())
         return;
 
-    d->overlayIconCacheKey = icon.cacheKey();
-    d->overlayIconName.clear();
-    d->overlayIcon = icon;
+#ifdef QT_DBUS_LIB
+    const SNIIconList before = d->currentPixmaps(SNIIconSlot::Overlay);
+#endif
+    slot.cacheKey = icon.cacheKey();
+    slot.name.clear();
+    slot.icon = icon;
+    d->badgeText.clear();
+    d->badgeCount = 0;
 
 #ifdef QT_DBUS_LIB
-    d->serializedOverlayIcon = d->iconToPixmapList(icon);
-    Q_EMIT d->dbus->d->adaptor->NewOverlayIcon();
+    slot.stale = true;
+    d->notifyPixmapChange(SNIIconSlot::Overlay, SNILatencyTracker::OverlayIcon, before);
 #endif
 }
 
 QIcon StatusNotifierItem::overlayIconPixmap() const
 {
-    return d->overlayIcon;
+    return d->sourceIcon(SNIIconSlot::Overlay);
+}
+
+void StatusNotifierItem::setBadgeCount(int count)
+{
+    if (count <= 0)
+        setBadgeText(QString());
+    else if (count > 99)
+        setBadgeText(QStringLiteral("99+"));
+    else
+        setBadgeText(QString::number(count));
+
+    d->badgeCount = qMax(0, count);
+}
+
+int StatusNotifierItem::badgeCount() const
+{
+    return d->badgeCount;
+}
+
+void StatusNotifierItem::setBadgeText(const QString &text)
+{
+    d->record(SNITrace::SetBadgeText, text);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Overlay];
+
+    if (d->badgeText == text)
+        return;
+
+    d->badgeText  = text;
+    d->badgeCount = 0;
+
+    // the badge replaces the overlay icon
+    slot.name.clear();
+    slot.icon = QIcon();
+    slot.cacheKey = 0;
+
+#ifdef QT_DBUS_LIB
+    // rendered when sent, like the icons set by pixmap
+    slot.stale = true;
+    slot.pixmapChanged = !text.isEmpty();
+    d->notifyChange(SNILatencyTracker::OverlayIcon);
+#endif
+}
+
+QString StatusNotifierItem::badgeText() const
+{
+    return d->badgeText;
 }
 
 void StatusNotifierItem::setAttentionIconByName(const QString &name)
 {
-    if (d->attentionIconName == name)
+    d->record(SNITrace::SetAttentionIconByName, name);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Attention];
+
+    if (slot.name == name)
         return;
 
-    d->attentionIconName = name;
+    slot.name = StatusNotifierItemPrivate::intern(name);
 
 #ifdef QT_DBUS_LIB
-    d->serializedAttentionIcon = SNIIconList();
-    Q_EMIT d->dbus->d->adaptor->NewAttentionIcon();
+    slot.stale = true;
+    d->notifyChange(SNILatencyTracker::AttentionIcon);
 #endif
 }
 
 QString StatusNotifierItem::attentionIconName() const
 {
-    return d->attentionIconName;
+    return d->icons[SNIIconSlot::Attention].name;
 }
 
 void StatusNotifierItem::setAttentionIconByPixmap(const QIcon &icon)
 {
-    if (d->attentionIconName.isEmpty() && d->attentionIconCacheKey == icon.cacheKey())
+    d->record(SNITrace::SetAttentionIconByPixmap, icon);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::Attention];
+
+    if (slot.name.isEmpty() && slot.cacheKey == icon.cacheKey())
         return;
 
-    d->attentionIconCacheKey = icon.cacheKey();
-    d->attentionIconName.clear();
-    d->attentionIcon = icon;
+#ifdef QT_DBUS_LIB
+    const SNIIconList before = d->currentPixmaps(SNIIconSlot::Attention);
+#endif
+    slot.cacheKey = icon.cacheKey();
+    slot.name.clear();
+    slot.icon = icon;
 
 #ifdef QT_DBUS_LIB
-    d->serializedAttentionIcon = d->iconToPixmapList(icon);
-    Q_EMIT d->dbus->d->adaptor->NewAttentionIcon();
+    slot.stale = true;
+    d->notifyPixmapChange(SNIIconSlot::Attention, SNILatencyTracker::AttentionIcon, before);
 #endif
 }
 
 QIcon StatusNotifierItem::attentionIconPixmap() const
 {
-    return d->attentionIcon;
+    return d->sourceIcon(SNIIconSlot::Attention);
 }
 
 void StatusNotifierItem::setToolTip(const QString &iconName, const QString &title, const QString &subTitle)
 {
-    if (d->toolTipIconName == iconName && d->toolTipTitle == title && d->toolTipSubTitle == subTitle)
-        return;
+    d->record(SNITrace::SetToolTip, iconName, title, subTitle);
 
-    d->toolTipIconName = iconName;
+    SNIIconSlot& slot = d->icons[SNIIconSlot::ToolTip];
+
+    if (slot.name == iconName && d->toolTipTitle == title
+        && !d->toolTipTemplate && d->toolTipSubTitle == subTitle) {
+        return;
+    }
+    slot.name          = StatusNotifierItemPrivate::intern(iconName);
     d->toolTipTitle    = title;
     d->toolTipSubTitle = subTitle;
+    d->toolTipTemplate.reset();
 
 #ifdef QT_DBUS_LIB
-    d->serializedToolTipIcon = SNIIconList();
-    Q_EMIT d->dbus->d->adaptor->NewToolTip();
+    slot.stale = true;
+    d->notifyChange(SNILatencyTracker::ToolTip);
 #endif
 }
 
 void StatusNotifierItem::setToolTip(const QIcon& icon, const QString& title, const QString& subTitle)
 {
-    if (d->toolTipIconName.isEmpty() &&
-        d->toolTipIcon.cacheKey() == icon.cacheKey() &&
-        d->toolTipTitle           == title &&
-        d->toolTipSubTitle        == subTitle) {
+    d->record(SNITrace::SetToolTipWithIcon, icon, title, subTitle);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::ToolTip];
+
+    const bool textChanged = d->toolTipTitle != title || d->toolTipSubTitle != subTitle || d->toolTipTemplate;
+    const bool iconChanged = !slot.name.isEmpty() || slot.cacheKey != icon.cacheKey();
+    if (!textChanged && !iconChanged)
         return;
-    }
-    d->toolTipIconName.clear();
 
-    d->toolTipIcon     = icon;
+#ifdef QT_DBUS_LIB
+    const SNIIconList before = d->currentPixmaps(SNIIconSlot::ToolTip);
+#endif
+    slot.name.clear();
+    slot.icon          = icon;
+    slot.cacheKey      = icon.cacheKey();
     d->toolTipTitle    = title;
     d->toolTipSubTitle = subTitle;
+    d->toolTipTemplate.reset();
 
 #ifdef QT_DBUS_LIB
-    d->serializedToolTipIcon = d->iconToPixmapList(icon);
-    Q_EMIT d->dbus->d->adaptor->NewToolTip();
+    if (!iconChanged) {
+        d->notifyChange(SNILatencyTracker::ToolTip);
+        return;
+    }
+    slot.stale = true;
+    d->notifyPixmapChange(SNIIconSlot::ToolTip, SNILatencyTracker::ToolTip, before, textChanged);
 #endif
 }
 
 void StatusNotifierItem::setToolTipIconByName(const QString &name)
 {
-    if (d->toolTipIconName == name)
+    d->record(SNITrace::SetToolTipIconByName, name);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::ToolTip];
+
+    if (slot.name == name)
         return;
 
-    d->toolTipIconName = name;
+    slot.name = StatusNotifierItemPrivate::intern(name);
 
 #ifdef QT_DBUS_LIB
-    d->serializedToolTipIcon = SNIIconList();
-    Q_EMIT d->dbus->d->adaptor->NewToolTip();
+    slot.stale = true;
+    d->notifyChange(SNILatencyTracker::ToolTip);
 #endif
 }
 
 QString StatusNotifierItem::toolTipIconName() const
 {
-    return d->toolTipIconName;
+    return d->icons[SNIIconSlot::ToolTip].name;
 }
 
 void StatusNotifierItem::setToolTipIconByPixmap(const QIcon &icon)
 {
-    if (d->toolTipIconName.isEmpty() && d->toolTipIconCacheKey == icon.cacheKey())
+    d->record(SNITrace::SetToolTipIconByPixmap, icon);
+
+    SNIIconSlot& slot = d->icons[SNIIconSlot::ToolTip];
+
+    if (slot.name.isEmpty() && slot.cacheKey == icon.cacheKey())
         return;
 
-    d->toolTipIconCacheKey = icon.cacheKey();
-    d->toolTipIconName.clear();
-    d->toolTipIcon = icon;
+#ifdef QT_DBUS_LIB
+    const SNIIconList before = d->currentPixmaps(SNIIconSlot::ToolTip);
+#endif
+    slot.cacheKey = icon.cacheKey();
+    slot.name.clear();
+    slot.icon = icon;
 
 #ifdef QT_DBUS_LIB
-    d->serializedToolTipIcon = d->iconToPixmapList(icon);
-    Q_EMIT d->dbus->d->adaptor->NewToolTip();
+    slot.stale = true;
+    d->notifyPixmapChange(SNIIconSlot::ToolTip, SNILatencyTracker::ToolTip, before);
 #endif
 }
 
 QIcon StatusNotifierItem::toolTipIconPixmap() const
 {
-    return d->toolTipIcon;
+    return d->sourceIcon(SNIIconSlot::ToolTip);
 }
 
 void StatusNotifierItem::setToolTipTitle(const QString &title)
 {
+    d->record(SNITrace::SetToolTipTitle, title);
+
     if (d->toolTipTitle == title)
         return;
 
     d->toolTipTitle = title;
 
 #ifdef QT_DBUS_LIB
-    Q_EMIT d->dbus->d->adaptor->NewToolTip();
+    d->notifyChange(SNILatencyTracker::ToolTip);
 #endif
 }
 
@@ -288,19 +599,87 @@ QString StatusNotifierItem::toolTipTitle() const
 
 void StatusNotifierItem::setToolTipSubTitle(const QString &subTitle)
 {
-    if (d->toolTipSubTitle == subTitle)
+    d->record(SNITrace::SetToolTipSubTitle, subTitle);
+
+    if (!d->toolTipTemplate && d->toolTipSubTitle == subTitle)
         return;
 
     d->toolTipSubTitle = subTitle;
+    d->toolTipTemplate.reset();
 
 #ifdef QT_DBUS_LIB
-    Q_EMIT d->dbus->d->adaptor->NewToolTip();
+    d->notifyChange(SNILatencyTracker::ToolTip);
 #endif
 }
 
 QString StatusNotifierItem::toolTipSubTitle() const
 {
-    return d->toolTipSubTitle;
+    return d->toolTipDescription();
+}
+
+void StatusNotifierItem::setToolTipTemplate(const QString &text)
+{
+    d->record(SNITrace::SetToolTipTemplate, text);
+
+    if (text.isEmpty()) {
+        // the subtitle doesn't change
+        if (d->toolTipTemplate) {
+            d->toolTipSubTitle = d->toolTipDescription();
+            d->toolTipTemplate.reset();
+        }
+        return;
+    }
+    if (d->toolTipTemplate && d->toolTipTemplate->text == text)
+        return;
+
+    std::unique_ptr<SNIToolTipTemplate> toolTip(new SNIToolTipTemplate);
+    StatusNotifierItemPrivate::parseToolTipTemplate(*toolTip, text);
+
+    if (d->toolTipTemplate) {
+        for (SNIToolTipTemplate::Field& field : toolTip->fields) {
+            if (const SNIToolTipTemplate::Field* previous = d->toolTipField(field.name))
+                field = *previous;
+        }
+    }
+    d->toolTipTemplate = std::move(toolTip);
+
+#ifdef QT_DBUS_LIB
+    d->notifyChange(SNILatencyTracker::ToolTip);
+#endif
+}
+
+QString StatusNotifierItem::toolTipTemplate() const
+{
+    return d->toolTipTemplate ? d->toolTipTemplate->text : QString();
+}
+
+void StatusNotifierItem::setToolTipField(const QString &name, const QString &value)
+{
+    d->record(SNITrace::SetToolTipField, name, value);
+
+    SNIToolTipTemplate::Field* field = d->toolTipField(name);
+    if (!field || (field->precision < 0 && field->text == value))
+        return;
+
+    field->text      = value;
+    field->precision = -1;
+    d->toolTipFieldChanged();
+}
+
+void StatusNotifierItem::setToolTipField(const QString &name, double value, int precision)
+{
+    d->record(SNITrace::SetToolTipNumber, name, value, precision);
+
+    precision = qBound(0, precision, 16);
+
+    SNIToolTipTemplate::Field* field = d->toolTipField(name);
+    if (!field || (field->precision == precision && field->number == value))
+        return;
+
+    field->text.clear();
+    field->number    = value;
+    field->precision = precision;
+    d->toolTipFieldChanged();
 }
 
 void StatusNotifierItem::setContextMenu(QMenu* menu)
@@ -316,52 +695,1443 @@ QMenu* StatusNotifierItem::contextMenu() const
     return d->dbus->contextMenu();
 #endif
 }
-//==============================================================================
-// StatusNotifierItemPrivate
-//==============================================================================
-StatusNotifierItemPrivate::StatusNotifierItemPrivate(StatusNotifierItem* sni)
-    : q(sni)
-    , category(StatusNotifierItem::ApplicationStatus)
-    , status(StatusNotifierItem::Active)
+
+void StatusNotifierItem::setLatencyTrackingEnabled(bool enabled)
 {
+#ifdef QT_DBUS_LIB
+    if (enabled == bool(d->latency))
+        return;
+
+    d->latency.reset(enabled ? new SNILatencyTracker : nullptr);
+#else
+    Q_UNUSED(enabled)
+#endif
 }
 
-void StatusNotifierItemPrivate::init(QString extraId)
+bool StatusNotifierItem::isLatencyTrackingEnabled() const
 {
-    id    = std::move(extraId);
-    title = QLatin1String("Test");
 #ifdef QT_DBUS_LIB
-    dbus  = new StatusNotifierItemDBus(q);
+    return bool(d->latency);
+#else
+    return false;
 #endif
 }
 
+QVariantMap StatusNotifierItem::latencyStatistics() const
+{
 #ifdef QT_DBUS_LIB
-SNIIconList StatusNotifierItemPrivate::iconToPixmapList(const QIcon& icon)
+    if (d->latency)
+        return d->latency->statistics();
+#endif
+    return QVariantMap();
+}
+
+QString StatusNotifierItem::latencyReport() const
 {
-    SNIIconList pixmapList;
+#ifdef QT_DBUS_LIB
+    if (d->latency)
+        return d->latency->report();
+#endif
+    return QString();
+}
 
-    const QList<QSize> sizes = icon.availableSizes();
-    for (const QSize &size : sizes) {
-        QImage image = icon.pixmap(size).toImage();
+bool StatusNotifierItem::startRecording(const QString &fileName)
+{
+    std::unique_ptr<SNITraceWriter> trace(new SNITraceWriter);
+    if (!trace->open(fileName, d->id))
+        return false;
 
-        SNIIcon pix;
-        pix.height = image.height();
-        pix.width = image.width();
+    d->trace = std::move(trace);
+    return true;
+}
+
+void StatusNotifierItem::stopRecording()
+{
+    d->trace.reset();
+}
+
+bool StatusNotifierItem::isRecording() const
+{
+    return bool(d->trace);
+}
 
-        if (image.format() != QImage::Format_ARGB32)
-            image = image.convertToFormat(QImage::Format_ARGB32);
+void StatusNotifierItem::setVisible(bool visible)
+{
+    d->record(SNITrace::SetVisible, int(visible));
 
-        pix.bytes = QByteArray((char *) image.bits(), image.sizeInBytes());
+    if (d->visible == visible)
+        return;
 
-        // swap to network byte order if we are little endian
-        if (QSysInfo::ByteOrder == QSysInfo::LittleEndian) {
-            quint32 *uintBuf = (quint32 *) pix.bytes.data();
+    d->visible = visible;
+
+#ifdef QT_DBUS_LIB
+    if (visible)
+        d->attach();
+    else
+        d->dbus->d->detach();
+#endif
+}
+
+bool StatusNotifierItem::isVisible() const
+{
+    return d->visible;
+}
+
+void StatusNotifierItem::show()
+{
+    setVisible(true);
+}
+
+void StatusNotifierItem::hide()
+{
+    setVisible(false);
+}
+
+bool StatusNotifierItem::isRegistered() const
+{
+#ifdef QT_DBUS_LIB
+    return d->dbus->d->registration == StatusNotifierItemDBusPrivate::Registered;
+#else
+    return false;
+#endif
+}
+
+bool StatusNotifierItem::isHostAvailable() const
+{
+#ifdef QT_DBUS_LIB
+    return d->dbus->d->hostAvailable;
+#else
+    return false;
+#endif
+}
+
+StatusNotifierItemAwaiter StatusNotifierItem::registered()
+{
+    return StatusNotifierItemAwaiter(this, StatusNotifierItemAwaiter::Registration);
+}
+
+StatusNotifierItemAwaiter StatusNotifierItem::hostAvailable()
+{
+    return StatusNotifierItemAwaiter(this, StatusNotifierItemAwaiter::HostAvailability);
+}
+
+void StatusNotifierItem::setIdleModeEnabled(bool enabled)
+{
+#ifdef QT_DBUS_LIB
+    if (enabled == d->idleMode)
+        return;
+
+    d->idleMode = enabled;
+    if (!enabled)
+        d->flushDeferredUpdates();
+#else
+    Q_UNUSED(enabled)
+#endif
+}
+
+bool StatusNotifierItem::isIdleModeEnabled() const
+{
+#ifdef QT_DBUS_LIB
+    return d->idleMode;
+#else
+    return false;
+#endif
+}
+
+void StatusNotifierItem::setPassiveDeferralEnabled(bool enabled)
+{
+#ifdef QT_DBUS_LIB
+    if (enabled == bool(d->passiveDeferral))
+        return;
+
+    if (enabled) {
+        d->passiveDeferral.reset(new SNIPassiveDeferral);
+        return;
+    }
+    if (d->status == Passive && d->deferredUpdates)
+        d->flushPassiveUpdates();
+
+    d->passiveDeferral.reset();
+#else
+    Q_UNUSED(enabled)
+#endif
+}
+
+bool StatusNotifierItem::isPassiveDeferralEnabled() const
+{
+#ifdef QT_DBUS_LIB
+    return bool(d->passiveDeferral);
+#else
+    return false;
+#endif
+}
+
+QVariantMap StatusNotifierItem::passiveDeferralStatistics() const
+{
+    QVariantMap map;
+#ifdef QT_DBUS_LIB
+    if (const SNIPassiveDeferral* deferral = d->passiveDeferral.get()) {
+        const bool   passive = d->status == Passive && d->visible && !d->isIdle();
+        const qint64 pending = passive ? qPopulationCount(d->deferredUpdates) : 0;
+        const qint64 skipped = qint64(deferral->deferredChanges) - deferral->sentSignals - pending;
+
+        map.insert(QStringLiteral("deferredChanges"), deferral->deferredChanges);
+        map.insert(QStringLiteral("sentSignals"),     deferral->sentSignals);
+        map.insert(QStringLiteral("skippedSignals"),  qMax(qint64(0), skipped));
+        map.insert(QStringLiteral("pendingSignals"),  pending);
+        map.insert(QStringLiteral("flushes"),         deferral->flushes);
+    }
+#endif
+    return map;
+}
+
+void StatusNotifierItem::setMemoryLeanModeEnabled(bool enabled)
+{
+#ifdef QT_DBUS_LIB
+    if (enabled == d->leanMode)
+        return;
+
+    for (int kind = 0; kind < SNIIconSlot::KindCount; ++kind) {
+        SNIIconSlot& slot = d->icons[kind];
+        if (slot.stale)
+            continue;
+
+        // keep a single form of the icons already serialized
+        if (enabled)
+            slot.icon = QIcon();
+        else if (slot.icon.isNull())
+            slot.icon = d->sourceIcon(SNIIconSlot::Kind(kind));
+    }
+    d->leanMode = enabled;
+#else
+    Q_UNUSED(enabled)
+#endif
+}
+
+bool StatusNotifierItem::isMemoryLeanModeEnabled() const
+{
+#ifdef QT_DBUS_LIB
+    return d->leanMode;
+#else
+    return false;
+#endif
+}
+
+void StatusNotifierItem::setRevisionSignalsEnabled(bool enabled)
+{
+#ifdef QT_DBUS_LIB
+    d->revisionSignals = enabled;
+#else
+    Q_UNUSED(enabled)
+#endif
+}
+
+bool StatusNotifierItem::isRevisionSignalsEnabled() const
+{
+#ifdef QT_DBUS_LIB
+    return d->revisionSignals;
+#else
+    return false;
+#endif
+}
+
+void StatusNotifierItem::setRedundantSignalFilterEnabled(bool enabled)
+{
+#ifdef QT_DBUS_LIB
+    if (enabled == bool(d->redundancyFilter))
+        return;
+
+    // nothing is known to be fetched until the next reads
+    d->redundancyFilter.reset(enabled ? new SNIRedundancyFilter : nullptr);
+#else
+    Q_UNUSED(enabled)
+#endif
+}
+
+bool StatusNotifierItem::isRedundantSignalFilterEnabled() const
+{
+#ifdef QT_DBUS_LIB
+    return bool(d->redundancyFilter);
+#else
+    return false;
+#endif
+}
+
+int StatusNotifierItem::skippedRedundantSignals() const
+{
+#ifdef QT_DBUS_LIB
+    return d->redundancyFilter ? int(d->redundancyFilter->skippedSignals) : 0;
+#else
+    return 0;
+#endif
+}
+
+bool StatusNotifierItem::isIdle() const
+{
+#ifdef QT_DBUS_LIB
+    return d->isIdle();
+#else
+    return false;
+#endif
+}
+
+qint64 StatusNotifierItem::memoryUsage() const
+{
+    return d->memoryUsage();
+}
+
+qint64 StatusNotifierItem::sharedMemoryUsage()
+{
+    return SNIPayloadPool::instance()->memoryUsage();
+}
+
+void StatusNotifierItem::setPixmapBandwidthBudget(qint64 bytesPerSecond)
+{
+    SNIBandwidthScheduler::instance()->setBudget(bytesPerSecond);
+}
+
+qint64 StatusNotifierItem::pixmapBandwidthBudget()
+{
+    return SNIBandwidthScheduler::instance()->budget();
+}
+
+QVariantMap StatusNotifierItem::pixmapBandwidthStatistics()
+{
+    return SNIBandwidthScheduler::instance()->statistics();
+}
+
+void StatusNotifierItem::setIconCacheEnabled(bool enabled)
+{
+    SNIIconCache::instance()->setEnabled(enabled);
+}
+
+bool StatusNotifierItem::isIconCacheEnabled()
+{
+    return SNIIconCache::instance()->isEnabled();
+}
+//==============================================================================
+// StatusNotifierItemAwaiter
+//==============================================================================
+StatusNotifierItemAwaiter::StatusNotifierItemAwaiter(StatusNotifierItem *item, Kind kind)
+    : item_(item)
+    , kind_(kind)
+{
+}
+
+bool StatusNotifierItemAwaiter::await_ready() const
+{
+    const auto *item = static_cast<const StatusNotifierItem *>(item_.data());
+    if (!item)
+        return true;
+
+#ifdef QT_DBUS_LIB
+    if (kind_ == Registration)
+        return item->d->dbus->d->registration != StatusNotifierItemDBusPrivate::RegistrationPending;
+#endif
+    return item->isHostAvailable();
+}
+
+bool StatusNotifierItemAwaiter::await_resume() const
+{
+    const auto *item = static_cast<const StatusNotifierItem *>(item_.data());
+    if (!item)
+        return false;
+
+    return kind_ == Registration ? item->isRegistered() : item->isHostAvailable();
+}
+
+void StatusNotifierItemAwaiter::wait(std::function<void()> resume)
+{
+    auto *item = static_cast<StatusNotifierItem *>(item_.data());
+    if (!item) {
+        QTimer::singleShot(0, std::move(resume));
+        return;
+    }
+    // the first of the two connections to fire resumes, from the event loop
+    struct Connections {
+        QMetaObject::Connection state;
+        QMetaObject::Connection destroyed;
+    };
+    auto connections = std::make_shared<Connections>();
+    auto done = [connections, resume = std::move(resume)]() {
+        QObject::disconnect(connections->state);
+        QObject::disconnect(connections->destroyed);
+        QTimer::singleShot(0, resume);
+    };
+    connections->destroyed = QObject::connect(item, &QObject::destroyed, done);
+
+    if (kind_ == Registration) {
+        connections->state = QObject::connect(item, &StatusNotifierItem::registrationFinished, done);
+    } else {
+        connections->state = QObject::connect(item, &StatusNotifierItem::hostAvailabilityChanged,
+                                              [done](bool available) {
+            if (available)
+                done();
+        });
+    }
+}
+//==============================================================================
+// StatusNotifierItemPrivate
+//==============================================================================
+namespace {
+// Icon names and theme paths come from a small vocabulary, interned strings
+// let all the items of the process share a single copy of each of them.
+struct SNIStringPool
+{
+    QMutex        mutex;
+    QSet<QString> strings;
+};
+Q_GLOBAL_STATIC(SNIStringPool, stringPool)
+
+// tells apart the traces of items sharing an id
+QAtomicInt traceCounter;
+
+// Adds up the heap blocks of an item, counting shared ones once
+class SNIMemoryCounter
+{
+public:
+    void add(qint64 bytes)
+    {
+        total += bytes;
+    }
+
+    void add(const QString& string)
+    {
+        if (string.capacity() > 0 && claim(string.constData()))
+            total += sizeof(QArrayData) + (string.capacity() + 1) * qint64(sizeof(QChar));
+    }
+
+    void add(const QByteArray& bytes)
+    {
+        if (bytes.capacity() > 0 && claim(bytes.constData()))
+            total += sizeof(QArrayData) + bytes.capacity() + 1;
+    }
+
+    void add(const QIcon& icon)
+    {
+        // the engine keeps the pixmaps it was given, 32 bits per pixel
+        if (icon.isNull() || icons.contains(icon.cacheKey()))
+            return;
+
+        icons.insert(icon.cacheKey());
+        const QList<QSize> sizes = icon.availableSizes();
+        for (const QSize& size : sizes)
+            total += qint64(size.width()) * size.height() * 4;
+    }
+
+#ifdef QT_DBUS_LIB
+    void add(const SNIIconList& list)
+    {
+        if (list.isEmpty() || !claim(&list.at(0)))
+            return;
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+        // an array of pointers to heap allocated nodes
+        total += sizeof(QListData::Data) + list.size() * qint64(sizeof(void*) + sizeof(SNIIcon));
+#else
+        total += sizeof(QArrayData) + list.capacity() * qint64(sizeof(SNIIcon));
+#endif
+        for (const SNIIcon& pix : list)
+            add(pix.bytes);
+    }
+#endif
+
+    qint64 total { 0 };
+
+private:
+    bool claim(const void* block)
+    {
+        if (blocks.contains(block))
+            return false;
+
+        blocks.insert(block);
+        return true;
+    }
+
+    QSet<const void*> blocks;
+    QSet<qint64>      icons;
+};
+} // namespace
+
+StatusNotifierItemPrivate::StatusNotifierItemPrivate(StatusNotifierItem* sni)
+    : q(sni)
+    , category(StatusNotifierItem::ApplicationStatus)
+    , status(StatusNotifierItem::Active)
+{
+}
+
+void StatusNotifierItemPrivate::init(QString extraId, bool show)
+{
+    id      = std::move(extraId);
+    title   = QLatin1String("Test");
+    visible = show;
+#ifdef QT_DBUS_LIB
+    dbus    = new StatusNotifierItemDBus(q);
+    if (visible)
+        dbus->d->attach();
+#endif
+
+    // record production workloads without changing the application
+    static const QString traceDir = qEnvironmentVariable("SNI_QT_TRACE_DIR");
+    if (!traceDir.isEmpty()) {
+        QString name = id;
+        name.replace(QLatin1Char('/'), QLatin1Char('_'));
+
+        q->startRecording(QString::fromLatin1("%1/%2-%3-%4.snitrace")
+                              .arg(traceDir, name)
+                              .arg(QCoreApplication::applicationPid())
+                              .arg(traceCounter.fetchAndAddRelaxed(1) + 1));
+    }
+}
+
+qint64 StatusNotifierItemPrivate::memoryUsage() const
+{
+    SNIMemoryCounter counter;
+    counter.add(sizeof(StatusNotifierItem) + sizeof(StatusNotifierItemPrivate));
+
+    for (const QString* string : { &id, &title, &iconThemePath, &badgeText, &toolTipTitle, &toolTipSubTitle })
+        counter.add(*string);
+
+    if (const SNIToolTipTemplate* toolTip = toolTipTemplate.get()) {
+        counter.add(sizeof(SNIToolTipTemplate));
+        counter.add(toolTip->text);
+        counter.add(toolTip->description);
+        for (const QString& literal : toolTip->literals)
+            counter.add(literal);
+        for (const SNIToolTipTemplate::Field& field : toolTip->fields) {
+            counter.add(field.name);
+            counter.add(field.text);
+        }
+    }
+
+    for (const SNIIconSlot& slot : icons) {
+        counter.add(slot.name);
+        counter.add(slot.icon);
+#ifdef QT_DBUS_LIB
+        counter.add(slot.serialized);
+#endif
+    }
+#ifdef QT_DBUS_LIB
+    if (iconRevisionLog) {
+        counter.add(sizeof(SNIIconRevisionLog)
+                    + iconRevisionLog->entries.capacity() * sizeof(SNIIconRevisionLog::Entry));
+        for (const SNIIconRevisionLog::Entry& entry : std::as_const(iconRevisionLog->entries))
+            counter.add(entry.rects.capacity() * sizeof(QRect));
+    }
+    if (progress) {
+        counter.add(sizeof(SNIProgressState)
+                    + progress->frames.capacity() * sizeof(SNIIconList));
+        counter.add(progress->restore);
+        for (const SNIIconList& frame : std::as_const(progress->frames))
+            counter.add(frame);
+    }
+    if (latency)
+        counter.add(latency->memoryUsage());
+    if (passiveDeferral)
+        counter.add(sizeof(SNIPassiveDeferral));
+    if (redundancyFilter) {
+        counter.add(sizeof(SNIRedundancyFilter));
+        for (const SNIRedundancyFilter::Value& value : redundancyFilter->fetched) {
+            for (const QString& text : value.text)
+                counter.add(text);
+        }
+    }
+
+    counter.add(sizeof(StatusNotifierItemDBus) + sizeof(StatusNotifierItemDBusPrivate));
+    if (dbus->d->transport)
+        counter.add(dbus->d->transport->memoryUsage());
+    counter.add(dbus->d->menuObjectPath.path());
+#endif
+    return counter.total;
+}
+
+QString StatusNotifierItemPrivate::intern(const QString& string)
+{
+    if (string.isEmpty())
+        return string;
+
+    SNIStringPool* pool = stringPool();
+    QMutexLocker locker(&pool->mutex);
+
+    const auto it = pool->strings.constFind(string);
+    if (it != pool->strings.constEnd())
+        return *it;
+
+    pool->strings.insert(string);
+    return string;
+}
+
+QIcon StatusNotifierItemPrivate::sourceIcon(SNIIconSlot::Kind kind) const
+{
+    const SNIIconSlot& slot = icons[kind];
+
+#ifdef QT_DBUS_LIB
+    // dropped in lean mode, rebuilt from the pixmaps sent on the bus
+    if (slot.icon.isNull() && slot.name.isEmpty() && slot.cacheKey != 0) {
+        if (kind == SNIIconSlot::Main && isProgressActive())
+            return pixmapListToIcon(progress->restore);
+
+        return pixmapListToIcon(slot.serialized);
+    }
+#endif
+    return slot.icon;
+}
+
+void StatusNotifierItemPrivate::parseToolTipTemplate(SNIToolTipTemplate& toolTip, const QString& text)
+{
+    toolTip.text = text;
+
+    QString literal;
+    for (int i = 0; i < text.size(); ++i) {
+        const QChar c = text.at(i);
+
+        // doubled braces are literal ones
+        if ((c == QLatin1Char('{') || c == QLatin1Char('}')) && i + 1 < text.size() && text.at(i + 1) == c) {
+            literal += c;
+            ++i;
+            continue;
+        }
+        const int end = c == QLatin1Char('{') ? text.indexOf(QLatin1Char('}'), i + 1) : -1;
+        if (end < 0) {
+            literal += c;
+            continue;
+        }
+        const QString name = text.mid(i + 1, end - i - 1);
+
+        int field = 0;
+        while (field < toolTip.fields.size() && toolTip.fields.at(field).name != name)
+            ++field;
+        if (field == toolTip.fields.size()) {
+            toolTip.fields.append(SNIToolTipTemplate::Field());
+            toolTip.fields.last().name = name;
+        }
+        toolTip.literals.append(std::exchange(literal, QString()));
+        toolTip.placeholders.append(field);
+        i = end;
+    }
+    toolTip.literals.append(literal);
+}
+
+const QString& StatusNotifierItemPrivate::toolTipDescription() const
+{
+    SNIToolTipTemplate* toolTip = toolTipTemplate.get();
+    if (!toolTip)
+        return toolTipSubTitle;
+
+    if (!toolTip->stale)
+        return toolTip->description;
+
+    // reuses the buffer, unless a host still holds the previous description
+    QString& description = toolTip->description;
+    description.resize(0);
+
+    for (int i = 0; i < toolTip->placeholders.size(); ++i) {
+        description += toolTip->literals.at(i);
+
+        const SNIToolTipTemplate::Field& field = toolTip->fields.at(toolTip->placeholders.at(i));
+        if (field.precision < 0)
+            description += field.text;
+        else
+            description += QString::number(field.number, 'f', field.precision);
+    }
+    description += toolTip->literals.constLast();
+
+    toolTip->stale = false;
+    return description;
+}
+
+SNIToolTipTemplate::Field* StatusNotifierItemPrivate::toolTipField(const QString& name)
+{
+    if (!toolTipTemplate)
+        return nullptr;
+
+    // a handful of fields, cheaper than hashing the name
+    for (SNIToolTipTemplate::Field& field : toolTipTemplate->fields) {
+        if (field.name == name)
+            return &field;
+    }
+    return nullptr;
+}
+
+void StatusNotifierItemPrivate::toolTipFieldChanged()
+{
+    toolTipTemplate->stale = true;
+
+#ifdef QT_DBUS_LIB
+    notifyChange(SNILatencyTracker::ToolTip);
+#endif
+}
+
+namespace {
+// Leaves the file untouched when it has the same contents, so hosts keep their cache
+bool writeIfChanged(const QString& path, const QByteArray& contents)
+{
+    QFile current(path);
+    if (current.open(QIODevice::ReadOnly) && current.size() == contents.size() && current.readAll() == contents)
+        return true;
+
+    QSaveFile file(path);
+    return file.open(QIODevice::WriteOnly)
+        && file.write(contents) == contents.size()
+        && file.commit();
+}
+} // namespace
+
+QString StatusNotifierItemPrivate::exportedIconThemePath() const
+{
+    QString name = id;
+    name.replace(QLatin1Char('/'), QLatin1Char('_'));
+    if (name.isEmpty() || name.startsWith(QLatin1Char('.')))
+        name.prepend(QLatin1Char('_'));
+
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+           + QLatin1String("/statusnotifieritem-qt/themes/") + name;
+}
+
+bool StatusNotifierItemPrivate::exportIcon(const QString& name, const QIcon& icon)
+{
+    // the name is a file name in the theme, not a path
+    if (name.isEmpty() || name.contains(QLatin1Char('/')) || name.startsWith(QLatin1Char('.'))) {
+        qWarning("StatusNotifierItem: invalid icon name '%s', not exported", qUtf8Printable(name));
+        return false;
+    }
+    const auto exported = exportedIcons.constFind(name);
+    if (exported != exportedIcons.constEnd() && exported.value() == icon.cacheKey())
+        return true;
+
+    const QString themeDir = exportedIconThemePath() + QLatin1String("/hicolor");
+
+    QList<QSize> sizes = icon.availableSizes();
+    if (sizes.isEmpty()) {
+        // scalable icons don't report any size
+        for (int size : { 16, 22, 24, 32, 48, 64, 128 })
+            sizes.append(QSize(size, size));
+    }
+    bool ok = true;
+    for (const QSize &size : std::as_const(sizes)) {
+        const QString dir = QString::fromLatin1("%1/%2x%3/apps")
+                                .arg(themeDir).arg(size.width()).arg(size.height());
+        if (!QDir().mkpath(dir)) {
+            ok = false;
+            continue;
+        }
+        QByteArray png;
+        QBuffer    buffer(&png);
+        ok = buffer.open(QIODevice::WriteOnly)
+             && icon.pixmap(size).save(&buffer, "PNG")
+             && writeIfChanged(dir + QLatin1Char('/') + name + QLatin1String(".png"), png)
+             && ok;
+    }
+    if (ok)
+        exportedIcons.insert(name, icon.cacheKey());
+    return ok;
+}
+
+bool StatusNotifierItemPrivate::writeIconThemeIndex() const
+{
+    const QString themeDir = exportedIconThemePath() + QLatin1String("/hicolor");
+
+    // list every size exported so far, not only the ones of the last call
+    QStringList directories;
+    QString     sections;
+    const QStringList sizeDirs = QDir(themeDir).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const QString &sizeDir : sizeDirs) {
+        const int size = sizeDir.section(QLatin1Char('x'), 0, 0).toInt();
+        if (size <= 0)
+            continue;
+
+        const QString directory = sizeDir + QLatin1String("/apps");
+        directories.append(directory);
+        sections += QString::fromLatin1("\n[%1]\nSize=%2\nContext=Applications\nType=Fixed\n")
+                        .arg(directory).arg(size);
+    }
+    const QString index = QLatin1String("[Icon Theme]\nName=hicolor\nDirectories=")
+                          + directories.join(QLatin1Char(',')) + QLatin1Char('\n')
+                          + sections;
+    return writeIfChanged(themeDir + QLatin1String("/index.theme"), index.toUtf8());
+}
+
+#ifdef QT_DBUS_LIB
+namespace {
+// Bounding rectangle of the pixels that differ between two images of the same size
+QRect changedRect(const SNIIcon& before, const SNIIcon& after)
+{
+    if (before.bytes.constData() == after.bytes.constData())
+        return QRect();
+
+    const int width  = after.width;
+    const int height = after.height;
+    const qsizetype size = qsizetype(width) * height * 4;
+    if (before.bytes.size() != size || after.bytes.size() != size)
+        return QRect(0, 0, width, height);
+
+    const quint32* a = reinterpret_cast<const quint32*>(before.bytes.constData());
+    const quint32* b = reinterpret_cast<const quint32*>(after.bytes.constData());
+
+    int top = -1, bottom = -1, left = width, right = -1;
+    for (int y = 0; y < height; ++y) {
+        const quint32* rowA = a + qsizetype(y) * width;
+        const quint32* rowB = b + qsizetype(y) * width;
+        if (std::memcmp(rowA, rowB, size_t(width) * 4) == 0)
+            continue;
+
+        if (top < 0)
+            top = y;
+        bottom = y;
+
+        int x0 = 0;
+        while (rowA[x0] == rowB[x0])
+            ++x0;
+        int x1 = width - 1;
+        while (rowA[x1] == rowB[x1])
+            --x1;
+
+        left  = qMin(left, x0);
+        right = qMax(right, x1);
+    }
+    if (top < 0)
+        return QRect();
+
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+} // namespace
+
+SNIIconList StatusNotifierItemPrivate::badgeIcons() const
+{
+    // the sizes of the main icon, without serializing it if it is stale
+    const SNIIconSlot& main = icons[SNIIconSlot::Main];
+
+    QList<QSize> sizes;
+    if (!main.stale) {
+        for (const SNIIcon &pix : std::as_const(main.serialized))
+            sizes.append(QSize(pix.width, pix.height));
+    } else if (main.name.isEmpty()) {
+        sizes = main.icon.availableSizes();
+    }
+    if (sizes.isEmpty())
+        sizes = defaultIconSizes();
+
+    return SNIBadgeRenderer::render(badgeText, sizes);
+}
+
+const SNIIconList& StatusNotifierItemPrivate::serialized(SNIIconSlot::Kind kind)
+{
+    SNIIconSlot& slot = icons[kind];
+    if (!slot.stale)
+        return slot.serialized;
+
+    slot.stale = false;
+
+    // icons set by name are looked up by the host
+    SNIIconList list;
+    if (kind == SNIIconSlot::Overlay && !badgeText.isEmpty())
+        list = badgeIcons();
+    else if (slot.name.isEmpty())
+        list = iconToPixmapList(slot.icon);
+    const quint64 hash = sharePayloads(list);
+
+    // the same pixels in a new QIcon, e.g. rebuilt from resources, change nothing;
+    // progress frames are drawn over the icon they restore when done
+    const SNIIconList& current = kind == SNIIconSlot::Main && isProgressActive()
+                               ? progress->restore : slot.serialized;
+    const bool changed = hash != slot.contentHash || !sameContent(list, current);
+    slot.contentHash = hash;
+
+    if (kind != SNIIconSlot::Main || !changed) {
+        if (changed)
+            slot.serialized = std::move(list);
+        if (leanMode)
+            slot.icon = QIcon();
+
+        return slot.serialized;
+    }
+    const SNIIconList previous = std::exchange(slot.serialized, std::move(list));
+    if (progress)
+        progressBaseChanged();
+
+    iconChanged(previous);
+
+    if (leanMode)
+        slot.icon = QIcon();
+
+    return slot.serialized;
+}
+
+quint64 StatusNotifierItemPrivate::sharePayloads(SNIIconList& list) const
+{
+    SNIPayloadPool* pool = SNIPayloadPool::instance();
+
+    quint64 hash = 0;
+    for (SNIIcon& pix : list) {
+        const quint64 seed  = (quint64(quint32(pix.width)) << 32) | quint32(pix.height);
+        const quint64 bytes = SNIPayloadPool::hash(pix.bytes.constData(), pix.bytes.size(), seed);
+
+        // mapped payloads are already shared by the icon cache, and must not outlive their mapping;
+        // lean items reuse the payloads of the pool without adding theirs
+        if (!pix.mapping)
+            pix.bytes = pool->share(pix.bytes, bytes, !leanMode);
+        hash      = SNIPayloadPool::hash(&bytes, sizeof(bytes), hash);
+    }
+    return hash;
+}
+
+bool StatusNotifierItemPrivate::sameContent(const SNIIconList& a, const SNIIconList& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (int i = 0; i < a.size(); ++i) {
+        const SNIIcon& x = a.at(i);
+        const SNIIcon& y = b.at(i);
+
+        // shared payloads compare by address
+        if (x.width != y.width || x.height != y.height
+            || (x.bytes.constData() != y.bytes.constData() && x.bytes != y.bytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SNIIconList StatusNotifierItemPrivate::currentPixmaps(SNIIconSlot::Kind kind) const
+{
+    const SNIIconSlot& slot = icons[kind];
+    return slot.name.isEmpty() && !slot.stale ? slot.serialized : SNIIconList();
+}
+
+void StatusNotifierItemPrivate::notifyPixmapChange(SNIIconSlot::Kind kind, SNILatencyTracker::Update update,
+                                                   const SNIIconList& before, bool otherChanges)
+{
+    // telling a new QIcon with the same pixels serializes it now,
+    // instead of when the signal is sent, so not while deferred;
+    // the same pixels are neither announced nor charged to the budget
+    if (!before.isEmpty() && !isDeferred(update) && sameContent(before, serialized(kind))) {
+        if (otherChanges)
+            notifyChange(update);
+        return;
+    }
+    icons[kind].pixmapChanged = true;
+    notifyChange(update);
+}
+
+void StatusNotifierItemPrivate::iconChanged(const SNIIconList& previous)
+{
+    ++iconRevision;
+    icons[SNIIconSlot::Main].pixmapChanged = true;
+
+    if (iconRevisionLog) {
+        const SNIIconList& current = icons[SNIIconSlot::Main].serialized;
+
+        SNIIconRevisionLog::Entry entry;
+        entry.revision      = iconRevision;
+        entry.layoutChanged = previous.size() != current.size();
+
+        for (int i = 0; !entry.layoutChanged && i < current.size(); ++i) {
+            const SNIIcon& before = previous.at(i);
+            const SNIIcon& after  = current.at(i);
+            if (before.width != after.width || before.height != after.height)
+                entry.layoutChanged = true;
+            else
+                entry.rects.append(changedRect(before, after));
+        }
+        if (entry.layoutChanged)
+            entry.rects.clear();
+
+        QVector<SNIIconRevisionLog::Entry>& entries = iconRevisionLog->entries;
+        if (entries.size() == SNIIconRevisionLog::maxEntries)
+            entries.removeFirst();
+        entries.append(entry);
+    }
+}
+
+void StatusNotifierItemPrivate::trackChange(SNILatencyTracker::Update update)
+{
+    ++revisions[update];
+
+    if (latency)
+        latency->changed(update);
+}
+
+void StatusNotifierItemPrivate::trackFetch(SNILatencyTracker::Update update)
+{
+    if (latency)
+        latency->fetched(update);
+
+    if (redundancyFilter)
+        markFetched(update);
+
+    record(SNITrace::PropertyRead, int(update));
+}
+
+void StatusNotifierItemPrivate::notify(SNILatencyTracker::Update update)
+{
+    if (isDeferred(update)) {
+        deferredUpdates |= quint8(1 << update);
+        // only the changes held back because of the Passive status
+        if (passiveDeferral && status == StatusNotifierItem::Passive && visible && !isIdle())
+            ++passiveDeferral->deferredChanges;
+        return;
+    }
+    if (redundancyFilter && isRedundant(update)) {
+        ++redundancyFilter->skippedSignals;
+        return;
+    }
+    if (throttledUpdates & (1 << update)) {
+        // the signal waiting for the bandwidth budget announces this change too,
+        // unless it no longer needs to wait: the icon was set by name meanwhile,
+        // or the item needs attention
+        if (status != StatusNotifierItem::NeedsAttention && pixmapBytes(update) > 0) {
+            SNIBandwidthScheduler::instance()->coalesced();
+            return;
+        }
+        throttledUpdates &= quint8(~(1 << update));
+        emitUpdate(update);
+        return;
+    }
+    if (throttle(update))
+        return;
+
+    emitUpdate(update);
+}
+
+void StatusNotifierItemPrivate::emitUpdate(SNILatencyTracker::Update update)
+{
+    if (latency)
+        latency->emitted(update);
+
+    SNITransport* transport = dbus->d->transport.get();
+    switch (update) {
+    case SNILatencyTracker::Status:
+        transport->emitSignal(SNITransport::NewStatus, QString::fromLatin1(
+            q->metaObject()->enumerator(q->metaObject()->indexOfEnumerator("SNIStatus")).valueToKey(status))
+        );
+        break;
+    case SNILatencyTracker::Title:
+        transport->emitSignal(SNITransport::NewTitle);
+        break;
+    case SNILatencyTracker::Icon:
+        // the revision announced below is the one of the serialized icon
+        serialized(SNIIconSlot::Main);
+        transport->emitSignal(SNITransport::NewIcon);
+
+        if (emittedIconRevision != iconRevision) {
+            emittedIconRevision = iconRevision;
+            transport->emitIconRevision(iconRevision);
+        }
+        break;
+    case SNILatencyTracker::OverlayIcon:
+        transport->emitSignal(SNITransport::NewOverlayIcon);
+        break;
+    case SNILatencyTracker::AttentionIcon:
+        transport->emitSignal(SNITransport::NewAttentionIcon);
+        break;
+    case SNILatencyTracker::ToolTip:
+        transport->emitSignal(SNITransport::NewToolTip);
+        break;
+    case SNILatencyTracker::IconThemePath:
+        transport->emitSignal(SNITransport::NewIconThemePath, iconThemePath);
+        break;
+    case SNILatencyTracker::UpdateCount:
+        break;
+    }
+
+    // the status and the theme path are sent with their signal
+    if (redundancyFilter
+        && (update == SNILatencyTracker::Status || update == SNILatencyTracker::IconThemePath)) {
+        markFetched(update);
+    }
+    if (revisionSignals)
+        transport->emitRevision(QLatin1String(SNILatencyTracker::updateName(update)), revisions[update]);
+
+    const SNIIconSlot::Kind kind = iconKind(update);
+    if (kind != SNIIconSlot::KindCount)
+        icons[kind].pixmapChanged = false;
+}
+
+SNIIconSlot::Kind StatusNotifierItemPrivate::iconKind(SNILatencyTracker::Update update)
+{
+    switch (update) {
+    case SNILatencyTracker::Icon:          return SNIIconSlot::Main;
+    case SNILatencyTracker::OverlayIcon:   return SNIIconSlot::Overlay;
+    case SNILatencyTracker::AttentionIcon: return SNIIconSlot::Attention;
+    case SNILatencyTracker::ToolTip:       return SNIIconSlot::ToolTip;
+    default:
+        return SNIIconSlot::KindCount;
+    }
+}
+
+qint64 StatusNotifierItemPrivate::pixmapBytes(SNILatencyTracker::Update update) const
+{
+    // only new pixmaps are charged, not names nor the text of the tooltip
+    const SNIIconSlot::Kind kind = iconKind(update);
+    if (kind == SNIIconSlot::KindCount)
+        return 0;
+
+    const SNIIconSlot& slot = icons[kind];
+    if (!slot.pixmapChanged || !slot.name.isEmpty())
+        return 0;
+
+    // estimated from the sizes of the icon until it is serialized
+    qint64 bytes = 0;
+    if (!slot.stale) {
+        for (const SNIIcon& pix : slot.serialized)
+            bytes += pix.bytes.size();
+    } else {
+        const QList<QSize> sizes = kind == SNIIconSlot::Overlay && !badgeText.isEmpty()
+                                 ? defaultIconSizes() : slot.icon.availableSizes();
+        for (const QSize& size : sizes)
+            bytes += qint64(size.width()) * size.height() * 4;
+    }
+    return bytes;
+}
+
+bool StatusNotifierItemPrivate::throttle(SNILatencyTracker::Update update)
+{
+    SNIBandwidthScheduler* scheduler = SNIBandwidthScheduler::instance();
+    if (scheduler->budget() <= 0)
+        return false;
+
+    // updates by name, or keeping their pixmaps, are not limited
+    const qint64 bytes = pixmapBytes(update);
+    if (bytes == 0)
+        return false;
+
+    const int delay = scheduler->reserve(bytes, status == StatusNotifierItem::NeedsAttention);
+    if (delay == 0)
+        return false;
+
+    // sent earlier if a name or NeedsAttention doesn't have to wait
+    const quint32 serial = ++throttleSerials[update];
+    throttledUpdates |= quint8(1 << update);
+    QTimer::singleShot(delay, q, [this, update, serial] {
+        if (!(throttledUpdates & (1 << update)) || throttleSerials[update] != serial)
+            return;
+
+        throttledUpdates &= quint8(~(1 << update));
+
+        // the item may have lost its host or become Passive meanwhile
+        if (isDeferred(update)) {
+            deferredUpdates |= quint8(1 << update);
+            return;
+        }
+        if (redundancyFilter && isRedundant(update)) {
+            ++redundancyFilter->skippedSignals;
+            return;
+        }
+        emitUpdate(update);
+    });
+    return true;
+}
+
+void StatusNotifierItemPrivate::notifyChange(SNILatencyTracker::Update update)
+{
+    trackChange(update);
+    notify(update);
+}
+
+SNIRedundancyFilter::Value StatusNotifierItemPrivate::groupValue(SNILatencyTracker::Update update) const
+{
+    SNIRedundancyFilter::Value value;
+
+    switch (update) {
+    case SNILatencyTracker::Status:
+        value.keys[0] = status;
+        break;
+    case SNILatencyTracker::Title:
+        value.text[0] = title;
+        break;
+    case SNILatencyTracker::Icon: {
+        const SNIIconSlot& slot = icons[SNIIconSlot::Main];
+        value.text[0] = slot.name;
+        value.text[1] = iconThemePath; // names are looked up in it
+        value.keys[0] = slot.cacheKey;
+        if (isProgressActive())
+            value.keys[1] = (qint64(progress->steps) << 32) | quint32(progress->frame);
+        break;
+    }
+    case SNILatencyTracker::OverlayIcon:
+        value.text[0] = icons[SNIIconSlot::Overlay].name;
+        value.text[1] = badgeText;
+        value.keys[0] = icons[SNIIconSlot::Overlay].cacheKey;
+        break;
+    case SNILatencyTracker::AttentionIcon:
+        value.text[0] = icons[SNIIconSlot::Attention].name;
+        value.keys[0] = icons[SNIIconSlot::Attention].cacheKey;
+        break;
+    case SNILatencyTracker::ToolTip:
+        value.text[0] = icons[SNIIconSlot::ToolTip].name;
+        value.text[1] = toolTipTitle;
+        value.text[2] = toolTipDescription();
+        value.keys[0] = icons[SNIIconSlot::ToolTip].cacheKey;
+        break;
+    case SNILatencyTracker::IconThemePath:
+        value.text[0] = iconThemePath;
+        break;
+    case SNILatencyTracker::UpdateCount:
+        break;
+    }
+    return value;
+}
+
+bool StatusNotifierItemPrivate::isRedundant(SNILatencyTracker::Update update) const
+{
+    return (redundancyFilter->known & (1 << update))
+        && redundancyFilter->fetched[update] == groupValue(update);
+}
+
+void StatusNotifierItemPrivate::markFetched(SNILatencyTracker::Update update)
+{
+    redundancyFilter->fetched[update] = groupValue(update);
+    redundancyFilter->known |= quint8(1 << update);
+}
+
+bool StatusNotifierItemPrivate::isIdle() const
+{
+    return idleMode && !dbus->d->hostAvailable;
+}
+
+bool StatusNotifierItemPrivate::isDeferred(SNILatencyTracker::Update update) const
+{
+    // hidden items have no connection
+    if (!visible || isIdle())
+        return true;
+
+    // hosts usually hide Passive items, only the status matters to them
+    return passiveDeferral
+        && status == StatusNotifierItem::Passive
+        && update != SNILatencyTracker::Status;
+}
+
+void StatusNotifierItemPrivate::attach()
+{
+    // hosts read the whole item once it is registered: its state is
+    // serialized beforehand, and the changes made while hidden not announced
+    for (int kind = 0; kind < SNIIconSlot::KindCount; ++kind)
+        serialized(SNIIconSlot::Kind(kind));
+    toolTipDescription();
+    deferredUpdates = 0;
+
+    dbus->d->attach();
+}
+
+void StatusNotifierItemPrivate::flushDeferredUpdates()
+{
+    // a single signal per property, whatever the number of changes meanwhile
+    const quint8 updates = std::exchange(deferredUpdates, quint8(0));
+    for (int update = 0; update < SNILatencyTracker::UpdateCount; ++update) {
+        if (updates & (1 << update))
+            notify(SNILatencyTracker::Update(update));
+    }
+}
+
+void StatusNotifierItemPrivate::flushPassiveUpdates()
+{
+    const int pending = qPopulationCount(deferredUpdates);
+    flushDeferredUpdates();
+
+    // the updates still deferred are waiting for a host
+    passiveDeferral->sentSignals += quint32(pending - qPopulationCount(deferredUpdates));
+    ++passiveDeferral->flushes;
+}
+
+bool StatusNotifierItemPrivate::isProgressActive() const
+{
+    return progress && progress->value >= 0.0;
+}
+
+void StatusNotifierItemPrivate::progressBaseChanged()
+{
+    progress->frames.clear();
+
+    if (!isProgressActive())
+        return;
+
+    progress->restore = icons[SNIIconSlot::Main].serialized;
+    progress->frame   = -1;
+    showProgressFrame();
+}
+
+void StatusNotifierItemPrivate::renderProgressFrames()
+{
+    const SNIIconSlot& slot = icons[SNIIconSlot::Main];
+    const QIcon base = slot.name.isEmpty() ? sourceIcon(SNIIconSlot::Main) : QIcon::fromTheme(slot.name);
+
+    QList<QSize> sizes = base.availableSizes();
+    if (sizes.isEmpty())
+        sizes = defaultIconSizes();
+
+    progress->frames = QVector<SNIIconList>(progress->steps + 1);
+
+    for (const QSize& size : std::as_const(sizes)) {
+        QImage image = base.pixmap(size).toImage();
+        if (image.isNull()) {
+            image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::transparent);
+        } else {
+            image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+
+        const int   barHeight = qMax(2, image.height() / 8);
+        const int   margin    = qMax(1, image.width() / 16);
+        const QRect track(margin, image.height() - barHeight - margin,
+                          image.width() - 2 * margin, barHeight);
+
+        for (int frame = 0; frame <= progress->steps; ++frame) {
+            QImage canvas = image.copy();
+
+            QPainter painter(&canvas);
+            painter.fillRect(track, QColor(0, 0, 0, 160));
+            painter.fillRect(QRect(track.topLeft(), QSize(track.width() * frame / progress->steps, track.height())),
+                             QColor(61, 174, 233));
+            painter.end();
+
+            progress->frames[frame].append(imageToPixmap(canvas));
+        }
+    }
+}
+
+bool StatusNotifierItemPrivate::showProgressFrame()
+{
+    const int frame = qBound(0, qRound(progress->value * progress->steps), progress->steps);
+    if (frame == progress->frame && !progress->frames.isEmpty())
+        return false;
+
+    if (progress->frames.isEmpty())
+        renderProgressFrames();
+
+    // frames are implicitly shared, this doesn't copy any pixel
+    progress->frame = frame;
+    icons[SNIIconSlot::Main].serialized = progress->frames.at(frame);
+    return true;
+}
+
+void StatusNotifierItemPrivate::scheduleProgressEmission()
+{
+    if (progress->emissionPending)
+        return;
+
+    const qint64 elapsed = progress->lastEmission.isValid()
+                         ? progress->lastEmission.elapsed()
+                         : progress->interval;
+    if (elapsed >= progress->interval) {
+        progress->lastEmission.start();
+        notify(SNILatencyTracker::Icon);
+        return;
+    }
+    progress->emissionPending = true;
+    QTimer::singleShot(int(progress->interval - elapsed), q, [this] {
+        if (!progress || !progress->emissionPending)
+            return;
+
+        progress->emissionPending = false;
+        progress->lastEmission.start();
+        notify(SNILatencyTracker::Icon);
+    });
+}
+
+SNIIconDeltaList StatusNotifierItemPrivate::iconDelta(quint32 revision) const
+{
+    const SNIIconList& current = icons[SNIIconSlot::Main].serialized;
+
+    // union of the changed areas since the given revision, if all of them are known
+    bool full = true;
+    QVector<QRect> rects;
+    if (revision == iconRevision) {
+        full = false;
+        rects.resize(current.size());
+    } else if (iconRevisionLog && revision < iconRevision) {
+        const QVector<SNIIconRevisionLog::Entry>& entries = iconRevisionLog->entries;
+        if (!entries.isEmpty() && entries.first().revision <= revision + 1) {
+            full = false;
+            rects.resize(current.size());
+            for (const SNIIconRevisionLog::Entry& entry : entries) {
+                if (entry.revision <= revision)
+                    continue;
+                if (entry.layoutChanged) {
+                    full = true;
+                    break;
+                }
+                for (int i = 0; i < rects.size(); ++i)
+                    rects[i] |= entry.rects.at(i);
+            }
+        }
+    }
+
+    SNIIconDeltaList deltaList;
+    for (int i = 0; i < current.size(); ++i) {
+        const SNIIcon& pix  = current.at(i);
+        const QRect    rect = full ? QRect(0, 0, pix.width, pix.height) : rects.at(i);
+
+        SNIIconDelta delta;
+        delta.width      = pix.width;
+        delta.height     = pix.height;
+        delta.x          = rect.x();
+        delta.y          = rect.y();
+        delta.rectWidth  = rect.width();
+        delta.rectHeight = rect.height();
+
+        if (full) {
+            delta.bytes = pix.bytes;
+        } else if (!rect.isEmpty()) {
+            const int rowSize = rect.width() * 4;
+            delta.bytes.resize(rowSize * rect.height());
+            for (int y = 0; y < rect.height(); ++y) {
+                const qsizetype offset = (qsizetype(rect.y() + y) * pix.width + rect.x()) * 4;
+                std::memcpy(delta.bytes.data() + qsizetype(y) * rowSize,
+                            pix.bytes.constData() + offset, size_t(rowSize));
+            }
+        }
+        deltaList.append(delta);
+    }
+    return deltaList;
+}
+
+QList<QSize> StatusNotifierItemPrivate::defaultIconSizes()
+{
+    return { QSize(16, 16), QSize(22, 22), QSize(24, 24), QSize(32, 32), QSize(48, 48), QSize(64, 64) };
+}
+
+SNIIcon StatusNotifierItemPrivate::imageToPixmap(QImage image)
+{
+    SNIIcon pix;
+    pix.height = image.height();
+    pix.width = image.width();
+
+    // unpremultiplied and swapped to network byte order in a single pass
+    pix.bytes = SNIPixelConverter::toWire(image);
+    return pix;
+}
+
+SNIIconList StatusNotifierItemPrivate::iconToPixmapList(const QIcon& icon)
+{
+    SNIIconList pixmapList;
+    SNIIconCache* cache = SNIIconCache::instance();
+    // read once, the key is computed only when the cache is used
+    const bool cached = cache->isEnabled();
+
+    const QList<QSize> sizes = icon.availableSizes();
+    for (const QSize &size : sizes) {
+        QImage image = icon.pixmap(size).toImage();
+
+        SNIIcon pix;
+        pix.height = image.height();
+        pix.width = image.width();
+
+        QByteArray cacheKey;
+        if (cached) {
+            cacheKey  = SNIIconCache::key(image);
+            pix.bytes = cache->find(cacheKey, pix.width, pix.height, pix.mapping);
+            if (!pix.bytes.isNull()) {
+                pixmapList.append(pix);
+                continue;
+            }
+        }
+
+        pix.bytes = imageToPixmap(image).bytes;
+
+        if (cached)
+            cache->insert(cacheKey, pix.width, pix.height, pix.bytes);
 
-            for (uint i = 0; i < pix.bytes.size() / sizeof(quint32); ++i) {
-                *uintBuf = qToBigEndian(*uintBuf);
-                ++uintBuf;
-            }
-        }
         pixmapList.append(pix);
     }
     return pixmapList;
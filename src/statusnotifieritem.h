@@ -11,18 +11,66 @@
 
 #include "statusnotifieritem_export.h"
 
+#include <QHash>
 #include <QIcon>
 #include <QObject>
 #include <QPoint>
+#include <QPointer>
 #include <QString>
+#include <QVariantMap>
 
+#include <functional>
 #include <memory>
 
 QT_BEGIN_NAMESPACE
 class QMenu;
 QT_END_NAMESPACE
 
+class StatusNotifierItem;
 class StatusNotifierItemPrivate;
+/*!
+    Awaitable state of a StatusNotifierItem, for C++20 coroutines.
+
+    The library itself doesn't need C++20: await_suspend() accepts any
+    coroutine handle, so the awaiter works with `co_await` in code built
+    with coroutine support, e.g. a QCoro or a custom task type.
+
+    The coroutine is resumed from the event loop, never from inside the
+    library, and also when the item is destroyed; in that case the result
+    of `co_await` is false.
+
+    @see StatusNotifierItem::registered() StatusNotifierItem::hostAvailable()
+*/
+class SNI_QT_EXPORT StatusNotifierItemAwaiter
+{
+public:
+    //! The state awaited.
+    enum Kind {
+        Registration,     //!< The watcher answered the registration
+        HostAvailability, //!< A host is available
+    };
+
+    bool await_ready() const;
+
+    template<typename Handle>
+    void await_suspend(Handle handle)
+    {
+        wait([handle]() mutable { handle.resume(); });
+    }
+
+    bool await_resume() const;
+
+private:
+    friend class StatusNotifierItem;
+
+    StatusNotifierItemAwaiter(StatusNotifierItem *item, Kind kind);
+
+    void wait(std::function<void()> resume);
+
+    QPointer<QObject> item_;
+    Kind              kind_;
+};
+
 /*!
     Qt implementation of the Freedesktop' [StatusNotifierItem] specification.
 
@@ -38,6 +86,11 @@ class StatusNotifierItemPrivate;
     Each instance of StatusNotifierItem must provide an object called
     StatusNotifierItem with the following properties, methods and signals.
 
+    Items can be created from any thread running an event loop, which then
+    serves their D-Bus calls; each item is used from the thread it lives in.
+    Context menus, being widgets, and icons set by pixmap, converted with
+    QPixmap, are subject to the thread rules of these classes.
+
     [StatusNotifierItem]: https://www.freedesktop.org/wiki/Specifications/StatusNotifierItem/
 */
 class SNI_QT_EXPORT StatusNotifierItem : public QObject
@@ -46,6 +99,8 @@ class SNI_QT_EXPORT StatusNotifierItem : public QObject
 
     friend class StatusNotifierItemPrivate;
     friend class StatusNotifierItemDBus;
+    friend class StatusNotifierItemDBusPrivate;
+    friend class StatusNotifierItemAwaiter;
 
 public:
     //! Describes the status of this item or of the associated application.
@@ -97,6 +152,19 @@ public:
     */
     StatusNotifierItem(QString id, QObject *parent = nullptr);
 
+    /**
+        Construct a new status notifier item, hidden unless @p visible.
+
+        A hidden item holds its state only: it has no bus connection and
+        is not registered to the StatusNotifierWatcher until show().
+
+        @param id      The application id.
+        @param visible Whether the item is shown right away.
+        @param parent  The parent object.
+        @see setVisible()
+    */
+    StatusNotifierItem(QString id, bool visible, QObject *parent = nullptr);
+
     ~StatusNotifierItem() override;
 
     /*!
@@ -151,6 +219,37 @@ public:
     */
     QString iconName() const;
 
+    /*!
+        Sets an additional path the host adds to its icon theme search path,
+        to find the icons set by name.
+
+        @param path a directory containing one or more icon themes.
+        @see exportIcons()
+    */
+    void setIconThemePath(const QString &path);
+
+    /*!
+        @return the additional icon theme search path.
+    */
+    QString iconThemePath() const;
+
+    /*!
+        Writes @p icons once into a private hicolor icon theme and sets
+        its base directory as iconThemePath().
+
+        Afterwards the exported icons can be set by name with setIconByName()
+        and its siblings, so icon changes don't transfer pixmap data over the bus
+        and the host is free to cache the icons.
+        Icons are written for each of their available sizes; an icon exported
+        before under the same name is skipped when it is the same QIcon, and its
+        files are left untouched when their contents didn't change.
+
+        @param icons the icons to export, by icon name, which can't contain '/'
+                     nor start with '.'.
+        @return whether all the icons were written.
+    */
+    bool exportIcons(const QHash<QString, QIcon> &icons);
+
     /*!
         Sets a new main icon for the system tray
 
@@ -161,9 +260,70 @@ public:
 
     /*!
         @return the icon.
+        @note In memory-lean mode, each call converts the serialized pixmaps
+        to a new QIcon, which costs about as much as setting it: keep the
+        returned icon rather than calling this repeatedly.
+        @see setMemoryLeanModeEnabled()
     */
     QIcon iconPixmap() const;
 
+    /*!
+        Shows a progress bar over the main icon.
+
+        The frames for all the steps are rendered once from the main icon,
+        for each of its sizes, and kept serialized: later progress changes
+        only swap the frame shown. NewIcon is emitted only when the shown frame
+        changes, at most once per progressUpdateInterval().
+
+        @param progress the progress between 0.0 and 1.0,
+        a negative value removes the progress bar.
+        @note Frames take steps + 1 times the memory of the main icon.
+    */
+    void setProgress(double progress);
+
+    /*!
+        @return the progress shown, negative if there is none.
+    */
+    double progress() const;
+
+    /*!
+        Sets the number of progress steps, 100 by default.
+    */
+    void setProgressSteps(int steps);
+
+    /*!
+        @return the number of progress steps.
+    */
+    int progressSteps() const;
+
+    /*!
+        Sets the minimum interval between progress updates sent to the host,
+        100ms by default.
+    */
+    void setProgressUpdateInterval(int msec);
+
+    /*!
+        @return the minimum interval between progress updates.
+    */
+    int progressUpdateInterval() const;
+
+    /*!
+        Enables tracking the changed areas of the main icon, disabled by default.
+
+        Hosts supporting the io.github.qtilities.StatusNotifierItem extension
+        can then fetch with IconPixmapDelta() only the areas that changed since
+        the revision they know, instead of every size in full.
+        This is useful for progress or meter icons, where only a few pixels
+        change between frames.
+    */
+    void setIconDeltaUpdatesEnabled(bool enabled);
+
+    /*!
+        @return whether the changed areas of the main icon are tracked.
+        @see setIconDeltaUpdatesEnabled()
+    */
+    bool isIconDeltaUpdatesEnabled() const;
+
     /*!
         Sets an icon to be used as overlay for the main one
 
@@ -188,9 +348,45 @@ public:
 
     /*!
         @return the overlay icon.
+        @note In memory-lean mode, each call converts the serialized pixmaps
+        to a new QIcon, which costs about as much as setting it: keep the
+        returned icon rather than calling this repeatedly.
+        @see setMemoryLeanModeEnabled()
     */
     QIcon overlayIconPixmap() const;
 
+    /*!
+        Shows a counter as overlay icon, e.g. the number of unread messages.
+        Counts above 99 are shown as "99+".
+
+        @param count the count to show, 0 or less removes the badge.
+        @see setBadgeText()
+    */
+    void setBadgeCount(int count);
+
+    /*!
+        @return the count shown as overlay icon, 0 if there is none.
+    */
+    int badgeCount() const;
+
+    /*!
+        Shows a short text on a colored badge as overlay icon,
+        replacing overlayIconName() and overlayIconPixmap().
+
+        The badge is rendered for each size of the main icon from glyphs
+        rasterized once and shared by all the items, so that frequent changes
+        are cheap. Only printable ASCII characters are supported,
+        other characters are shown as '?'.
+
+        @param text the text to show, an empty string removes the badge.
+    */
+    void setBadgeText(const QString &text);
+
+    /*!
+        @return the text shown as overlay icon.
+    */
+    QString badgeText() const;
+
     /*!
         Sets a new icon that should be used when the application wants to request attention
         (usually the systemtray will blink between this icon and the main one).
@@ -216,6 +412,10 @@ public:
 
     /*!
         @return the requesting attention icon.
+        @note In memory-lean mode, each call converts the serialized pixmaps
+        to a new QIcon, which costs about as much as setting it: keep the
+        returned icon rather than calling this repeatedly.
+        @see setMemoryLeanModeEnabled()
     */
     QIcon attentionIconPixmap() const;
 #if 0
@@ -272,6 +472,10 @@ public:
 
     /*!
         @return the tooltip icon.
+        @note In memory-lean mode, each call converts the serialized pixmaps
+        to a new QIcon, which costs about as much as setting it: keep the
+        returned icon rather than calling this repeatedly.
+        @see setMemoryLeanModeEnabled()
     */
     QIcon toolTipIconPixmap() const;
 
@@ -291,10 +495,43 @@ public:
     void setToolTipSubTitle(const QString &subTitle);
 
     /*!
-        @return the subtitle of the tooltip.
+        @return the subtitle of the tooltip, rendered from the template if any.
     */
     QString toolTipSubTitle() const;
 
+    /*!
+        Sets the template of the tooltip subtitle: fixed text with named
+        fields written `{name}`, and `{{` and `}}` for literal braces,
+        e.g. "CPU {cpu}% · RAM {ram} GiB · {jobs} jobs".
+
+        The fields are then updated one by one with setToolTipField().
+        The subtitle is only rendered when a host reads the tooltip, and
+        a field set to its current value doesn't announce any change,
+        so frequent updates neither format nor compare the whole text.
+        Fields keep their values when the template changes; new ones
+        are empty. An empty template keeps the last rendered subtitle,
+        which setToolTip() and setToolTipSubTitle() also replace.
+    */
+    void setToolTipTemplate(const QString &text);
+
+    /*!
+        @return the template of the tooltip subtitle, empty if none.
+    */
+    QString toolTipTemplate() const;
+
+    /*!
+        Sets the field @p name of the tooltip template to @p value.
+        Fields not in the template are ignored.
+    */
+    void setToolTipField(const QString &name, const QString &value);
+
+    /*!
+        Sets the field @p name of the tooltip template to @p value,
+        formatted on read with @p precision decimals.
+        This is an overloaded member provided for convenience.
+    */
+    void setToolTipField(const QString &name, double value, int precision = 0);
+
     /*!
         Sets a new context menu for this StatusNotifierItem.
 
@@ -313,6 +550,323 @@ public:
     */
     QMenu* contextMenu() const;
 
+    /*!
+        Enables or disables the tracking of update latencies, disabled by default.
+
+        For each update (status, title, icon, overlay icon, attention icon,
+        tooltip and icon theme path) the time from the setter call to the
+        emission of its New* signal, from the emission to the first fetch
+        of the value by a host and from the setter call to that fetch are
+        aggregated in histograms with a precision of about 6%.
+
+        Disabling the tracking discards the recorded values.
+    */
+    void setLatencyTrackingEnabled(bool enabled);
+
+    /*!
+        @return whether update latencies are tracked.
+    */
+    bool isLatencyTrackingEnabled() const;
+
+    /*!
+        @return the latencies recorded so far, in microseconds.
+
+        The map is keyed by update ("Status", "Title", "Icon", "OverlayIcon",
+        "AttentionIcon", "ToolTip" and "IconThemePath"), then by stage
+        ("setToEmit", "emitToFetch" and "setToFetch"); each value is a map
+        with the keys "count", "min", "max", "mean", "p50", "p90", "p99"
+        and "p99.9". Updates and stages without values are omitted.
+    */
+    QVariantMap latencyStatistics() const;
+
+    /*!
+        @return the latencies recorded so far as a text table,
+        e.g. for logging.
+    */
+    QString latencyReport() const;
+
+    /*!
+        Starts recording the calls made to this item into a binary trace:
+        the setters called by the application, the activation and scroll
+        requests of hosts and their property reads, with their timing.
+
+        The trace can be replayed against a fresh item with the sni-replay
+        tool. Setting the environment variable `SNI_QT_TRACE_DIR` records
+        every item to `<id>-<pid>-<n>.snitrace` in that directory,
+        where n numbers the items of the process.
+
+        @param fileName The trace file, overwritten if it exists.
+        @return whether the file could be opened.
+    */
+    bool startRecording(const QString &fileName);
+
+    /*!
+        Stops recording and closes the trace file.
+    */
+    void stopRecording();
+
+    /*!
+        @return whether the calls to this item are being recorded.
+    */
+    bool isRecording() const;
+
+    /*!
+        Shows or hides the item, shown by default.
+
+        Showing the item connects it to the bus, exports it and registers
+        it to the StatusNotifierWatcher, with its icons serialized and its
+        tooltip rendered beforehand, as hosts read the whole item once it
+        is registered. Hiding it closes its connection, so it disappears
+        from the hosts. The setters keep working on a hidden item, without
+        any signal; the changes are read when it is shown again.
+    */
+    void setVisible(bool visible);
+
+    /*!
+        @return whether the item is shown.
+    */
+    bool isVisible() const;
+
+    /*!
+        Shows the item, same as setVisible(true).
+    */
+    void show();
+
+    /*!
+        Hides the item, same as setVisible(false).
+    */
+    void hide();
+
+    /*!
+        @return whether the item is registered to the StatusNotifierWatcher.
+    */
+    bool isRegistered() const;
+
+    /*!
+        @return whether at least one StatusNotifierHost is available,
+        i.e. the item is shown in a tray.
+    */
+    bool isHostAvailable() const;
+
+    /*!
+        Awaits the answer of the StatusNotifierWatcher to the registration
+        of this item, which is sent asynchronously on construction.
+
+        @code
+        const bool ok = co_await item->registered();
+        @endcode
+
+        @return an awaiter resuming with whether the item is registered.
+        @see registrationFinished()
+    */
+    StatusNotifierItemAwaiter registered();
+
+    /*!
+        Awaits a StatusNotifierHost showing the item.
+
+        @return an awaiter resuming with true once a host is available.
+        @see hostAvailabilityChanged()
+    */
+    StatusNotifierItemAwaiter hostAvailable();
+
+    /*!
+        Enables or disables the idle mode, disabled by default.
+
+        While no StatusNotifierHost is available, e.g. in headless or locked
+        sessions, the setters of an item in idle mode only store the new
+        state: icons set by pixmap are not serialized and no change signal
+        is sent on D-Bus. When a host appears, each changed property is
+        announced once, and its icons are serialized when first read.
+
+        Until the StatusNotifierWatcher has answered whether a host is
+        registered, the item is considered idle as well. Only enable it
+        when every host registers to the StatusNotifierWatcher.
+    */
+    void setIdleModeEnabled(bool enabled);
+
+    /*!
+        @return whether the idle mode is enabled.
+        @see setIdleModeEnabled()
+    */
+    bool isIdleModeEnabled() const;
+
+    /*!
+        Enables or disables the memory-lean mode, disabled by default.
+
+        An icon set by pixmap is otherwise kept twice: as the given QIcon
+        and serialized for the bus. In lean mode, the QIcon is dropped once
+        serialized, and iconPixmap(), overlayIconPixmap(),
+        attentionIconPixmap() and toolTipIconPixmap() rebuild a new QIcon
+        from the serialized pixmaps on each call. Its pixmaps are not kept
+        in the pool shared by the items either, see sharedMemoryUsage().
+
+        @see memoryUsage()
+    */
+    void setMemoryLeanModeEnabled(bool enabled);
+
+    /*!
+        @return whether the memory-lean mode is enabled.
+    */
+    bool isMemoryLeanModeEnabled() const;
+
+    /*!
+        @return whether the item is idle, i.e. the idle mode is enabled
+        and no host is available.
+    */
+    bool isIdle() const;
+
+    /*!
+        Enables or disables the deferral of updates while Passive,
+        disabled by default.
+
+        Hosts usually hide Passive items. When enabled, the changes made
+        while the status is Passive, other than the status itself, are only
+        recorded: icons are not serialized and no change signal is sent.
+        They are announced in one batch, one signal per changed property,
+        when setStatus() moves to Active or NeedsAttention.
+
+        @see passiveDeferralStatistics()
+    */
+    void setPassiveDeferralEnabled(bool enabled);
+
+    /*!
+        @return whether updates are deferred while Passive.
+    */
+    bool isPassiveDeferralEnabled() const;
+
+    /*!
+        @return the counters of the deferral of updates while Passive,
+        empty if disabled:
+        - deferredChanges: the change signals held back,
+        - sentSignals: the signals sent when leaving Passive,
+        - skippedSignals: the signals saved, superseded by later changes,
+        - pendingSignals: the signals still held back,
+        - flushes: the number of times the item left Passive with updates.
+
+        Each skipped icon signal also saves the serialization of the icon,
+        when it was set by pixmap.
+    */
+    QVariantMap passiveDeferralStatistics() const;
+
+    /*!
+        Enables or disables the NewRevision signal, disabled by default.
+
+        Each group of properties (the status, the title, each icon, the
+        tooltip and the icon theme path) has a revision, incremented on
+        each change and read by hosts from the Revisions property of the
+        io.github.qtilities.StatusNotifierItem extension. When enabled,
+        each change signal is followed by NewRevision with the group and
+        its revision, so that hosts can skip the reads of values they have.
+    */
+    void setRevisionSignalsEnabled(bool enabled);
+
+    /*!
+        @return whether NewRevision is sent after each change signal.
+    */
+    bool isRevisionSignalsEnabled() const;
+
+    /*!
+        Enables or disables the filter of redundant signals, disabled by default.
+
+        When enabled, the change signal of a group of properties is not sent
+        if its value is the one hosts read last, e.g. when a change is
+        reverted before being announced, while Passive or without host.
+        It assumes that every host reads the group again after each signal.
+
+        @see skippedRedundantSignals()
+    */
+    void setRedundantSignalFilterEnabled(bool enabled);
+
+    /*!
+        @return whether redundant change signals are skipped.
+    */
+    bool isRedundantSignalFilterEnabled() const;
+
+    /*!
+        @return the number of change signals skipped since the filter
+        of redundant signals was enabled.
+    */
+    int skippedRedundantSignals() const;
+
+    /*!
+        @return the heap memory held by this item, in bytes.
+
+        It covers the data of the item: texts, icon names, serialized pixmaps,
+        progress frames and icon history, plus the objects exporting it on D-Bus.
+        Blocks shared within the item are counted once; blocks shared with
+        other items, such as interned icon names, are counted by each of them.
+        The pixmaps of QIcon objects are estimated from their sizes.
+        Qt internal object data and the D-Bus connection are not included,
+        nor the pixmaps shared by the items, see sharedMemoryUsage().
+    */
+    qint64 memoryUsage() const;
+
+    /*!
+        @return the heap memory held by the pool of serialized pixmaps
+        shared by all the items of the process, in bytes.
+
+        Identical pixmaps, of the same item or of others, share a single
+        buffer from this pool, which keeps the most recently used ones up
+        to 8 MiB. Items in memory-lean mode don't add theirs to it.
+        The buffers used by an item are counted by its memoryUsage() too.
+    */
+    static qint64 sharedMemoryUsage();
+
+    /*!
+        Sets the bandwidth budget of the pixmaps of all the items of the
+        process, in bytes per second, 0 for unlimited (the default).
+
+        Hosts fetch the pixmaps of an icon or tooltip set by pixmap after
+        its change signal. With a budget, the signal is held back when
+        its pixmaps would exceed it, e.g. when many items change their
+        icons at once, and sent as soon as the budget allows it, in the
+        order of the changes; further changes meanwhile are announced by
+        the same signal. Up to one second of budget can be used at once.
+        Updates by name, of the tooltip text and of the other properties
+        are never held back, nor the updates of NeedsAttention items, whose
+        pixmaps still count against the budget. Such an update sends
+        the signal held back for the same property at once.
+
+        @see pixmapBandwidthStatistics()
+    */
+    static void setPixmapBandwidthBudget(qint64 bytesPerSecond);
+
+    /*!
+        @return the bandwidth budget of the pixmaps, 0 if unlimited.
+    */
+    static qint64 pixmapBandwidthBudget();
+
+    /*!
+        @return the counters of the bandwidth budget of the pixmaps,
+        for all the items of the process:
+        - budget: the budget in bytes per second,
+        - sentSignals, sentBytes: the pixmap updates sent at once, and their pixmap bytes,
+        - urgentSignals: of those, the ones of NeedsAttention items over the budget,
+        - deferredSignals, deferredBytes: the pixmap updates held back,
+        - coalescedSignals: the changes announced by a signal already held back,
+        - totalDelay, maxDelay, averageDelay: the queueing delays, in milliseconds.
+    */
+    static QVariantMap pixmapBandwidthStatistics();
+
+    /*!
+        Enables or disables the persistent icon cache, shared by all the items
+        of the process and disabled by default.
+
+        When enabled, the serialized data of icons set by pixmap is stored
+        under `$XDG_CACHE_HOME/statusnotifieritem-qt/icons`, keyed by the hash
+        of the image content and its size. On later runs the stored data
+        is memory-mapped read-only instead of being converted again.
+        Entries are written in the background and the least recently used
+        ones are removed beyond 16 MiB.
+    */
+    static void setIconCacheEnabled(bool enabled);
+
+    /*!
+        @return whether the persistent icon cache is enabled.
+        @see setIconCacheEnabled()
+    */
+    static bool isIconCacheEnabled();
+
 Q_SIGNALS:
     /*!
         Inform the host application that an activation has been requested.
@@ -347,6 +901,21 @@ Q_SIGNALS:
     */
     void scrollRequested(int delta, Qt::Orientation orientation);
 
+    /*!
+        Emitted when the StatusNotifierWatcher answered the registration,
+        on construction and again each time the watcher restarts.
+
+        @param success Whether the item has been registered.
+    */
+    void registrationFinished(bool success);
+
+    /*!
+        Emitted when the first host appears or the last one goes away.
+
+        @param available Whether at least one host is available.
+    */
+    void hostAvailabilityChanged(bool available);
+
 private:
     std::unique_ptr<StatusNotifierItemPrivate> const d;
 };
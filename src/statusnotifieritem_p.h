@@ -9,54 +9,227 @@
 
 #include "statusnotifieritem.h"
 #include "statusnotifieritemdbus_p.hpp"
+#include "statusnotifieritemlatency_p.hpp"
+#include "statusnotifieritemtrace_p.hpp"
 
 #include <QDBusConnection>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QIcon>
-#include <QObject>
+#include <QRect>
 #include <QString>
+#include <QStringList>
+#include <QVector>
 
-class StatusNotifierItemPrivate : public QObject
+#include <memory>
+
+#ifdef QT_DBUS_LIB
+// Changed areas of the main icon between consecutive revisions,
+// kept for the last revisions only.
+struct SNIIconRevisionLog
+{
+    struct Entry {
+        quint32        revision;
+        bool           layoutChanged; // the sizes changed, rects are empty
+        QVector<QRect> rects;         // one per icon size
+    };
+    static constexpr int maxEntries = 16;
+
+    QVector<Entry> entries;
+};
+
+// Frames of the main icon with a progress bar, rendered once
+struct SNIProgressState
+{
+    double               value { -1.0 }; // negative when no progress is shown
+    int                  steps { 100 };
+    int                  interval { 100 };
+    int                  frame { -1 };   // index of the frame shown
+    bool                 emissionPending { false };
+    QElapsedTimer        lastEmission;
+    QVector<SNIIconList> frames;         // steps + 1 frames, all the sizes each
+    SNIIconList          restore;        // the main icon, shown when done
+};
+
+// Updates held back while the item is Passive, and the signals saved
+struct SNIPassiveDeferral
+{
+    quint32 deferredChanges { 0 }; // New* signals held back
+    quint32 sentSignals { 0 };     // New* signals sent when leaving Passive
+    quint32 flushes { 0 };
+};
+
+// The value of each group of properties last fetched by a host,
+// so that a change reverted before the next fetch isn't announced
+struct SNIRedundancyFilter
+{
+    struct Value {
+        QString text[3];
+        qint64  keys[2] { 0, 0 };
+
+        bool operator==(const Value& other) const
+        {
+            return keys[0] == other.keys[0] && keys[1] == other.keys[1]
+                && text[0] == other.text[0] && text[1] == other.text[1] && text[2] == other.text[2];
+        }
+    };
+
+    Value   fetched[SNILatencyTracker::UpdateCount];
+    quint8  known { 0 };          // bit per SNILatencyTracker::Update fetched
+    quint32 skippedSignals { 0 };
+};
+#endif
+
+// The tooltip subtitle as fixed text with named fields, rendered on read
+struct SNIToolTipTemplate
 {
-    Q_OBJECT
+    struct Field {
+        QString name;
+        QString text;
+        double  number { 0.0 };
+        int     precision { -1 }; // decimals of a number, negative for a text
+    };
+
+    QString        text;
+    QStringList    literals;     // around the placeholders, one more than them
+    QVector<int>   placeholders; // the field shown by each
+    QVector<Field> fields;
+    QString        description;
+    bool           stale { true }; // description lags behind the fields
+};
 
+// State of one of the four icons of an item
+struct SNIIconSlot
+{
+    enum Kind : quint8 { Main, Overlay, Attention, ToolTip, KindCount };
+
+    QString     name;          // interned, see StatusNotifierItemPrivate::intern()
+    QIcon       icon;
+    qint64      cacheKey { 0 };
+#ifdef QT_DBUS_LIB
+    SNIIconList serialized;
+    quint64     contentHash { 0 }; // of the pixmaps last serialized
+    bool        stale { false };   // serialized lags behind name and icon
+    bool        pixmapChanged { false }; // new pixmaps not announced yet
+#endif
+};
+
+// Not a QObject: the public object is the only one needed per item,
+// the rest is plain data laid out in a single allocation.
+class StatusNotifierItemPrivate
+{
 public:
     StatusNotifierItemPrivate(StatusNotifierItem* item);
     StatusNotifierItemPrivate() = delete;
 
-    void init(QString id);
+    void init(QString id, bool visible);
+    QString exportedIconThemePath() const;
+    bool exportIcon(const QString& name, const QIcon& icon);
+    bool writeIconThemeIndex() const;
+    qint64 memoryUsage() const;
+
+    // shares the storage of equal strings, e.g. icon names, across items
+    static QString intern(const QString&);
+
+    // the icon set by pixmap, rebuilt from its serialized form in lean mode
+    QIcon sourceIcon(SNIIconSlot::Kind) const;
+
+    // the tooltip subtitle, rendered from the template on first read after a change
+    static void parseToolTipTemplate(SNIToolTipTemplate&, const QString& text);
+    const QString& toolTipDescription() const;
+    SNIToolTipTemplate::Field* toolTipField(const QString& name);
+    void toolTipFieldChanged();
+
+    template<typename... Args>
+    void record(SNITrace::Event event, const Args&... args)
+    {
+        if (trace)
+            trace->write(event, args...);
+    }
 
 #ifdef QT_DBUS_LIB
+    static QList<QSize> defaultIconSizes();
+    static SNIIcon imageToPixmap(QImage);
     SNIIconList iconToPixmapList(const QIcon&);
+    // the badge text drawn at the sizes of the main icon
+    SNIIconList badgeIcons() const;
+    // the D-Bus form of an icon, serialized on first use after a change
+    const SNIIconList& serialized(SNIIconSlot::Kind);
+    void iconChanged(const SNIIconList& previous);
+
+    // icons are compared by content, their payloads shared with identical ones
+    quint64 sharePayloads(SNIIconList&) const;
+    static bool sameContent(const SNIIconList&, const SNIIconList&);
+    SNIIconList currentPixmaps(SNIIconSlot::Kind) const;
+    void notifyPixmapChange(SNIIconSlot::Kind, SNILatencyTracker::Update, const SNIIconList& before,
+                            bool otherChanges = false);
+    SNIIconDeltaList iconDelta(quint32 revision) const;
+
+    // emits the New* signal of an update, timestamping it if tracking latency
+    void trackChange(SNILatencyTracker::Update);
+    void trackFetch(SNILatencyTracker::Update);
+    void notify(SNILatencyTracker::Update);
+    void notifyChange(SNILatencyTracker::Update);
+    void emitUpdate(SNILatencyTracker::Update);
+
+    // pixmap updates wait for the bandwidth budget shared by the items
+    static SNIIconSlot::Kind iconKind(SNILatencyTracker::Update);
+    qint64 pixmapBytes(SNILatencyTracker::Update) const;
+    bool throttle(SNILatencyTracker::Update);
+
+    // the signal of an update is redundant if the hosts already fetched its value
+    SNIRedundancyFilter::Value groupValue(SNILatencyTracker::Update) const;
+    bool isRedundant(SNILatencyTracker::Update) const;
+    void markFetched(SNILatencyTracker::Update);
 
-    StatusNotifierItemDBus* dbus;
-    SNIIconList serializedIcon;
-    SNIIconList serializedAttentionIcon;
-    SNIIconList serializedOverlayIcon;
-    SNIIconList serializedToolTipIcon;
+    // without any host, updates are only marked and sent once one appears;
+    // likewise for all but the status while Passive, if deferral is enabled
+    bool isIdle() const;
+    bool isDeferred(SNILatencyTracker::Update) const;
+    void flushDeferredUpdates();
+    void flushPassiveUpdates();
+    // shows the item, exporting it with its state serialized
+    void attach();
+
+    bool isProgressActive() const;
+    void progressBaseChanged();
+    void renderProgressFrames();
+    bool showProgressFrame();
+    void scheduleProgressEmission();
+
+    StatusNotifierItemDBus*              dbus;
+    std::unique_ptr<SNIIconRevisionLog>  iconRevisionLog;
+    std::unique_ptr<SNIProgressState>    progress;
+    std::unique_ptr<SNILatencyTracker>   latency;
+    std::unique_ptr<SNIPassiveDeferral>  passiveDeferral;
+    std::unique_ptr<SNIRedundancyFilter> redundancyFilter;
+    quint32                              revisions[SNILatencyTracker::UpdateCount] {};
+    quint32                              iconRevision { 0 };
+    quint32                              emittedIconRevision { 0 };
+    quint8                               deferredUpdates { 0 };  // bit per SNILatencyTracker::Update
+    quint8                               throttledUpdates { 0 }; // likewise, waiting for the budget
+    quint32                              throttleSerials[SNILatencyTracker::UpdateCount] {}; // of the pending timers
+    bool                                 idleMode { false };
+    bool                                 leanMode { false };
+    bool                                 revisionSignals { false };
 #endif
-    StatusNotifierItem* q;
-    StatusNotifierItem::SNICategory category;
-    StatusNotifierItem::SNIStatus   status;
-    QString id;
-    QString title;
-
-    // icons
-    QString iconName,
-            overlayIconName,
-            attentionIconName;
-    QIcon   icon,
-            overlayIcon,
-            attentionIcon;
-    qint64  iconCacheKey,
-            overlayIconCacheKey,
-            attentionIconCacheKey;
-
-    // tooltip
-    QString toolTipTitle,
-            toolTipSubTitle,
-            toolTipIconName;
-    QIcon   toolTipIcon;
-    qint64  toolTipIconCacheKey;
+    StatusNotifierItem*                 q;
+    StatusNotifierItem::SNICategory     category;
+    StatusNotifierItem::SNIStatus       status;
+    int                                 badgeCount { 0 };
+    bool                                visible { true };
+    std::unique_ptr<SNITraceWriter>     trace;
+    std::unique_ptr<SNIToolTipTemplate> toolTipTemplate;
+    QHash<QString, qint64>              exportedIcons; // QIcon::cacheKey() by name
+
+    SNIIconSlot icons[SNIIconSlot::KindCount];
+
+    QString id,
+            title,
+            iconThemePath,
+            badgeText,        // drawn as overlay icon
+            toolTipTitle,
+            toolTipSubTitle;
 };
 
 #endif // SNI_QT_PRIVATE_H
@@ -0,0 +1,215 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritembadge_p.hpp"
+#include "statusnotifieritempixel_p.hpp"
+
+#include <QFont>
+#include <QFontMetrics>
+#include <QHash>
+#include <QMutex>
+#include <QPainter>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+// pill color, the text is white
+constexpr uint badgeRed   = 218;
+constexpr uint badgeGreen = 68;
+constexpr uint badgeBlue  = 83;
+
+// x / 255 rounded, exact for x up to 255 * 255
+inline uint div255(uint x)
+{
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+#ifdef __SSE2__
+// div255() on 8 lanes of 16 bits
+inline __m128i div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+inline __m128i load8(const uchar* p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+#endif
+
+/*
+    Blends a row of white glyph coverage over a row of pill coverage into
+    premultiplied ARGB32, with multiplications and shifts only; the division
+    by alpha is left to the SIMD kernels of SNIPixelConverter.
+*/
+void blendRow(quint32* dst, const uchar* background, const uchar* foreground, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    // SSE2 is part of x86-64, and compilers leave the loop below scalar at -O2;
+    // the products fit in 16 bits, 255 * 255 + 128 + 255 < 2^16
+    const __m128i max   = _mm_set1_epi16(255);
+    const __m128i red   = _mm_set1_epi16(short(badgeRed));
+    const __m128i green = _mm_set1_epi16(short(badgeGreen));
+    const __m128i blue  = _mm_set1_epi16(short(badgeBlue));
+    for (; i + 8 <= count; i += 8) {
+        const __m128i fg = load8(foreground + i);
+        const __m128i bg = div255(_mm_mullo_epi16(load8(background + i), _mm_sub_epi16(max, fg)));
+        const __m128i a  = _mm_add_epi16(fg, bg);
+        const __m128i r  = _mm_add_epi16(fg, div255(_mm_mullo_epi16(red, bg)));
+        const __m128i g  = _mm_add_epi16(fg, div255(_mm_mullo_epi16(green, bg)));
+        const __m128i b  = _mm_add_epi16(fg, div255(_mm_mullo_epi16(blue, bg)));
+
+        // B, G, R, A in memory
+        const __m128i blueGreen = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+        const __m128i redAlpha  = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(a, a));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(blueGreen, redAlpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(blueGreen, redAlpha));
+    }
+#endif
+    for (; i < count; ++i) {
+        const uint fg    = foreground[i];
+        const uint bg    = div255(background[i] * (255 - fg));
+        const uint alpha = fg + bg;
+        const uint red   = fg + div255(badgeRed * bg);
+        const uint green = fg + div255(badgeGreen * bg);
+        const uint blue  = fg + div255(badgeBlue * bg);
+
+        dst[i] = (alpha << 24) | (red << 16) | (green << 8) | blue;
+    }
+}
+} // namespace
+
+SNIIconList SNIBadgeRenderer::render(const QString& text, const QList<QSize>& sizes)
+{
+    const QByteArray latin1 = text.toLatin1();
+
+    SNIIconList pixmapList;
+    for (const QSize& size : sizes) {
+        if (size.isEmpty())
+            continue;
+
+        const int badgeHeight = qMax(7, size.height() * 9 / 16);
+        pixmapList.append(renderOne(*atlas(badgeHeight), latin1, size));
+    }
+    return pixmapList;
+}
+
+int SNIBadgeRenderer::glyphIndex(char c)
+{
+    if (c < firstGlyph || c > lastGlyph)
+        c = '?';
+    return c - firstGlyph;
+}
+
+std::shared_ptr<const SNIBadgeRenderer::Atlas> SNIBadgeRenderer::atlas(int height)
+{
+    static QMutex mutex;
+    static QHash<int, std::shared_ptr<const Atlas>> atlases;
+
+    QMutexLocker locker(&mutex);
+    std::shared_ptr<const Atlas>& cached = atlases[height];
+    if (cached)
+        return cached;
+
+    auto atlas = std::make_shared<Atlas>();
+    atlas->height = height;
+
+    QFont font;
+    font.setBold(true);
+    font.setPixelSize(qMax(6, height * 3 / 4));
+    const QFontMetrics metrics(font);
+
+    // one pixel apart, so that overhanging glyphs don't bleed into their neighbors
+    int width = 0;
+    for (int i = 0; i < glyphCount; ++i) {
+        atlas->offsets[i]  = width;
+        atlas->advances[i] = metrics.horizontalAdvance(QLatin1Char(char(firstGlyph + i)));
+        width += atlas->advances[i] + 1;
+    }
+    atlas->glyphs = QImage(width, height, QImage::Format_Alpha8);
+    atlas->glyphs.fill(0);
+
+    QPainter painter(&atlas->glyphs);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+
+    const int baseline = (height + metrics.ascent() - metrics.descent()) / 2;
+    for (int i = 0; i < glyphCount; ++i)
+        painter.drawText(atlas->offsets[i], baseline, QString(QLatin1Char(char(firstGlyph + i))));
+
+    painter.end();
+
+    cached = atlas;
+    return cached;
+}
+
+SNIIcon SNIBadgeRenderer::renderOne(const Atlas& atlas, const QByteArray& text, const QSize& size)
+{
+    const int width  = size.width();
+    const int height = size.height();
+
+    SNIIcon pix;
+    pix.width  = width;
+    pix.height = height;
+    pix.bytes  = QByteArray(width * height * 4, '\0');
+
+    int textWidth = 0;
+    for (char c : text)
+        textWidth += atlas.advances[glyphIndex(c)];
+
+    const int badgeHeight = qMin(atlas.height, height);
+    const int padding     = badgeHeight / 4;
+    const int badgeWidth  = qMin(width, qMax(badgeHeight, textWidth + 2 * padding));
+    const int left        = width - badgeWidth;
+    const int top         = height - badgeHeight;
+    const int textLeft    = (badgeWidth - textWidth) / 2;
+
+    // the pill is a capsule: a segment at mid-height, inflated by radius
+    const float radius  = badgeHeight / 2.0f;
+    const float centerY = radius;
+    const float startX  = radius;
+    const float endX    = badgeWidth - radius;
+
+    std::vector<uchar>   background(size_t(badgeWidth));
+    std::vector<uchar>   foreground(size_t(badgeWidth));
+    std::vector<quint32> premultiplied(size_t(badgeWidth));
+
+    uchar* bits = reinterpret_cast<uchar*>(pix.bytes.data());
+    for (int y = 0; y < badgeHeight; ++y) {
+        const float dy = y + 0.5f - centerY;
+        for (int x = 0; x < badgeWidth; ++x) {
+            const float px = x + 0.5f;
+            const float dx = px < startX ? startX - px : (px > endX ? px - endX : 0.0f);
+            const float coverage = qBound(0.0f, radius - std::sqrt(dx * dx + dy * dy) + 0.5f, 1.0f);
+            background[size_t(x)] = uchar(coverage * 255.0f + 0.5f);
+        }
+
+        std::fill(foreground.begin(), foreground.end(), uchar(0));
+        const uchar* glyphRow = atlas.glyphs.constScanLine(y);
+        int pen = textLeft;
+        for (char c : text) {
+            const int glyph = glyphIndex(c);
+            for (int i = 0; i < atlas.advances[glyph]; ++i) {
+                const int x = pen + i;
+                if (x >= 0 && x < badgeWidth)
+                    foreground[size_t(x)] = qMax(foreground[size_t(x)], glyphRow[atlas.offsets[glyph] + i]);
+            }
+            pen += atlas.advances[glyph];
+        }
+        blendRow(premultiplied.data(), background.data(), foreground.data(), badgeWidth);
+        SNIPixelConverter::fromPremultiplied(premultiplied.data(),
+                                             bits + (qsizetype(top + y) * width + left) * 4, badgeWidth);
+    }
+    return pix;
+}
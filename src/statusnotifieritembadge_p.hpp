@@ -0,0 +1,53 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include "statusnotifieritemdbus_p.hpp"
+
+#include <QImage>
+#include <QList>
+#include <QSize>
+#include <QString>
+
+#include <memory>
+
+/*!
+    Renders badges, short texts such as unread counts on a colored pill,
+    directly into the big-endian ARGB32 data sent over the bus.
+
+    The glyphs of the printable ASCII characters are rasterized once
+    per icon size into an atlas shared by all the items of the process,
+    so changing the text doesn't involve QPainter text layout
+    nor the conversion done by iconToPixmapList().
+*/
+class SNIBadgeRenderer
+{
+public:
+    /*!
+        @return the badge showing @p text for each of @p sizes,
+        placed at the bottom-right corner of a transparent image.
+        Characters outside the printable ASCII range are shown as '?'.
+    */
+    static SNIIconList render(const QString& text, const QList<QSize>& sizes);
+
+private:
+    static constexpr char firstGlyph = ' ';
+    static constexpr char lastGlyph  = '~';
+    static constexpr int  glyphCount = lastGlyph - firstGlyph + 1;
+
+    // Alpha8 glyphs laid out side by side, rendered for a given badge height
+    struct Atlas {
+        int    height { 0 };
+        QImage glyphs;
+        int    offsets[glyphCount];
+        int    advances[glyphCount];
+    };
+
+    static int glyphIndex(char c);
+    static std::shared_ptr<const Atlas> atlas(int height);
+    static SNIIcon renderOne(const Atlas& atlas, const QByteArray& text, const QSize& size);
+};
@@ -0,0 +1,101 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritembandwidth_p.hpp"
+
+#include <QMutexLocker>
+
+#include <climits>
+
+namespace {
+// the capacity of the bucket, in time to refill it
+constexpr qint64 burstNs = 1000000000;
+} // namespace
+
+Q_GLOBAL_STATIC(SNIBandwidthScheduler, bandwidthScheduler)
+
+SNIBandwidthScheduler* SNIBandwidthScheduler::instance()
+{
+    return bandwidthScheduler();
+}
+
+SNIBandwidthScheduler::SNIBandwidthScheduler()
+{
+    clock.start();
+}
+
+qint64 SNIBandwidthScheduler::budget() const
+{
+    return rate;
+}
+
+void SNIBandwidthScheduler::setBudget(qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&mutex);
+
+    // a full bucket at the new rate, the delays already given still hold
+    rate               = qMax(qint64(0), bytesPerSecond);
+    theoreticalArrival = 0;
+}
+
+int SNIBandwidthScheduler::reserve(qint64 bytes, bool urgent)
+{
+    QMutexLocker locker(&mutex);
+
+    const qint64 bytesPerSecond = rate;
+    if (bytesPerSecond <= 0 || bytes <= 0) {
+        ++sentSignals;
+        sentBytes += qMax(qint64(0), bytes);
+        return 0;
+    }
+    // generic cell rate algorithm: the bytes fit if the bucket, refilled
+    // until now, has room for them
+    const qint64 now  = clock.nsecsElapsed();
+    const qint64 cost = qint64(double(bytes) * 1e9 / double(bytesPerSecond));
+
+    theoreticalArrival = qMax(theoreticalArrival, now) + cost;
+
+    const qint64 delayNs = theoreticalArrival - burstNs - now;
+    if (delayNs <= 0 || urgent) {
+        ++sentSignals;
+        sentBytes += bytes;
+        if (delayNs > 0)
+            ++urgentSignals;
+        return 0;
+    }
+    const int delay = int(qMin<qint64>((delayNs + 999999) / 1000000, INT_MAX));
+
+    ++deferredSignals;
+    deferredBytes += bytes;
+    totalDelay    += delay;
+    maxDelay       = qMax(maxDelay, qint64(delay));
+    return delay;
+}
+
+void SNIBandwidthScheduler::coalesced()
+{
+    QMutexLocker locker(&mutex);
+    ++coalescedSignals;
+}
+
+QVariantMap SNIBandwidthScheduler::statistics() const
+{
+    QMutexLocker locker(&mutex);
+
+    QVariantMap map;
+    map.insert(QStringLiteral("budget"),           qint64(rate));
+    map.insert(QStringLiteral("sentSignals"),      sentSignals);
+    map.insert(QStringLiteral("sentBytes"),        sentBytes);
+    map.insert(QStringLiteral("urgentSignals"),    urgentSignals);
+    map.insert(QStringLiteral("deferredSignals"),  deferredSignals);
+    map.insert(QStringLiteral("deferredBytes"),    deferredBytes);
+    map.insert(QStringLiteral("coalescedSignals"), coalescedSignals);
+    map.insert(QStringLiteral("totalDelay"),       totalDelay);
+    map.insert(QStringLiteral("maxDelay"),         maxDelay);
+    map.insert(QStringLiteral("averageDelay"),
+               deferredSignals ? double(totalDelay) / double(deferredSignals) : 0.0);
+    return map;
+}
@@ -0,0 +1,69 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVariantMap>
+
+#include <atomic>
+
+/*!
+    Budget of the pixmap traffic of all the items of the process.
+
+    The change signals of icons set by pixmap are followed by the hosts
+    fetching the pixmaps, so items reserve those bytes before sending
+    such a signal. The budget is a token bucket refilled at its rate
+    and holding one second of it: a reservation within the tokens left
+    is sent at once, others are given the delay after which the bucket
+    holds them. Reservations are served in the order they are made,
+    so a burst from many items is spread evenly instead of being sent
+    in one go. Urgent reservations are sent at once but consume their
+    tokens all the same, pushing back the others.
+
+    The scheduler may be used by items of several threads.
+*/
+class SNIBandwidthScheduler
+{
+public:
+    static SNIBandwidthScheduler* instance();
+
+    SNIBandwidthScheduler();
+
+    /*!
+        @return the budget in bytes per second, 0 if unlimited.
+    */
+    qint64 budget() const;
+    void setBudget(qint64 bytesPerSecond);
+
+    /*!
+        Reserves @p bytes of the budget.
+        @return the delay in milliseconds before they may be sent, 0 for now.
+    */
+    int reserve(qint64 bytes, bool urgent);
+
+    /*!
+        Counts a change announced by the signal of an earlier reservation.
+    */
+    void coalesced();
+
+    QVariantMap statistics() const;
+
+private:
+    std::atomic<qint64> rate { 0 };
+    mutable QMutex      mutex;                     // guards the members below
+    QElapsedTimer       clock;
+    qint64              theoreticalArrival { 0 };  // ns on clock, when the reserved bytes are refilled
+    qint64              sentSignals { 0 };
+    qint64              sentBytes { 0 };
+    qint64              urgentSignals { 0 };
+    qint64              deferredSignals { 0 };
+    qint64              deferredBytes { 0 };
+    qint64              coalescedSignals { 0 };
+    qint64              totalDelay { 0 };          // ms
+    qint64              maxDelay { 0 };            // ms
+};
@@ -0,0 +1,627 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritemclient.h"
+#include "statusnotifieritemclient_p.h"
+
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusVariant>
+#include <QMetaEnum>
+#include <QRect>
+
+#include <cstring>
+#include <memory>
+#include <utility>
+
+namespace {
+const QString itemInterface       = QStringLiteral("org.kde.StatusNotifierItem");
+const QString propertiesInterface = QStringLiteral("org.freedesktop.DBus.Properties");
+const QString extensionInterface  = QStringLiteral("io.github.qtilities.StatusNotifierItem");
+}
+
+StatusNotifierItemClient::StatusNotifierItemClient(const QString &item, QObject *parent)
+    : QObject(parent)
+    , d(new StatusNotifierItemClientPrivate(this))
+{
+    d->init(item);
+}
+
+StatusNotifierItemClient::~StatusNotifierItemClient()
+{
+}
+
+QString StatusNotifierItemClient::service() const
+{
+    return d->service;
+}
+
+QString StatusNotifierItemClient::path() const
+{
+    return d->path;
+}
+
+bool StatusNotifierItemClient::isReady() const
+{
+    return d->ready;
+}
+
+void StatusNotifierItemClient::setRefreshDelay(int msec)
+{
+    d->refreshTimer.setInterval(msec);
+}
+
+int StatusNotifierItemClient::refreshDelay() const
+{
+    return d->refreshTimer.interval();
+}
+
+void StatusNotifierItemClient::refresh(Properties properties)
+{
+    d->scheduleRefresh(properties);
+}
+
+QString StatusNotifierItemClient::id() const
+{
+    return d->id;
+}
+
+StatusNotifierItem::SNICategory StatusNotifierItemClient::category() const
+{
+    const QMetaEnum metaEnum = QMetaEnum::fromType<StatusNotifierItem::SNICategory>();
+    bool ok = false;
+    const int value = metaEnum.keyToValue(d->category.toLatin1().constData(), &ok);
+    return ok ? StatusNotifierItem::SNICategory(value) : StatusNotifierItem::ApplicationStatus;
+}
+
+StatusNotifierItem::SNIStatus StatusNotifierItemClient::status() const
+{
+    const QMetaEnum metaEnum = QMetaEnum::fromType<StatusNotifierItem::SNIStatus>();
+    bool ok = false;
+    const int value = metaEnum.keyToValue(d->status.toLatin1().constData(), &ok);
+    return ok ? StatusNotifierItem::SNIStatus(value) : StatusNotifierItem::Active;
+}
+
+QString StatusNotifierItemClient::title() const
+{
+    return d->title;
+}
+
+QString StatusNotifierItemClient::iconThemePath() const
+{
+    return d->iconThemePath;
+}
+
+QString StatusNotifierItemClient::menuPath() const
+{
+    return d->menuPath;
+}
+
+bool StatusNotifierItemClient::itemIsMenu() const
+{
+    return d->itemIsMenu;
+}
+
+QString StatusNotifierItemClient::iconName() const
+{
+    return d->icon.name;
+}
+
+QIcon StatusNotifierItemClient::icon() const
+{
+    return d->icon.toIcon();
+}
+
+QString StatusNotifierItemClient::overlayIconName() const
+{
+    return d->overlayIcon.name;
+}
+
+QIcon StatusNotifierItemClient::overlayIcon() const
+{
+    return d->overlayIcon.toIcon();
+}
+
+QString StatusNotifierItemClient::attentionIconName() const
+{
+    return d->attentionIcon.name;
+}
+
+QString StatusNotifierItemClient::attentionMovieName() const
+{
+    return d->attentionMovieName;
+}
+
+QIcon StatusNotifierItemClient::attentionIcon() const
+{
+    return d->attentionIcon.toIcon();
+}
+
+QString StatusNotifierItemClient::toolTipIconName() const
+{
+    return d->toolTipIcon.name;
+}
+
+QIcon StatusNotifierItemClient::toolTipIcon() const
+{
+    return d->toolTipIcon.toIcon();
+}
+
+QString StatusNotifierItemClient::toolTipTitle() const
+{
+    return d->toolTipTitle;
+}
+
+QString StatusNotifierItemClient::toolTipSubTitle() const
+{
+    return d->toolTipSubTitle;
+}
+
+void StatusNotifierItemClient::activate(const QPoint &position)
+{
+    d->call(QStringLiteral("Activate"), { position.x(), position.y() });
+}
+
+void StatusNotifierItemClient::secondaryActivate(const QPoint &position)
+{
+    d->call(QStringLiteral("SecondaryActivate"), { position.x(), position.y() });
+}
+
+void StatusNotifierItemClient::contextMenu(const QPoint &position)
+{
+    d->call(QStringLiteral("ContextMenu"), { position.x(), position.y() });
+}
+
+void StatusNotifierItemClient::scroll(int delta, Qt::Orientation orientation)
+{
+    d->call(QStringLiteral("Scroll"), {
+        delta,
+        orientation == Qt::Horizontal ? QStringLiteral("horizontal") : QStringLiteral("vertical")
+    });
+}
+//==================================================================================================
+// StatusNotifierItemClientPrivate
+//==================================================================================================
+QIcon StatusNotifierItemClientPrivate::Icon::toIcon()
+{
+    if (!converted) {
+        icon      = hasPixmaps ? pixmapListToIcon(pixmaps) : QIcon::fromTheme(name);
+        converted = true;
+
+        // a single representation of the icon, unless deltas apply to the pixmaps
+        if (!keepPixmaps)
+            pixmaps = SNIIconList();
+    }
+    return icon;
+}
+
+void StatusNotifierItemClientPrivate::Icon::setName(const QString &iconName)
+{
+    name = iconName;
+    if (hasPixmaps)
+        return;
+
+    icon      = QIcon();
+    converted = false;
+}
+
+void StatusNotifierItemClientPrivate::Icon::setPixmaps(const SNIIconList &pixmapList)
+{
+    pixmaps    = pixmapList;
+    hasPixmaps = !pixmapList.isEmpty();
+    icon       = QIcon();
+    converted  = false;
+}
+
+StatusNotifierItemClientPrivate::StatusNotifierItemClientPrivate(StatusNotifierItemClient *client)
+    : q(client)
+    , connection(QDBusConnection::sessionBus())
+{
+}
+
+void StatusNotifierItemClientPrivate::init(const QString &item)
+{
+    const int slash = item.indexOf(QLatin1Char('/'));
+    if (slash < 0) {
+        service = item;
+        path    = QStringLiteral("/StatusNotifierItem");
+    } else {
+        service = item.left(slash);
+        path    = item.mid(slash);
+    }
+
+    qDBusRegisterMetaType<SNIIcon>();
+    qDBusRegisterMetaType<SNIIconList>();
+    qDBusRegisterMetaType<SNIToolTip>();
+    qDBusRegisterMetaType<SNIIconDelta>();
+    qDBusRegisterMetaType<SNIIconDeltaList>();
+
+    // an item leaving the bus, or a new owner of its well-known name
+    serviceWatcher.setConnection(connection);
+    serviceWatcher.setWatchMode(QDBusServiceWatcher::WatchForOwnerChange);
+    serviceWatcher.addWatchedService(service);
+    QObject::connect(&serviceWatcher, &QDBusServiceWatcher::serviceOwnerChanged,
+                     this, &StatusNotifierItemClientPrivate::onServiceOwnerChanged);
+
+    refreshTimer.setSingleShot(true);
+    refreshTimer.setInterval(50);
+    QObject::connect(&refreshTimer, &QTimer::timeout, this, &StatusNotifierItemClientPrivate::fetch);
+
+    connection.connect(service, path, itemInterface, QStringLiteral("NewTitle"),
+                       this, SLOT(onNewTitle()));
+    connection.connect(service, path, itemInterface, QStringLiteral("NewIcon"),
+                       this, SLOT(onNewIcon()));
+    connection.connect(service, path, itemInterface, QStringLiteral("NewOverlayIcon"),
+                       this, SLOT(onNewOverlayIcon()));
+    connection.connect(service, path, itemInterface, QStringLiteral("NewAttentionIcon"),
+                       this, SLOT(onNewAttentionIcon()));
+    connection.connect(service, path, itemInterface, QStringLiteral("NewToolTip"),
+                       this, SLOT(onNewToolTip()));
+    connection.connect(service, path, itemInterface, QStringLiteral("NewMenu"),
+                       this, SLOT(onNewMenu()));
+    connection.connect(service, path, itemInterface, QStringLiteral("NewStatus"),
+                       this, SLOT(onNewStatus(QString)));
+    connection.connect(service, path, itemInterface, QStringLiteral("NewIconThemePath"),
+                       this, SLOT(onNewIconThemePath(QString)));
+    connection.connect(service, path, extensionInterface, QStringLiteral("NewIconRevision"),
+                       this, SLOT(onNewIconRevision(uint)));
+
+    fetchAll();
+
+    // also tells whether the item supports the extension
+    fetchIconDelta();
+}
+
+void StatusNotifierItemClientPrivate::scheduleRefresh(Properties properties)
+{
+    dirty |= properties;
+
+    // don't restart a running timer, so that a steady flow of signals
+    // can't postpone the refresh forever
+    if (!refreshTimer.isActive())
+        refreshTimer.start();
+}
+
+void StatusNotifierItemClientPrivate::fetch()
+{
+    // properties still being fetched are refreshed again once their reply arrives
+    const Properties properties = dirty & ~pending;
+    if (!properties)
+        return;
+
+    dirty &= ~properties;
+
+    if (properties == StatusNotifierItemClient::AllProperties) {
+        fetchAll();
+        return;
+    }
+    for (uint bit = 1; bit <= uint(StatusNotifierItemClient::AllProperties); bit <<= 1) {
+        if (properties.testFlag(Property(bit)))
+            fetchProperty(Property(bit));
+    }
+}
+
+void StatusNotifierItemClientPrivate::fetchAll()
+{
+    dirty   &= ~Properties(StatusNotifierItemClient::AllProperties);
+    pending |= StatusNotifierItemClient::AllProperties;
+
+    QDBusMessage message = QDBusMessage::createMethodCall(
+        service, path, propertiesInterface, QStringLiteral("GetAll"));
+    message << itemInterface;
+
+    auto *watcher = new QDBusPendingCallWatcher(connection.asyncCall(message), this);
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                     [this, current = generation](QDBusPendingCallWatcher *call) {
+        call->deleteLater();
+        if (current != generation)
+            return;
+
+        const QDBusPendingReply<QVariantMap> reply = *call;
+        if (!reply.isError()) {
+            const QVariantMap properties = reply.value();
+            for (auto it = properties.cbegin(); it != properties.cend(); ++it)
+                apply(it.key(), it.value());
+        }
+        finished(StatusNotifierItemClient::AllProperties);
+
+        if (!ready && !reply.isError()) {
+            ready = true;
+            Q_EMIT q->ready();
+        }
+    });
+}
+
+void StatusNotifierItemClientPrivate::fetchProperty(Property property)
+{
+    pending |= property;
+
+    // with the extension, pixmaps are updated by revision instead
+    const QStringList names = property == StatusNotifierItemClient::IconProperty && iconDeltaSupported
+                            ? QStringList { QStringLiteral("IconName") }
+                            : propertyNames(property);
+    auto remaining = std::make_shared<int>(names.size());
+
+    for (const QString &name : names) {
+        QDBusMessage message = QDBusMessage::createMethodCall(
+            service, path, propertiesInterface, QStringLiteral("Get"));
+        message << itemInterface << name;
+
+        auto *watcher = new QDBusPendingCallWatcher(connection.asyncCall(message), this);
+        QObject::connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                         [this, property, name, remaining, current = generation](QDBusPendingCallWatcher *call) {
+            call->deleteLater();
+            if (current != generation)
+                return;
+
+            const QDBusPendingReply<QDBusVariant> reply = *call;
+            if (!reply.isError())
+                apply(name, reply.value().variant());
+
+            if (--*remaining == 0)
+                finished(property);
+        });
+    }
+}
+
+void StatusNotifierItemClientPrivate::finished(Properties properties)
+{
+    pending &= ~properties;
+    Q_EMIT q->changed(properties);
+
+    // changes signaled while the request was pending
+    if (dirty && !refreshTimer.isActive())
+        refreshTimer.start();
+}
+
+void StatusNotifierItemClientPrivate::apply(const QString &name, const QVariant &value)
+{
+    if (name == QLatin1String("Category")) {
+        category = value.toString();
+    } else if (name == QLatin1String("Id")) {
+        id = value.toString();
+    } else if (name == QLatin1String("Title")) {
+        title = value.toString();
+    } else if (name == QLatin1String("Status")) {
+        status = value.toString();
+    } else if (name == QLatin1String("IconThemePath")) {
+        iconThemePath = value.toString();
+    } else if (name == QLatin1String("Menu")) {
+        menuPath = qdbus_cast<QDBusObjectPath>(value).path();
+    } else if (name == QLatin1String("ItemIsMenu")) {
+        itemIsMenu = value.toBool();
+    } else if (name == QLatin1String("IconName")) {
+        icon.setName(value.toString());
+    } else if (name == QLatin1String("IconPixmap")) {
+        if (!iconDeltaSupported)
+            icon.setPixmaps(qdbus_cast<SNIIconList>(value));
+    } else if (name == QLatin1String("OverlayIconName")) {
+        overlayIcon.setName(value.toString());
+    } else if (name == QLatin1String("OverlayIconPixmap")) {
+        overlayIcon.setPixmaps(qdbus_cast<SNIIconList>(value));
+    } else if (name == QLatin1String("AttentionIconName")) {
+        attentionIcon.setName(value.toString());
+    } else if (name == QLatin1String("AttentionIconPixmap")) {
+        attentionIcon.setPixmaps(qdbus_cast<SNIIconList>(value));
+    } else if (name == QLatin1String("AttentionMovieName")) {
+        attentionMovieName = value.toString();
+    } else if (name == QLatin1String("ToolTip")) {
+        const SNIToolTip toolTip = qdbus_cast<SNIToolTip>(value);
+        toolTipIcon.setName(toolTip.iconName);
+        toolTipIcon.setPixmaps(toolTip.iconPixmap);
+        toolTipTitle    = toolTip.title;
+        toolTipSubTitle = toolTip.description;
+    }
+}
+
+void StatusNotifierItemClientPrivate::call(const QString &method, const QVariantList &arguments)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(service, path, itemInterface, method);
+    message.setArguments(arguments);
+    connection.send(message);
+}
+
+void StatusNotifierItemClientPrivate::fetchIconDelta()
+{
+    if (iconDeltaPending)
+        return;
+
+    iconDeltaPending = true;
+
+    // an unknown revision is newer than the current one and gets whole images
+    QDBusMessage message = QDBusMessage::createMethodCall(
+        service, path, extensionInterface, QStringLiteral("IconPixmapDelta"));
+    message << (iconRevisionKnown ? iconRevision : ~quint32(0));
+
+    auto *watcher = new QDBusPendingCallWatcher(connection.asyncCall(message), this);
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, this,
+                     [this, whole = !iconRevisionKnown, current = generation](QDBusPendingCallWatcher *call) {
+        call->deleteLater();
+        if (current != generation)
+            return;
+
+        iconDeltaPending = false;
+
+        const QDBusPendingReply<uint, SNIIconDeltaList> reply = *call;
+        if (reply.isError())
+            return;
+
+        iconDeltaSupported = true;
+        icon.keepPixmaps   = true;
+        if (!applyIconDelta(reply.argumentAt<1>())) {
+            // out of sync, start over with whole images once
+            iconRevisionKnown = false;
+            if (!whole)
+                fetchIconDelta();
+            return;
+        }
+        iconRevision      = reply.argumentAt<0>();
+        iconRevisionKnown = true;
+        Q_EMIT q->changed(StatusNotifierItemClient::IconProperty);
+
+        if (latestIconRevision > iconRevision)
+            fetchIconDelta();
+    });
+}
+
+bool StatusNotifierItemClientPrivate::applyIconDelta(const SNIIconDeltaList &deltaList)
+{
+    SNIIconList pixmaps;
+    for (const SNIIconDelta &delta : deltaList) {
+        SNIIcon pix;
+        pix.width  = delta.width;
+        pix.height = delta.height;
+
+        for (const SNIIcon &known : std::as_const(icon.pixmaps)) {
+            if (known.width == delta.width && known.height == delta.height) {
+                pix.bytes = known.bytes;
+                break;
+            }
+        }
+        const QRect image(0, 0, delta.width, delta.height);
+        const QRect rect(delta.x, delta.y, delta.rectWidth, delta.rectHeight);
+        const int   rowSize = rect.width() * 4;
+        if (delta.bytes.size() != qsizetype(rowSize) * rect.height())
+            return false;
+
+        if (rect == image) {
+            pix.bytes = delta.bytes;
+        } else if (!rect.isEmpty()) {
+            if (!image.contains(rect) || pix.bytes.size() != qsizetype(image.width()) * image.height() * 4)
+                return false;
+
+            char *data = pix.bytes.data();
+            for (int y = 0; y < rect.height(); ++y) {
+                const qsizetype offset = (qsizetype(rect.y() + y) * image.width() + rect.x()) * 4;
+                std::memcpy(data + offset, delta.bytes.constData() + qsizetype(y) * rowSize, size_t(rowSize));
+            }
+        } else if (pix.bytes.isEmpty()) {
+            // unchanged, but unknown here
+            return false;
+        }
+        pixmaps.append(pix);
+    }
+    icon.setPixmaps(pixmaps);
+    return true;
+}
+
+QStringList StatusNotifierItemClientPrivate::propertyNames(Property property)
+{
+    switch (property) {
+    case StatusNotifierItemClient::CategoryProperty:
+        return { QStringLiteral("Category") };
+    case StatusNotifierItemClient::IdProperty:
+        return { QStringLiteral("Id") };
+    case StatusNotifierItemClient::TitleProperty:
+        return { QStringLiteral("Title") };
+    case StatusNotifierItemClient::StatusProperty:
+        return { QStringLiteral("Status") };
+    case StatusNotifierItemClient::IconThemePathProperty:
+        return { QStringLiteral("IconThemePath") };
+    case StatusNotifierItemClient::MenuProperty:
+        return { QStringLiteral("Menu") };
+    case StatusNotifierItemClient::ItemIsMenuProperty:
+        return { QStringLiteral("ItemIsMenu") };
+    case StatusNotifierItemClient::IconProperty:
+        return { QStringLiteral("IconName"), QStringLiteral("IconPixmap") };
+    case StatusNotifierItemClient::OverlayIconProperty:
+        return { QStringLiteral("OverlayIconName"), QStringLiteral("OverlayIconPixmap") };
+    case StatusNotifierItemClient::AttentionIconProperty:
+        return { QStringLiteral("AttentionIconName"), QStringLiteral("AttentionIconPixmap"),
+                 QStringLiteral("AttentionMovieName") };
+    case StatusNotifierItemClient::ToolTipProperty:
+        return { QStringLiteral("ToolTip") };
+    case StatusNotifierItemClient::AllProperties:
+        break;
+    }
+    return {};
+}
+
+void StatusNotifierItemClientPrivate::onNewTitle()
+{
+    scheduleRefresh(StatusNotifierItemClient::TitleProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewIcon()
+{
+    scheduleRefresh(StatusNotifierItemClient::IconProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewOverlayIcon()
+{
+    scheduleRefresh(StatusNotifierItemClient::OverlayIconProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewAttentionIcon()
+{
+    scheduleRefresh(StatusNotifierItemClient::AttentionIconProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewToolTip()
+{
+    scheduleRefresh(StatusNotifierItemClient::ToolTipProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewMenu()
+{
+    scheduleRefresh(StatusNotifierItemClient::MenuProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewStatus(const QString &newStatus)
+{
+    // the signal carries the value, no need for a round-trip
+    if (status == newStatus)
+        return;
+
+    status = newStatus;
+    Q_EMIT q->changed(StatusNotifierItemClient::StatusProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewIconThemePath(const QString &newPath)
+{
+    if (iconThemePath == newPath)
+        return;
+
+    iconThemePath = newPath;
+    Q_EMIT q->changed(StatusNotifierItemClient::IconThemePathProperty);
+}
+
+void StatusNotifierItemClientPrivate::onNewIconRevision(uint revision)
+{
+    latestIconRevision = revision;
+
+    if (!iconRevisionKnown || revision != iconRevision)
+        fetchIconDelta();
+}
+
+void StatusNotifierItemClientPrivate::onServiceOwnerChanged(const QString &, const QString &oldOwner,
+                                                            const QString &newOwner)
+{
+    // the replies still pending come from the former owner
+    ++generation;
+    refreshTimer.stop();
+    dirty   = {};
+    pending = {};
+
+    iconDeltaSupported = false;
+    iconDeltaPending   = false;
+    iconRevisionKnown  = false;
+    iconRevision       = 0;
+    latestIconRevision = 0;
+    icon.keepPixmaps   = false;
+
+    if (!oldOwner.isEmpty() && ready) {
+        ready = false;
+        Q_EMIT q->removed();
+    }
+    // a well-known name taken over by another process
+    if (!newOwner.isEmpty()) {
+        fetchAll();
+        fetchIconDelta();
+    }
+}
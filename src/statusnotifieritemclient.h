@@ -0,0 +1,186 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#ifndef STATUS_NOTIFIER_ITEM_CLIENT_H
+#define STATUS_NOTIFIER_ITEM_CLIENT_H
+
+#include "statusnotifieritem.h"
+#include "statusnotifieritem_export.h"
+
+#include <QIcon>
+#include <QObject>
+#include <QPoint>
+#include <QString>
+
+#include <memory>
+
+class StatusNotifierItemClientPrivate;
+/*!
+    Host side view of a remote StatusNotifierItem.
+
+    The client caches all the properties of the item, which are fetched
+    once with GetAll when the client is created. Afterwards, each New* signal
+    of the item only refreshes the properties it names, asynchronously.
+    Refreshes requested in a short time are coalesced in a single round-trip
+    per property, and a property is never fetched again while a previous
+    request for it is still pending.
+
+    Icons sent as pixmaps are converted back to QIcon only when requested.
+*/
+class SNI_QT_EXPORT StatusNotifierItemClient : public QObject
+{
+    Q_OBJECT
+
+    friend class StatusNotifierItemClientPrivate;
+
+public:
+    //! The groups of properties the client caches.
+    enum Property {
+        CategoryProperty      = 0x001, //!< Category
+        IdProperty            = 0x002, //!< Id
+        TitleProperty         = 0x004, //!< Title
+        StatusProperty        = 0x008, //!< Status
+        IconThemePathProperty = 0x010, //!< IconThemePath
+        MenuProperty          = 0x020, //!< Menu
+        ItemIsMenuProperty    = 0x040, //!< ItemIsMenu
+        IconProperty          = 0x080, //!< IconName and IconPixmap
+        OverlayIconProperty   = 0x100, //!< OverlayIconName and OverlayIconPixmap
+        AttentionIconProperty = 0x200, //!< AttentionIconName, AttentionIconPixmap and AttentionMovieName
+        ToolTipProperty       = 0x400, //!< ToolTip
+        AllProperties         = 0x7ff,
+    };
+    Q_DECLARE_FLAGS(Properties, Property)
+    Q_FLAG(Properties)
+
+    /*!
+        Starts tracking an item on the session bus.
+
+        @param item   The item as registered to the StatusNotifierWatcher,
+                      either a service name or a service name followed
+                      by the object path, e.g. ":1.42/StatusNotifierItem".
+        @param parent The parent object.
+    */
+    explicit StatusNotifierItemClient(const QString &item, QObject *parent = nullptr);
+
+    ~StatusNotifierItemClient() override;
+
+    /*!
+        @return the service name of the item.
+    */
+    QString service() const;
+
+    /*!
+        @return the object path of the item.
+    */
+    QString path() const;
+
+    /*!
+        @return whether the initial properties have been received,
+        and the item is still on the bus.
+        @see ready(), removed()
+    */
+    bool isReady() const;
+
+    /*!
+        Sets the delay used to coalesce refresh requests, 50ms by default.
+    */
+    void setRefreshDelay(int msec);
+
+    /*!
+        @return the delay used to coalesce refresh requests.
+    */
+    int refreshDelay() const;
+
+    /*!
+        Schedules a refresh of @p properties, coalesced with pending ones.
+    */
+    void refresh(Properties properties = AllProperties);
+
+    QString                         id() const;
+    StatusNotifierItem::SNICategory category() const;
+    StatusNotifierItem::SNIStatus   status() const;
+    QString                         title() const;
+    QString                         iconThemePath() const;
+    QString                         menuPath() const;
+    bool                            itemIsMenu() const;
+
+    QString iconName() const;
+    /*!
+        @return the main icon, from the pixmaps sent by the item if any,
+        from iconName() otherwise.
+    */
+    QIcon   icon() const;
+
+    QString overlayIconName() const;
+    /*!
+        @return the overlay icon.
+        @see icon()
+    */
+    QIcon   overlayIcon() const;
+
+    QString attentionIconName() const;
+    QString attentionMovieName() const;
+    /*!
+        @return the requesting attention icon.
+        @see icon()
+    */
+    QIcon   attentionIcon() const;
+
+    QString toolTipIconName() const;
+    /*!
+        @return the tooltip icon.
+        @see icon()
+    */
+    QIcon   toolTipIcon() const;
+    QString toolTipTitle() const;
+    QString toolTipSubTitle() const;
+
+    /*!
+        Asks the item for activation.
+    */
+    void activate(const QPoint &position);
+
+    /*!
+        Asks the item for secondary activation.
+    */
+    void secondaryActivate(const QPoint &position);
+
+    /*!
+        Asks the item to show its context menu.
+    */
+    void contextMenu(const QPoint &position);
+
+    /*!
+        Forwards a scroll action to the item.
+    */
+    void scroll(int delta, Qt::Orientation orientation);
+
+Q_SIGNALS:
+    /*!
+        Emitted once the initial properties have been received, and again
+        once a new owner of the service of the item answered.
+    */
+    void ready();
+
+    /*!
+        Emitted when the item leaves the bus; isReady() is false from then on.
+        The cached properties are kept, and refreshed if a new process takes
+        over the service of the item.
+    */
+    void removed();
+
+    /*!
+        Emitted when cached @p properties changed.
+    */
+    void changed(StatusNotifierItemClient::Properties properties);
+
+private:
+    std::unique_ptr<StatusNotifierItemClientPrivate> const d;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(StatusNotifierItemClient::Properties)
+
+#endif
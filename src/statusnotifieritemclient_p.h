@@ -0,0 +1,107 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#ifndef SNI_QT_CLIENT_PRIVATE_H
+#define SNI_QT_CLIENT_PRIVATE_H
+
+#include "statusnotifieritemclient.h"
+#include "statusnotifieritemdbus_p.hpp"
+
+#include <QDBusConnection>
+#include <QDBusServiceWatcher>
+#include <QIcon>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVariant>
+
+class StatusNotifierItemClientPrivate : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Property   = StatusNotifierItemClient::Property;
+    using Properties = StatusNotifierItemClient::Properties;
+
+    // An icon as cached by the client: its pixmaps until the first use
+    // converts them to a QIcon, which replaces them
+    struct Icon {
+        QIcon toIcon();
+        void  setName(const QString&);
+        void  setPixmaps(const SNIIconList&);
+
+        QString     name;
+        SNIIconList pixmaps;
+        QIcon       icon;
+        bool        hasPixmaps { false };  // which take precedence over the name
+        bool        converted { false };
+        bool        keepPixmaps { false }; // as the base of the icon deltas
+    };
+
+    StatusNotifierItemClientPrivate(StatusNotifierItemClient*);
+    StatusNotifierItemClientPrivate() = delete;
+
+    void init(const QString &item);
+    void scheduleRefresh(Properties);
+    void fetch();
+    void fetchAll();
+    void fetchProperty(Property);
+    void finished(Properties);
+    void apply(const QString &name, const QVariant &value);
+    void call(const QString &method, const QVariantList &arguments);
+    void fetchIconDelta();
+    bool applyIconDelta(const SNIIconDeltaList &);
+
+    static QStringList propertyNames(Property);
+
+    StatusNotifierItemClient* q;
+    QDBusConnection           connection;
+    QString                   service;
+    QString                   path;
+    QDBusServiceWatcher       serviceWatcher;
+    QTimer                    refreshTimer;
+    Properties                dirty;
+    Properties                pending;
+    quint32                   generation { 0 }; // of the owner of the service, older replies are dropped
+    bool                      ready { false };
+
+    // io.github.qtilities.StatusNotifierItem extension
+    bool                      iconDeltaSupported { false };
+    bool                      iconDeltaPending { false };
+    bool                      iconRevisionKnown { false };
+    quint32                   iconRevision { 0 };
+    quint32                   latestIconRevision { 0 };
+
+    // properties
+    QString category,
+            id,
+            title,
+            status,
+            iconThemePath,
+            menuPath,
+            attentionMovieName,
+            toolTipTitle,
+            toolTipSubTitle;
+    bool    itemIsMenu { false };
+    Icon    icon,
+            overlayIcon,
+            attentionIcon,
+            toolTipIcon;
+
+public Q_SLOTS:
+    void onNewTitle();
+    void onNewIcon();
+    void onNewOverlayIcon();
+    void onNewAttentionIcon();
+    void onNewToolTip();
+    void onNewMenu();
+    void onNewStatus(const QString &status);
+    void onNewIconThemePath(const QString &path);
+    void onNewIconRevision(uint revision);
+    void onServiceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner);
+};
+
+#endif // SNI_QT_CLIENT_PRIVATE_H
@@ -8,14 +8,16 @@
 #include "statusnotifieritemdbus_p_p.hpp"
 #include "statusnotifieritem.h"
 #include "statusnotifieritem_p.h"
-#include "statusnotifieritemadaptor.h"
+#include "statusnotifieritempixel_p.hpp"
 
 #include <dbusmenuexporter.h>
 
 #include <QDBusConnection>
-#include <QDBusInterface>
-#include <QDBusServiceWatcher>
+#include <QDBusMetaType>
+#include <QImage>
 #include <QMenu>
+#include <QPixmap>
+#include <QTimer>
 //==================================================================================================
 // DBus types
 //==================================================================================================
@@ -65,6 +67,57 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, SNIToolTip &toolT
     argument.endStructure();
     return argument;
 }
+
+// Marshall the SNIIconDelta data into a D-Bus argument
+QDBusArgument &operator<<(QDBusArgument &argument, const SNIIconDelta &delta)
+{
+    argument.beginStructure();
+    argument << delta.width;
+    argument << delta.height;
+    argument << delta.x;
+    argument << delta.y;
+    argument << delta.rectWidth;
+    argument << delta.rectHeight;
+    argument << delta.bytes;
+    argument.endStructure();
+    return argument;
+}
+
+// Retrieve the SNIIconDelta data from the D-Bus argument
+const QDBusArgument &operator>>(const QDBusArgument &argument, SNIIconDelta &delta)
+{
+    argument.beginStructure();
+    argument >> delta.width;
+    argument >> delta.height;
+    argument >> delta.x;
+    argument >> delta.y;
+    argument >> delta.rectWidth;
+    argument >> delta.rectHeight;
+    argument >> delta.bytes;
+    argument.endStructure();
+    return argument;
+}
+
+QIcon pixmapListToIcon(const SNIIconList &pixmapList)
+{
+    QIcon icon;
+    for (const SNIIcon &pix : pixmapList) {
+        if (pix.width <= 0 || pix.height <= 0
+            || pix.bytes.size() < qsizetype(pix.width) * pix.height * 4) {
+            continue;
+        }
+        QImage image(pix.width, pix.height, QImage::Format_ARGB32);
+
+        // data is in network byte order
+        const uchar *src = reinterpret_cast<const uchar *>(pix.bytes.constData());
+        for (int y = 0; y < pix.height; ++y) {
+            SNIPixelConverter::fromWire(src, reinterpret_cast<quint32 *>(image.scanLine(y)), pix.width);
+            src += qsizetype(pix.width) * 4;
+        }
+        icon.addPixmap(QPixmap::fromImage(image));
+    }
+    return icon;
+}
 //==================================================================================================
 // StatusNotifierItemDBus
 //==================================================================================================
@@ -78,8 +131,6 @@ StatusNotifierItemDBus::StatusNotifierItemDBus(StatusNotifierItem* parent)
 
 StatusNotifierItemDBus::~StatusNotifierItemDBus()
 {
-    d->sessionBus->unregisterObject(QLatin1String("/StatusNotifierItem"));
-    QDBusConnection::disconnectFromBus(d->service);
 }
 
 QString StatusNotifierItemDBus::id() const
@@ -89,51 +140,87 @@ QString StatusNotifierItemDBus::id() const
 
 QString StatusNotifierItemDBus::category() const
 {
-    return QLatin1String(
-        d->sni->metaObject()->enumerator(
-        d->sni->metaObject()->indexOfEnumerator("SNICategory")).valueToKey(d->sni->category()));
+    // the keys of the enumerators, without a meta-object lookup per read
+    switch (d->sni->category()) {
+    case StatusNotifierItem::ApplicationStatus: return QStringLiteral("ApplicationStatus");
+    case StatusNotifierItem::Communications:    return QStringLiteral("Communications");
+    case StatusNotifierItem::SystemServices:    return QStringLiteral("SystemServices");
+    case StatusNotifierItem::Hardware:          return QStringLiteral("Hardware");
+    case StatusNotifierItem::Reserved:          return QStringLiteral("Reserved");
+    }
+    return QString();
 }
 
 QString StatusNotifierItemDBus::status() const
 {
-    return QLatin1String(
-        d->sni->metaObject()->enumerator(
-        d->sni->metaObject()->indexOfEnumerator("SNIStatus")).valueToKey(d->sni->status()));
+    d->sni->d->trackFetch(SNILatencyTracker::Status);
+
+    switch (d->sni->status()) {
+    case StatusNotifierItem::Passive:        return QStringLiteral("Passive");
+    case StatusNotifierItem::Active:         return QStringLiteral("Active");
+    case StatusNotifierItem::NeedsAttention: return QStringLiteral("NeedsAttention");
+    }
+    return QString();
 }
 
 QString StatusNotifierItemDBus::title() const
 {
+    d->sni->d->trackFetch(SNILatencyTracker::Title);
+
     return d->sni->d->title;
 }
 
 QString StatusNotifierItemDBus::iconName() const
 {
-    return d->sni->d->iconName;
+    d->sni->d->trackFetch(SNILatencyTracker::Icon);
+
+    // hosts prefer names, hide it while progress frames are shown
+    if (d->sni->d->isProgressActive())
+        return QString();
+
+    return d->sni->d->icons[SNIIconSlot::Main].name;
 }
 
 SNIIconList StatusNotifierItemDBus::iconPixmap() const
 {
-    return d->sni->d->serializedIcon;
+    d->sni->d->trackFetch(SNILatencyTracker::Icon);
+
+    return d->sni->d->serialized(SNIIconSlot::Main);
+}
+
+QString StatusNotifierItemDBus::iconThemePath() const
+{
+    d->sni->d->trackFetch(SNILatencyTracker::IconThemePath);
+
+    return d->sni->d->iconThemePath;
 }
 
 QString StatusNotifierItemDBus::overlayIconName() const
 {
-    return d->sni->d->overlayIconName;
+    d->sni->d->trackFetch(SNILatencyTracker::OverlayIcon);
+
+    return d->sni->d->icons[SNIIconSlot::Overlay].name;
 }
 
 SNIIconList StatusNotifierItemDBus::overlayIconPixmap() const
 {
-    return d->sni->d->serializedOverlayIcon;
+    d->sni->d->trackFetch(SNILatencyTracker::OverlayIcon);
+
+    return d->sni->d->serialized(SNIIconSlot::Overlay);
 }
 
 QString StatusNotifierItemDBus::attentionIconName() const
 {
-    return d->sni->d->attentionIconName;
+    d->sni->d->trackFetch(SNILatencyTracker::AttentionIcon);
+
+    return d->sni->d->icons[SNIIconSlot::Attention].name;
 }
 
 SNIIconList StatusNotifierItemDBus::attentionIconPixmap() const
 {
-    return d->sni->d->serializedAttentionIcon;
+    d->sni->d->trackFetch(SNILatencyTracker::AttentionIcon);
+
+    return d->sni->d->serialized(SNIIconSlot::Attention);
 }
 
 uint32_t StatusNotifierItemDBus::windowId() const
@@ -143,11 +230,13 @@ uint32_t StatusNotifierItemDBus::windowId() const
 
 SNIToolTip StatusNotifierItemDBus::toolTip() const
 {
+    d->sni->d->trackFetch(SNILatencyTracker::ToolTip);
+
     SNIToolTip tt;
-    tt.iconName    = d->sni->d->toolTipIconName;
-    tt.iconPixmap  = d->sni->d->serializedToolTipIcon;
+    tt.iconName    = d->sni->d->icons[SNIIconSlot::ToolTip].name;
+    tt.iconPixmap  = d->sni->d->serialized(SNIIconSlot::ToolTip);
     tt.title       = d->sni->d->toolTipTitle;
-    tt.description = d->sni->d->toolTipSubTitle;
+    tt.description = d->sni->d->toolTipDescription();
     return tt;
 }
 
@@ -172,23 +261,23 @@ void StatusNotifierItemDBus::setContextMenu(QMenu* menu)
         return;
 
     if (d->menu)
-        QObject::disconnect(d->menu, &QObject::destroyed, d.get(), &StatusNotifierItemDBusPrivate::onMenuDestroyed);
+        QObject::disconnect(d->menuDestroyedConnection);
 
     d->menu = menu;
 
-    if (d->menu)
-        setMenuPath(QLatin1String("/MenuBar"));
-    else
-        setMenuPath(QLatin1String("/NO_DBUSMENU"));
-
-    // Note: we need to destroy menu exporter before creating new one
-    // to free the DBus object path for new menu
-    delete d->menuExporter;
-
     if (d->menu) {
-        QObject::connect(d->menu, &QObject::destroyed, d.get(), &StatusNotifierItemDBusPrivate::onMenuDestroyed);
-        d->menuExporter = new DBusMenuExporter{d->menuObjectPath.path(), d->menu, *d->sessionBus.get()};
+        d->menuDestroyedConnection = QObject::connect(d->menu, &QObject::destroyed, this, [this] {
+            d->onMenuDestroyed();
+        });
+    }
+
+    // a transport that can't export the menu is replaced by one that can
+    if (d->menu && d->transport && !d->transport->menuConnection()) {
+        d->detach();
+        d->attach();
+        return;
     }
+    d->exportMenu();
 }
 
 QMenu* StatusNotifierItemDBus::contextMenu() const
@@ -196,8 +285,25 @@ QMenu* StatusNotifierItemDBus::contextMenu() const
     return d->menu;
 }
 
+uint StatusNotifierItemDBus::iconRevision() const
+{
+    return d->sni->d->iconRevision;
+}
+
+SNIRevisionMap StatusNotifierItemDBus::revisions() const
+{
+    SNIRevisionMap map;
+    for (int update = 0; update < SNILatencyTracker::UpdateCount; ++update) {
+        map.insert(QLatin1String(SNILatencyTracker::updateName(SNILatencyTracker::Update(update))),
+                   d->sni->d->revisions[update]);
+    }
+    return map;
+}
+
 void StatusNotifierItemDBus::Activate(int x, int y)
 {
+    d->sni->d->record(SNITrace::Activate, x, y);
+
     if (d->sni->status() == StatusNotifierItem::NeedsAttention)
         d->sni->setStatus(StatusNotifierItem::Active);
 
@@ -206,6 +312,8 @@ void StatusNotifierItemDBus::Activate(int x, int y)
 
 void StatusNotifierItemDBus::SecondaryActivate(int x, int y)
 {
+    d->sni->d->record(SNITrace::SecondaryActivate, x, y);
+
     if (d->sni->status() == StatusNotifierItem::NeedsAttention)
         d->sni->setStatus(StatusNotifierItem::Active);
 
@@ -214,6 +322,8 @@ void StatusNotifierItemDBus::SecondaryActivate(int x, int y)
 
 void StatusNotifierItemDBus::ContextMenu(int x, int y)
 {
+    d->sni->d->record(SNITrace::ContextMenu, x, y);
+
     if (d->menu != nullptr)
     {
         if (d->menu->isVisible())
@@ -229,13 +339,28 @@ void StatusNotifierItemDBus::Scroll(int delta, const QString &orientation)
     if (orientation.toLower() == QLatin1String("horizontal"))
         orient = Qt::Horizontal;
 
+    d->sni->d->record(SNITrace::Scroll, delta, int(orient));
+
     Q_EMIT d->sni->scrollRequested(delta, orient);
 }
+
+void StatusNotifierItemDBus::onHostsChanged()
+{
+    // a host leaving doesn't tell whether others remain
+    d->queryHost();
+}
+
+uint StatusNotifierItemDBus::IconPixmapDelta(uint revision, SNIIconDeltaList &delta)
+{
+    d->sni->d->trackFetch(SNILatencyTracker::Icon);
+
+    d->sni->d->serialized(SNIIconSlot::Main);
+    delta = d->sni->d->iconDelta(revision);
+    return d->sni->d->iconRevision;
+}
 //==================================================================================================
 // StatusNotifierItemDBusPrivate
 //==================================================================================================
-int StatusNotifierItemDBusPrivate::serviceCounter = 0;
-
 StatusNotifierItemDBusPrivate::StatusNotifierItemDBusPrivate(StatusNotifierItemDBus* owner)
     : q(owner)
 {
@@ -243,54 +368,103 @@ StatusNotifierItemDBusPrivate::StatusNotifierItemDBusPrivate(StatusNotifierItemD
 
 void StatusNotifierItemDBusPrivate::init()
 {
-    sni     = static_cast<StatusNotifierItem*>(q->parent());
-    adaptor = new StatusNotifierItemAdaptor(q);
-    service = QString::fromLatin1("org.freedesktop.StatusNotifierItem-%1-%2")
-                        .arg(QCoreApplication::applicationPid(), ++serviceCounter);
-    sessionBus =
-        std::make_unique<QDBusConnection>(
-            QDBusConnection::connectToBus(QDBusConnection::SessionBus, service)
-        );
+    sni = static_cast<StatusNotifierItem*>(q->parent());
 
     menuObjectPath.setPath(QLatin1String("/NO_DBUSMENU"));
 
-    // Register DBus meta types
-    qDBusRegisterMetaType<SNIIcon>();
-    qDBusRegisterMetaType<SNIIconList>();
-    qDBusRegisterMetaType<SNIToolTip>();
-
-    // Separate DBus connection to the session bus is created, because QDbus does not provide
-    // a way to register different objects for different services with the same paths.
-    // For status notifiers we need different /StatusNotifierItem for each service.
+    // Register DBus meta types, once whatever the thread of the first item
+    static const bool registered = [] {
+        qDBusRegisterMetaType<SNIIcon>();
+        qDBusRegisterMetaType<SNIIconList>();
+        qDBusRegisterMetaType<SNIToolTip>();
+        qDBusRegisterMetaType<SNIIconDelta>();
+        qDBusRegisterMetaType<SNIIconDeltaList>();
+        qDBusRegisterMetaType<SNIRevisionMap>();
+        return true;
+    }();
+    Q_UNUSED(registered)
+}
 
-    // register service
-    sessionBus->registerObject(QLatin1String("/StatusNotifierItem"), q);
+void StatusNotifierItemDBusPrivate::attach()
+{
+    // exports the item and follows the hosts and the watcher
+    transport = SNITransport::create(this);
+    exportMenu();
     registerToHost();
+}
+
+void StatusNotifierItemDBusPrivate::detach()
+{
+    // the exporter uses the connection of the transport
+    delete menuExporter;
+    menuExporter = nullptr;
+    menuObjectPath.setPath(QLatin1String("/NO_DBUSMENU"));
+
+    // hide() may be called from a slot a transport is answering, even
+    // several times: each one is kept until the event loop is back
+    if (transport) {
+        retired.push_back(std::move(transport));
+        if (retired.size() == 1)
+            QTimer::singleShot(0, q, [this] { retired.clear(); });
+    }
+
+    setRegistration(RegistrationPending);
+    setHostAvailable(false);
+}
 
-    // monitor the watcher service in case the host restarts
-    QDBusServiceWatcher *watcher = new QDBusServiceWatcher(
-        QLatin1String("org.kde.StatusNotifierWatcher"),
-        *sessionBus.get(),
-        QDBusServiceWatcher::WatchForOwnerChange,
-        q
-    );
-    QObject::connect(
-        watcher, &QDBusServiceWatcher::serviceOwnerChanged,
-        this, &StatusNotifierItemDBusPrivate::onServiceOwnerChanged
-    );
+void StatusNotifierItemDBusPrivate::exportMenu()
+{
+    // the menu is still shown on ContextMenu by transports that can't export it
+    QDBusConnection* connection = transport ? transport->menuConnection() : nullptr;
+
+    if (menu && connection)
+        q->setMenuPath(QLatin1String("/MenuBar"));
+    else
+        q->setMenuPath(QLatin1String("/NO_DBUSMENU"));
+
+    // Note: we need to destroy menu exporter before creating new one
+    // to free the DBus object path for new menu
+    delete menuExporter;
+    menuExporter = nullptr;
+
+    if (menu && connection)
+        menuExporter = new DBusMenuExporter{menuObjectPath.path(), menu, *connection};
 }
 
 void StatusNotifierItemDBusPrivate::registerToHost()
 {
-    QDBusInterface interface(
-        QLatin1String("org.kde.StatusNotifierWatcher"),
-        QLatin1String("/StatusNotifierWatcher"),
-        QLatin1String("org.kde.StatusNotifierWatcher"), *sessionBus.get()
-    );
-    interface.asyncCall(
-        QLatin1String("RegisterStatusNotifierItem"),
-        sessionBus->baseService()
-    );
+    setRegistration(RegistrationPending);
+    if (transport)
+        transport->registerItem();
+}
+
+void StatusNotifierItemDBusPrivate::queryHost()
+{
+    if (transport)
+        transport->queryHost();
+}
+
+void StatusNotifierItemDBusPrivate::setRegistration(RegistrationState state)
+{
+    if (registration == state)
+        return;
+
+    registration = state;
+
+    if (state != RegistrationPending)
+        Q_EMIT sni->registrationFinished(state == Registered);
+}
+
+void StatusNotifierItemDBusPrivate::setHostAvailable(bool available)
+{
+    if (hostAvailable == available)
+        return;
+
+    hostAvailable = available;
+    if (available)
+        sni->d->flushDeferredUpdates();
+
+    Q_EMIT sni->hostAvailabilityChanged(available);
 }
 
 void StatusNotifierItemDBusPrivate::onMenuDestroyed()
@@ -309,6 +483,10 @@ void StatusNotifierItemDBusPrivate::onServiceOwnerChanged(
     Q_UNUSED(service)
     Q_UNUSED(oldOwner)
 
-    if (!newOwner.isEmpty())
+    if (!newOwner.isEmpty()) {
         registerToHost();
+    } else {
+        setRegistration(RegistrationPending);
+        setHostAvailable(false);
+    }
 }
@@ -8,6 +8,8 @@
 
 #include <QDBusArgument>
 #include <QDBusObjectPath>
+#include <QIcon>
+#include <QMap>
 #include <QObject>
 #include <QString>
 
@@ -26,6 +28,7 @@ struct SNIIcon {
     int width;        //!< The icon width. @todo pixels?
     int height;       //!< The icon height.
     QByteArray bytes; //!< The icon data.
+    std::shared_ptr<const void> mapping; //!< Keeps @c bytes valid when they wrap a cached file.
 };
 
 /*!
@@ -59,9 +62,46 @@ struct SNIToolTip {
     QString description;
 };
 
+/*!
+    Changed area of one size of an icon, between two revisions.
+
+    The area holds rectWidth * rectHeight ARGB32 pixels in network byte order,
+    row by row, to be copied at (x, y) into the image of the same size.
+    An empty area means that the image of that size didn't change.
+*/
+struct SNIIconDelta {
+    int width;        //!< The width of the whole image.
+    int height;       //!< The height of the whole image.
+    int x;            //!< The left edge of the changed area.
+    int y;            //!< The top edge of the changed area.
+    int rectWidth;    //!< The width of the changed area.
+    int rectHeight;   //!< The height of the changed area.
+    QByteArray bytes; //!< The pixels of the changed area.
+};
+
+/*!
+    Changes of an icon since a given revision, with signature a(iiiiiiay).
+
+    There is one entry per size of the current icon, in the same order
+    of the IconPixmap property; sizes that are not listed no longer exist.
+    The area of a size missing on the receiving side always covers the whole image.
+*/
+typedef QList<SNIIconDelta> SNIIconDeltaList;
+
+/*!
+    Revision of each group of properties, keyed by group, with signature a{su}.
+
+    The groups are named after the signal announcing their changes:
+    Status, Title, Icon, OverlayIcon, AttentionIcon, ToolTip and IconThemePath.
+*/
+typedef QMap<QString, uint> SNIRevisionMap;
+
 Q_DECLARE_METATYPE(SNIIcon)
 Q_DECLARE_METATYPE(SNIIconList)
 Q_DECLARE_METATYPE(SNIToolTip)
+Q_DECLARE_METATYPE(SNIIconDelta)
+Q_DECLARE_METATYPE(SNIIconDeltaList)
+Q_DECLARE_METATYPE(SNIRevisionMap)
 
 QDBusArgument &operator<<(QDBusArgument &argument, const SNIIcon &icon);
 const QDBusArgument &operator>>(const QDBusArgument &argument, SNIIcon &icon);
@@ -69,6 +109,15 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, SNIIcon &icon);
 QDBusArgument &operator<<(QDBusArgument &argument, const SNIToolTip &toolTip);
 const QDBusArgument &operator>>(const QDBusArgument &argument, SNIToolTip &toolTip);
 
+QDBusArgument &operator<<(QDBusArgument &argument, const SNIIconDelta &delta);
+const QDBusArgument &operator>>(const QDBusArgument &argument, SNIIconDelta &delta);
+
+/*!
+    Converts back icon data received from the bus to a QIcon,
+    with a pixmap for each valid entry of @p pixmapList.
+*/
+QIcon pixmapListToIcon(const SNIIconList &pixmapList);
+
 //==================================================================================================
 // StatusNotifierItemDBus
 //==================================================================================================
@@ -133,6 +182,13 @@ class StatusNotifierItemDBus : public QObject
     */
     Q_PROPERTY(SNIIconList IconPixmap READ iconPixmap)
 
+    /*!
+        An additional path to add to the theme search path
+        to find the icons specified above.
+        @see StatusNotifierItem::setIconThemePath()
+    */
+    Q_PROPERTY(QString IconThemePath READ iconThemePath)
+
     /*!
         The Freedesktop-compliant name of an icon.
         This can be used by the visualization to indicate extra state information,
@@ -193,6 +249,20 @@ class StatusNotifierItemDBus : public QObject
     */
     Q_PROPERTY(QDBusObjectPath Menu READ menuPath)
 
+    /*!
+        Revision of IconPixmap, incremented each time it changes.
+        Part of the io.github.qtilities.StatusNotifierItem extension.
+        @see IconPixmapDelta()
+    */
+    Q_PROPERTY(uint IconRevision READ iconRevision)
+
+    /*!
+        Revision of each group of properties, incremented on each change.
+        Part of the io.github.qtilities.StatusNotifierItem extension.
+        @see SNIRevisionMap
+    */
+    Q_PROPERTY(SNIRevisionMap Revisions READ revisions)
+
     friend class StatusNotifierItem;
 
 public:
@@ -205,6 +275,7 @@ public:
     QString     title() const;
     QString     iconName() const;
     SNIIconList iconPixmap() const;
+    QString     iconThemePath() const;
     QString     overlayIconName() const;
     SNIIconList overlayIconPixmap() const;
     QString     attentionIconName() const;
@@ -241,6 +312,18 @@ public:
     void setContextMenu(QMenu*);
     QMenu* contextMenu() const;
 
+    /*!
+        @return the revision of the main icon.
+        @see IconRevision
+    */
+    uint iconRevision() const;
+
+    /*!
+        @return the revisions of the groups of properties.
+        @see Revisions
+    */
+    SNIRevisionMap revisions() const;
+
 public Q_SLOTS:
     /*!
         Asks the status notifier item to show a context menu.
@@ -297,8 +380,26 @@ public Q_SLOTS:
     */
     void Scroll(int delta, const QString &orientation);
 
+    /*!
+        Returns the areas of the main icon that changed since @p revision.
+
+        When @p revision is unknown, too old, or delta tracking is disabled,
+        each area covers the whole image.
+        Part of the io.github.qtilities.StatusNotifierItem extension.
+
+        @param revision  The revision known by the caller.
+        @param delta     The changed areas, one per icon size.
+        @return the current revision.
+        @see StatusNotifierItem::setIconDeltaUpdatesEnabled()
+    */
+    uint IconPixmapDelta(uint revision, SNIIconDeltaList &delta);
+
 // Q_SIGNALS are in StatusNotifierItemAdaptor
 
+private Q_SLOTS:
+    // StatusNotifierHostRegistered and StatusNotifierHostUnregistered of the watcher
+    void onHostsChanged();
+
 private:
     std::unique_ptr<StatusNotifierItemDBusPrivate> const d;
 };
@@ -6,11 +6,13 @@
 */
 #pragma once
 
+#include "statusnotifieritemtransport_p.hpp"
+
 #include <QObject>
-#include <QDBusConnection>
 #include <QDBusObjectPath>
 
 #include <memory>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 class QMenu;
@@ -19,33 +21,42 @@ QT_END_NAMESPACE
 class DBusMenuExporter;
 class StatusNotifierItem;
 class StatusNotifierItemDBus;
-class StatusNotifierItemAdaptor;
 
-class StatusNotifierItemDBusPrivate : public QObject
+class StatusNotifierItemDBusPrivate
 {
-    Q_OBJECT
-
     friend class StatusNotifierItem;
     friend class StatusNotifierItemDBus;
 
 public:
     StatusNotifierItemDBusPrivate(StatusNotifierItemDBus*);
 
+    enum RegistrationState : quint8 {
+        RegistrationPending,
+        Registered,
+        RegistrationFailed
+    };
+
     void init();
+    // the transport exists only while the item is shown
+    void attach();
+    void detach();
+    void exportMenu();
     void registerToHost();
+    void queryHost();
+    void setRegistration(RegistrationState);
+    void setHostAvailable(bool);
 
     StatusNotifierItem*              sni;
     StatusNotifierItemDBus*          q;
-    StatusNotifierItemAdaptor*       adaptor;
+    std::unique_ptr<SNITransport>    transport;
+    std::vector<std::unique_ptr<SNITransport>> retired; // until the event loop is back
     QDBusObjectPath                  menuObjectPath;
     DBusMenuExporter*                menuExporter { nullptr };
     QMenu*                           menu { nullptr };
-    std::unique_ptr<QDBusConnection> sessionBus;
-    QString                          service;
-
-    static int                       serviceCounter;
+    QMetaObject::Connection          menuDestroyedConnection;
+    RegistrationState                registration { RegistrationPending };
+    bool                             hostAvailable { false };
 
-public Q_SLOTS:
     void onMenuDestroyed();
     void onServiceOwnerChanged(
         const QString &service, const QString &oldOwner, const QString &newOwner
@@ -0,0 +1,292 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritemdispatcher_p.hpp"
+#include "statusnotifieritemdbus_p.hpp"
+#include "statusnotifieritemintrospection_p.hpp"
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusVariant>
+#include <QHash>
+
+namespace {
+const char* const interfaceNames[] = {
+    "org.kde.StatusNotifierItem",
+    "io.github.qtilities.StatusNotifierItem",
+    "org.freedesktop.DBus.Properties",
+    "org.freedesktop.DBus.Introspectable",
+    "org.freedesktop.DBus.Peer"
+};
+
+struct SNIMemberInfo
+{
+    const char*              name;
+    SNIDispatcher::Interface interface;
+    const char*              signature; // of the arguments
+};
+
+const SNIMemberInfo members[] = {
+    { "ContextMenu",       SNIDispatcher::ItemInterface,           "ii"  },
+    { "Activate",          SNIDispatcher::ItemInterface,           "ii"  },
+    { "SecondaryActivate", SNIDispatcher::ItemInterface,           "ii"  },
+    { "Scroll",            SNIDispatcher::ItemInterface,           "is"  },
+    { "IconPixmapDelta",   SNIDispatcher::ExtensionInterface,      "u"   },
+    { "Get",               SNIDispatcher::PropertiesInterface,     "ss"  },
+    { "GetAll",            SNIDispatcher::PropertiesInterface,     "s"   },
+    { "Set",               SNIDispatcher::PropertiesInterface,     "ssv" },
+    { "Introspect",        SNIDispatcher::IntrospectableInterface, ""    },
+    { "Ping",              SNIDispatcher::PeerInterface,           ""    },
+    { "GetMachineId",      SNIDispatcher::PeerInterface,           ""    }
+};
+
+const char* const propertyNames[] = {
+    "Category", "Id", "Title", "Status", "WindowId", "IconThemePath", "Menu", "ItemIsMenu",
+    "IconName", "IconPixmap", "OverlayIconName", "OverlayIconPixmap", "AttentionIconName",
+    "AttentionIconPixmap", "AttentionMovieName", "ToolTip", "IconRevision", "Revisions"
+};
+static_assert(sizeof(propertyNames) / sizeof(*propertyNames) == SNIDispatcher::PropertyCount,
+              "a name per property");
+
+SNIDispatcher::Interface interfaceOfProperty(SNIDispatcher::Property property)
+{
+    return property < SNIDispatcher::IconRevision ? SNIDispatcher::ItemInterface
+                                                  : SNIDispatcher::ExtensionInterface;
+}
+
+QDBusMessage unknownInterface(const QDBusMessage& message, const QString& interfaceName)
+{
+    return message.createErrorReply(QStringLiteral("org.freedesktop.DBus.Error.UnknownInterface"),
+                                    QStringLiteral("No such interface '%1'").arg(interfaceName));
+}
+
+const char standardInterfacesXml[] = R"sni(  <interface name="org.freedesktop.DBus.Properties">
+    <method name="Get">
+      <arg name="interface_name" type="s" direction="in"/>
+      <arg name="property_name" type="s" direction="in"/>
+      <arg name="value" type="v" direction="out"/>
+    </method>
+    <method name="Set">
+      <arg name="interface_name" type="s" direction="in"/>
+      <arg name="property_name" type="s" direction="in"/>
+      <arg name="value" type="v" direction="in"/>
+    </method>
+    <method name="GetAll">
+      <arg name="interface_name" type="s" direction="in"/>
+      <arg name="values" type="a{sv}" direction="out"/>
+    </method>
+    <signal name="PropertiesChanged">
+      <arg name="interface_name" type="s"/>
+      <arg name="changed_properties" type="a{sv}"/>
+      <arg name="invalidated_properties" type="as"/>
+    </signal>
+  </interface>
+  <interface name="org.freedesktop.DBus.Introspectable">
+    <method name="Introspect">
+      <arg name="xml_data" type="s" direction="out"/>
+    </method>
+  </interface>
+  <interface name="org.freedesktop.DBus.Peer">
+    <method name="Ping"/>
+    <method name="GetMachineId">
+      <arg name="machine_uuid" type="s" direction="out"/>
+    </method>
+  </interface>
+)sni";
+
+const QString& interfacesXml()
+{
+    static const QString xml = QLatin1String(sniItemInterfaceXml) + QLatin1Char('\n')
+                             + QLatin1String(sniExtensionInterfaceXml) + QLatin1Char('\n');
+    return xml;
+}
+
+const QString& introspectionDocument()
+{
+    static const QString document =
+        QLatin1String("<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
+                      " \"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n<node>\n")
+        + interfacesXml() + QLatin1String(standardInterfacesXml) + QLatin1String("</node>\n");
+    return document;
+}
+
+void sendReply(const QDBusMessage& message, const QDBusConnection& connection, const QDBusMessage& reply)
+{
+    if (message.isReplyRequired())
+        connection.send(reply);
+}
+} // namespace
+
+SNIDispatcher::SNIDispatcher(StatusNotifierItemDBus* item)
+    : item(item)
+{
+}
+
+SNIDispatcher::Interface SNIDispatcher::interfaceOf(const QString& name)
+{
+    static const QHash<QString, Interface> interfaces = [] {
+        QHash<QString, Interface> hash;
+        for (int i = 0; i < UnknownInterface; ++i)
+            hash.insert(QLatin1String(interfaceNames[i]), Interface(i));
+        return hash;
+    }();
+    return interfaces.value(name, UnknownInterface);
+}
+
+SNIDispatcher::Member SNIDispatcher::memberOf(const QString& name)
+{
+    static const QHash<QString, Member> names = [] {
+        QHash<QString, Member> hash;
+        for (int i = 0; i < UnknownMember; ++i)
+            hash.insert(QLatin1String(members[i].name), Member(i));
+        return hash;
+    }();
+    return names.value(name, UnknownMember);
+}
+
+SNIDispatcher::Property SNIDispatcher::propertyOf(const QString& name)
+{
+    static const QHash<QString, Property> properties = [] {
+        QHash<QString, Property> hash;
+        for (int i = 0; i < PropertyCount; ++i)
+            hash.insert(QLatin1String(propertyNames[i]), Property(i));
+        return hash;
+    }();
+    return properties.value(name, PropertyCount);
+}
+
+QString SNIDispatcher::introspect(const QString& path) const
+{
+    Q_UNUSED(path)
+    return interfacesXml();
+}
+
+bool SNIDispatcher::handleMessage(const QDBusMessage& message, const QDBusConnection& connection)
+{
+    const Member member = memberOf(message.member());
+    if (member == UnknownMember)
+        return false;
+
+    // the interface is optional in method calls
+    if (!message.interface().isEmpty() && interfaceOf(message.interface()) != members[member].interface)
+        return false;
+
+    if (message.signature() != QLatin1String(members[member].signature)) {
+        sendReply(message, connection, message.createErrorReply(
+            QDBusError::InvalidArgs,
+            QStringLiteral("Invalid arguments '%1' to %2").arg(message.signature(), message.member())));
+        return true;
+    }
+    const QVariantList arguments = message.arguments();
+
+    switch (member) {
+    case ContextMenu:
+        item->ContextMenu(arguments.at(0).toInt(), arguments.at(1).toInt());
+        sendReply(message, connection, message.createReply());
+        break;
+    case Activate:
+        item->Activate(arguments.at(0).toInt(), arguments.at(1).toInt());
+        sendReply(message, connection, message.createReply());
+        break;
+    case SecondaryActivate:
+        item->SecondaryActivate(arguments.at(0).toInt(), arguments.at(1).toInt());
+        sendReply(message, connection, message.createReply());
+        break;
+    case Scroll:
+        item->Scroll(arguments.at(0).toInt(), arguments.at(1).toString());
+        sendReply(message, connection, message.createReply());
+        break;
+    case IconPixmapDelta: {
+        SNIIconDeltaList delta;
+        const uint revision = item->IconPixmapDelta(arguments.at(0).toUInt(), delta);
+        sendReply(message, connection, message.createReply(
+            QVariantList { revision, QVariant::fromValue(delta) }));
+        break;
+    }
+    case Get:
+    case Set: {
+        // the interface is optional
+        const QString   interfaceName = arguments.at(0).toString();
+        const Interface interface     = interfaceName.isEmpty() ? UnknownInterface : interfaceOf(interfaceName);
+        const Property  property      = propertyOf(arguments.at(1).toString());
+
+        if (!interfaceName.isEmpty() && interface == UnknownInterface) {
+            sendReply(message, connection, unknownInterface(message, interfaceName));
+        } else if (property == PropertyCount
+            || (!interfaceName.isEmpty() && interface != interfaceOfProperty(property))) {
+            sendReply(message, connection, message.createErrorReply(
+                QStringLiteral("org.freedesktop.DBus.Error.UnknownProperty"),
+                QStringLiteral("No such property '%1'").arg(arguments.at(1).toString())));
+        } else if (member == Set) {
+            sendReply(message, connection, message.createErrorReply(
+                QStringLiteral("org.freedesktop.DBus.Error.PropertyReadOnly"),
+                QStringLiteral("Property '%1' is read-only").arg(arguments.at(1).toString())));
+        } else {
+            sendReply(message, connection, message.createReply(
+                QVariant::fromValue(QDBusVariant(value(property)))));
+        }
+        break;
+    }
+    case GetAll: {
+        // all the properties for an empty interface
+        const QString   interfaceName = arguments.at(0).toString();
+        const Interface interface     = interfaceName.isEmpty() ? UnknownInterface : interfaceOf(interfaceName);
+
+        if (!interfaceName.isEmpty() && interface == UnknownInterface) {
+            sendReply(message, connection, unknownInterface(message, interfaceName));
+            break;
+        }
+        QVariantMap map;
+        if (interface == ItemInterface || interface == ExtensionInterface || interfaceName.isEmpty()) {
+            for (int i = 0; i < PropertyCount; ++i) {
+                if (interfaceName.isEmpty() || interfaceOfProperty(Property(i)) == interface)
+                    map.insert(QLatin1String(propertyNames[i]), value(Property(i)));
+            }
+        }
+        sendReply(message, connection, message.createReply(map));
+        break;
+    }
+    case Introspect:
+        sendReply(message, connection, message.createReply(introspectionDocument()));
+        break;
+    case Ping:
+        sendReply(message, connection, message.createReply());
+        break;
+    case GetMachineId:
+        sendReply(message, connection, message.createReply(
+            QString::fromLatin1(QDBusConnection::localMachineId())));
+        break;
+    case UnknownMember:
+        return false;
+    }
+    return true;
+}
+
+QVariant SNIDispatcher::value(Property property) const
+{
+    switch (property) {
+    case Category:            return item->category();
+    case Id:                  return item->id();
+    case Title:               return item->title();
+    case Status:              return item->status();
+    case WindowId:            return int(item->windowId());
+    case IconThemePath:       return item->iconThemePath();
+    case Menu:                return QVariant::fromValue(item->menuPath());
+    case ItemIsMenu:          return item->itemIsMenu();
+    case IconName:            return item->iconName();
+    case IconPixmap:          return QVariant::fromValue(item->iconPixmap());
+    case OverlayIconName:     return item->overlayIconName();
+    case OverlayIconPixmap:   return QVariant::fromValue(item->overlayIconPixmap());
+    case AttentionIconName:   return item->attentionIconName();
+    case AttentionIconPixmap: return QVariant::fromValue(item->attentionIconPixmap());
+    case AttentionMovieName:  return QString();
+    case ToolTip:             return QVariant::fromValue(item->toolTip());
+    case IconRevision:        return item->iconRevision();
+    case Revisions:           return QVariant::fromValue(item->revisions());
+    case PropertyCount:       break;
+    }
+    return QVariant();
+}
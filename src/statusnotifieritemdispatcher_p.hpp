@@ -0,0 +1,82 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QDBusVirtualObject>
+
+class StatusNotifierItemDBus;
+
+/*!
+    Serves the item and its extension on a QDBusConnection without the
+    generated adaptors, which look properties and methods up by name in
+    the meta-object on each call.
+
+    Members and properties are mapped once to enumerators, property values
+    are read from the plain getters of StatusNotifierItemDBus, and the
+    introspection data is built once from the interface files.
+*/
+class SNIDispatcher : public QDBusVirtualObject
+{
+public:
+    explicit SNIDispatcher(StatusNotifierItemDBus* item);
+
+    QString introspect(const QString& path) const override;
+    bool    handleMessage(const QDBusMessage& message, const QDBusConnection& connection) override;
+
+    enum Interface : quint8 {
+        ItemInterface,
+        ExtensionInterface,
+        PropertiesInterface,
+        IntrospectableInterface,
+        PeerInterface,
+        UnknownInterface
+    };
+    enum Member : quint8 {
+        ContextMenu,
+        Activate,
+        SecondaryActivate,
+        Scroll,
+        IconPixmapDelta,
+        Get,
+        GetAll,
+        Set,
+        Introspect,
+        Ping,
+        GetMachineId,
+        UnknownMember
+    };
+    enum Property : quint8 {
+        Category,
+        Id,
+        Title,
+        Status,
+        WindowId,
+        IconThemePath,
+        Menu,
+        ItemIsMenu,
+        IconName,
+        IconPixmap,
+        OverlayIconName,
+        OverlayIconPixmap,
+        AttentionIconName,
+        AttentionIconPixmap,
+        AttentionMovieName,
+        ToolTip,
+        IconRevision,      // the extension ones follow
+        Revisions,
+        PropertyCount
+    };
+
+private:
+    static Interface interfaceOf(const QString& name);
+    static Member    memberOf(const QString& name);
+    static Property  propertyOf(const QString& name);
+
+    QVariant value(Property) const;
+
+    StatusNotifierItemDBus* const item;
+};
@@ -0,0 +1,187 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritemiconcache_p.hpp"
+#include "statusnotifieritempool_p.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Q_GLOBAL_STATIC(SNIIconCache, iconCache)
+
+SNIIconCache* SNIIconCache::instance()
+{
+    return iconCache();
+}
+
+SNIIconCache::SNIIconCache()
+    : SNIIconCache(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                   + QLatin1String("/statusnotifieritem-qt/icons"))
+{
+}
+
+SNIIconCache::SNIIconCache(const QString& directory)
+    : directory(directory)
+{
+    // a single writer, so that the size of the directory is tracked without locking
+    writer.setMaxThreadCount(1);
+}
+
+SNIIconCache::~SNIIconCache()
+{
+    writer.waitForDone();
+}
+
+bool SNIIconCache::isEnabled() const
+{
+    return enabled;
+}
+
+void SNIIconCache::setEnabled(bool enable)
+{
+    enabled = enable;
+}
+
+QByteArray SNIIconCache::key(const QImage& image)
+{
+    // the same fast hash as the payload pool, MD5 would cost more than the conversion saved
+    quint64 hash = (quint64(image.width()) << 40) ^ (quint64(image.height()) << 16) ^ quint64(image.format());
+
+    // padding bytes are not part of the content
+    const qsizetype lineLength = qsizetype(image.width()) * image.depth() / 8;
+    if (image.bytesPerLine() == lineLength) {
+        hash = SNIPayloadPool::hash(image.constBits(), lineLength * image.height(), hash);
+    } else {
+        for (int y = 0; y < image.height(); ++y)
+            hash = SNIPayloadPool::hash(image.constScanLine(y), lineLength, hash);
+    }
+    return QByteArray::number(hash, 16);
+}
+
+QByteArray SNIIconCache::find(const QByteArray& key, int width, int height, std::shared_ptr<const void>& mapping)
+{
+    const QString path = filePath(key, width, height);
+
+    QMutexLocker locker(&mutex);
+
+    auto it = mapped.find(path);
+    if (it != mapped.end()) {
+        it->lastUse = ++useCount;
+        mapping     = it->mapping;
+        return it->bytes;
+    }
+
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return QByteArray();
+
+    // a truncated or foreign file is not an error, just a miss
+    const qint64 size = qint64(width) * height * 4;
+    struct stat status;
+    void* data = MAP_FAILED;
+    if (::fstat(fd, &status) == 0 && status.st_size == size) {
+        data = ::mmap(nullptr, size_t(size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // the entry was used, for the eviction of the least recently used ones
+        ::futimens(fd, nullptr);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return QByteArray();
+
+    mapping = std::shared_ptr<const void>(data, [size](const void* p) {
+        ::munmap(const_cast<void*>(p), size_t(size));
+    });
+    const QByteArray bytes = QByteArray::fromRawData(static_cast<const char*>(data), int(size));
+
+    if (mapped.size() >= maximumMappings) {
+        auto oldest = mapped.begin();
+        for (auto i = mapped.begin(); i != mapped.end(); ++i) {
+            if (i->lastUse < oldest->lastUse)
+                oldest = i;
+        }
+        mapped.erase(oldest);
+    }
+    mapped.insert(path, Mapping { bytes, mapping, ++useCount });
+    return bytes;
+}
+
+void SNIIconCache::insert(const QByteArray& key, int width, int height, const QByteArray& bytes)
+{
+    const QString path = filePath(key, width, height);
+    {
+        QMutexLocker locker(&mutex);
+        if (pending.contains(path))
+            return;
+        pending.insert(path);
+    }
+    writer.start([this, path, bytes] {
+        write(path, bytes);
+
+        QMutexLocker locker(&mutex);
+        pending.remove(path);
+    });
+}
+
+void SNIIconCache::waitForWrites()
+{
+    writer.waitForDone();
+}
+
+void SNIIconCache::write(const QString& path, const QByteArray& bytes)
+{
+    if (QFileInfo::exists(path) || !QDir().mkpath(directory))
+        return;
+
+    if (diskSize < 0) {
+        diskSize = 0;
+        for (const QFileInfo& entry : QDir(directory).entryInfoList({ QStringLiteral("*.argb") }, QDir::Files))
+            diskSize += entry.size();
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    file.write(bytes);
+    if (!file.commit())
+        return;
+
+    diskSize += bytes.size();
+    if (diskSize > maximumSize)
+        trim();
+}
+
+void SNIIconCache::trim()
+{
+    // oldest first, down to three quarters to not trim on every write
+    const QFileInfoList entries = QDir(directory).entryInfoList(
+        { QStringLiteral("*.argb") }, QDir::Files, QDir::Time | QDir::Reversed);
+
+    for (const QFileInfo& entry : entries) {
+        if (diskSize <= maximumSize / 4 * 3)
+            break;
+        // mapped entries stay readable once removed
+        if (QFile::remove(entry.filePath()))
+            diskSize -= entry.size();
+    }
+}
+
+QString SNIIconCache::filePath(const QByteArray& key, int width, int height) const
+{
+    return QString::fromLatin1("%1/%2-%3x%4.argb")
+        .arg(directory, QString::fromLatin1(key))
+        .arg(width)
+        .arg(height);
+}
@@ -0,0 +1,99 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+#include <atomic>
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+class QImage;
+QT_END_NAMESPACE
+
+/*!
+    Persistent cache of serialized icons, shared by all the items of the process.
+
+    Each entry is a single file holding the big-endian ARGB32 payload
+    of one icon size, as it is sent over the bus in a(iiay).
+    Entries are named after the hash of the source image content and its size,
+    and are memory-mapped read-only when found, so the returned arrays wrap
+    the mapping and no conversion happens.
+
+    Entries are written by a background thread, never by the setters, and
+    the least recently used ones are removed once the directory exceeds
+    maximumSize. Only the most recently found mappings are kept open;
+    the others live as long as the icons using them.
+
+    The cache may be used by items of several threads.
+*/
+class SNIIconCache
+{
+public:
+    static SNIIconCache* instance();
+
+    SNIIconCache();
+    explicit SNIIconCache(const QString& directory);
+    ~SNIIconCache();
+
+    bool isEnabled() const;
+    void setEnabled(bool enabled);
+
+    /*!
+        @return the cache key of @p image, computed from its pixels,
+        format and size.
+    */
+    static QByteArray key(const QImage& image);
+
+    /*!
+        @return the cached payload for @p key or a null QByteArray
+        if there is no valid entry for it. The payload wraps a mapping
+        that stays valid as long as @p mapping holds it.
+    */
+    QByteArray find(const QByteArray& key, int width, int height, std::shared_ptr<const void>& mapping);
+
+    /*!
+        Stores @p bytes as the payload for @p key, from the writer thread.
+    */
+    void insert(const QByteArray& key, int width, int height, const QByteArray& bytes);
+
+    /*!
+        Waits until the entries being inserted are written.
+    */
+    void waitForWrites();
+
+    static constexpr qint64 maximumSize = 16 * 1024 * 1024;
+
+private:
+    struct Mapping
+    {
+        QByteArray                  bytes;
+        std::shared_ptr<const void> mapping;
+        quint64                     lastUse;
+    };
+
+    QString filePath(const QByteArray& key, int width, int height) const;
+    // on the writer thread
+    void write(const QString& path, const QByteArray& bytes);
+    void trim();
+
+    static constexpr int maximumMappings = 64;
+
+    std::atomic<bool>       enabled { false };
+    QString                 directory;
+    QMutex                  mutex;  // guards the mappings and the pending writes
+    QHash<QString, Mapping> mapped;
+    quint64                 useCount { 0 };
+    QSet<QString>           pending;
+    qint64                  diskSize { -1 }; // of the directory, on the writer thread
+    QThreadPool             writer;
+};
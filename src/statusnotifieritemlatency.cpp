@@ -0,0 +1,227 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritemlatency_p.hpp"
+
+#include <QtAlgorithms>
+#include <QTextStream>
+
+#include <cmath>
+//==============================================================================
+// SNILatencyHistogram
+//==============================================================================
+void SNILatencyHistogram::record(qint64 usec)
+{
+    usec = qBound(qint64(0), usec, (qint64(1) << maxBits) - 1);
+
+    if (counts.isEmpty())
+        counts.fill(0, bucketCount);
+
+    ++counts[index(quint64(usec))];
+
+    minimum = total == 0 ? usec : qMin(minimum, usec);
+    maximum = qMax(maximum, usec);
+    sum    += usec;
+    ++total;
+}
+
+double SNILatencyHistogram::mean() const
+{
+    return total == 0 ? 0.0 : double(sum) / total;
+}
+
+qint64 SNILatencyHistogram::percentile(double percentile) const
+{
+    if (total == 0)
+        return 0;
+
+    const qint64 rank = qMax(qint64(1), qint64(std::ceil(qBound(0.0, percentile, 100.0) / 100.0 * total)));
+
+    qint64 seen = 0;
+    for (int i = 0; i < counts.size(); ++i) {
+        seen += counts.at(i);
+        if (seen >= rank)
+            return qMin(highestEquivalent(i), maximum);
+    }
+    return maximum;
+}
+
+QVariantMap SNILatencyHistogram::toVariantMap() const
+{
+    QVariantMap map;
+    map.insert(QStringLiteral("count"), total);
+    map.insert(QStringLiteral("min"),   minimum);
+    map.insert(QStringLiteral("max"),   maximum);
+    map.insert(QStringLiteral("mean"),  mean());
+    map.insert(QStringLiteral("p50"),   percentile(50.0));
+    map.insert(QStringLiteral("p90"),   percentile(90.0));
+    map.insert(QStringLiteral("p99"),   percentile(99.0));
+    map.insert(QStringLiteral("p99.9"), percentile(99.9));
+    return map;
+}
+
+qint64 SNILatencyHistogram::memoryUsage() const
+{
+    return sizeof(SNILatencyHistogram) + counts.capacity() * qint64(sizeof(quint32));
+}
+
+int SNILatencyHistogram::index(quint64 usec)
+{
+    if (usec < linearCount)
+        return int(usec);
+
+    // the highest bit selects the power of two, the next 4 bits the bucket
+    const int msb = 63 - qCountLeadingZeroBits(usec);
+    const int sub = int(usec >> (msb - subBucketBits)) & ((1 << subBucketBits) - 1);
+    return linearCount + (msb - 5) * (1 << subBucketBits) + sub;
+}
+
+qint64 SNILatencyHistogram::highestEquivalent(int index)
+{
+    if (index < linearCount)
+        return index;
+
+    const int    msb   = (index - linearCount) / (1 << subBucketBits) + 5;
+    const int    sub   = (index - linearCount) % (1 << subBucketBits);
+    const qint64 width = qint64(1) << (msb - subBucketBits);
+    return ((1 << subBucketBits) + sub) * width + width - 1;
+}
+//==============================================================================
+// SNILatencyTracker
+//==============================================================================
+SNILatencyTracker::SNILatencyTracker()
+{
+    clock.start();
+}
+
+void SNILatencyTracker::changed(Update update)
+{
+    Pending& p = pending[update];
+
+    p.lastChanged = now();
+    if (p.changed < 0)
+        p.changed = p.lastChanged;
+}
+
+void SNILatencyTracker::emitted(Update update)
+{
+    Pending&     p = pending[update];
+    const qint64 t = now();
+
+    if (p.lastChanged >= 0) {
+        record(update, SetToEmit, t - p.lastChanged);
+        p.lastChanged = -1;
+    }
+    if (p.emitted < 0)
+        p.emitted = t;
+}
+
+void SNILatencyTracker::fetched(Update update)
+{
+    Pending&     p = pending[update];
+    const qint64 t = now();
+
+    if (p.emitted >= 0)
+        record(update, EmitToFetch, t - p.emitted);
+    if (p.changed >= 0)
+        record(update, SetToFetch, t - p.changed);
+
+    p.changed = -1;
+    p.emitted = -1;
+}
+
+QVariantMap SNILatencyTracker::statistics() const
+{
+    QVariantMap map;
+    for (int u = 0; u < UpdateCount; ++u) {
+        QVariantMap stages;
+        for (int s = 0; s < StageCount; ++s) {
+            if (histograms[u][s])
+                stages.insert(QLatin1String(stageName(Stage(s))), histograms[u][s]->toVariantMap());
+        }
+        if (!stages.isEmpty())
+            map.insert(QLatin1String(updateName(Update(u))), stages);
+    }
+    return map;
+}
+
+QString SNILatencyTracker::report() const
+{
+    QString     text;
+    QTextStream stream(&text);
+
+    stream << "update         stage        count      min      p50      p90      p99    p99.9      max (us)\n";
+    for (int u = 0; u < UpdateCount; ++u) {
+        for (int s = 0; s < StageCount; ++s) {
+            const SNILatencyHistogram* h = histograms[u][s].get();
+            if (!h)
+                continue;
+
+            stream << qSetFieldWidth(15) << Qt::left << updateName(Update(u))
+                   << qSetFieldWidth(11) << stageName(Stage(s))
+                   << qSetFieldWidth(9) << Qt::right
+                   << h->count() << h->min()
+                   << h->percentile(50.0) << h->percentile(90.0)
+                   << h->percentile(99.0) << h->percentile(99.9)
+                   << h->max()
+                   << qSetFieldWidth(0) << '\n';
+        }
+    }
+    stream.flush();
+    return text;
+}
+
+qint64 SNILatencyTracker::memoryUsage() const
+{
+    qint64 bytes = sizeof(SNILatencyTracker);
+    for (int u = 0; u < UpdateCount; ++u) {
+        for (int s = 0; s < StageCount; ++s) {
+            if (histograms[u][s])
+                bytes += histograms[u][s]->memoryUsage();
+        }
+    }
+    return bytes;
+}
+
+const char* SNILatencyTracker::updateName(Update update)
+{
+    switch (update) {
+    case Status:        return "Status";
+    case Title:         return "Title";
+    case Icon:          return "Icon";
+    case OverlayIcon:   return "OverlayIcon";
+    case AttentionIcon: return "AttentionIcon";
+    case ToolTip:       return "ToolTip";
+    case IconThemePath: return "IconThemePath";
+    case UpdateCount:   break;
+    }
+    return "";
+}
+
+const char* SNILatencyTracker::stageName(Stage stage)
+{
+    switch (stage) {
+    case SetToEmit:   return "setToEmit";
+    case EmitToFetch: return "emitToFetch";
+    case SetToFetch:  return "setToFetch";
+    case StageCount:  break;
+    }
+    return "";
+}
+
+qint64 SNILatencyTracker::now() const
+{
+    return clock.nsecsElapsed() / 1000;
+}
+
+void SNILatencyTracker::record(Update update, Stage stage, qint64 usec)
+{
+    std::unique_ptr<SNILatencyHistogram>& histogram = histograms[update][stage];
+    if (!histogram)
+        histogram.reset(new SNILatencyHistogram);
+
+    histogram->record(usec);
+}
@@ -0,0 +1,111 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+#include <memory>
+
+/*!
+    Histogram of latencies in microseconds.
+
+    Buckets are log-linear, as in HdrHistogram: values below 32us are exact,
+    larger ones fall in one of 16 buckets per power of two, so any reported
+    value is within 6.25% of the recorded one. Values are clamped to 2^32us.
+*/
+class SNILatencyHistogram
+{
+public:
+    void   record(qint64 usec);
+    qint64 count() const { return total; }
+    qint64 min() const { return minimum; }
+    qint64 max() const { return maximum; }
+    double mean() const;
+
+    /*!
+        @return the highest value equivalent to the one at @p percentile,
+        between 0 and 100.
+    */
+    qint64 percentile(double percentile) const;
+
+    QVariantMap toVariantMap() const;
+    qint64      memoryUsage() const;
+
+private:
+    static constexpr int linearCount   = 32;
+    static constexpr int subBucketBits = 4;
+    static constexpr int maxBits       = 32;
+    static constexpr int bucketCount   = linearCount + (maxBits - 5) * (1 << subBucketBits);
+
+    static int    index(quint64 usec);
+    static qint64 highestEquivalent(int index);
+
+    QVector<quint32> counts; // allocated on first record
+    qint64           total { 0 };
+    qint64           sum { 0 };
+    qint64           minimum { 0 };
+    qint64           maximum { 0 };
+};
+
+/*!
+    Timestamps the updates of an item, from the setter call to the emission
+    of the New* signal and to the first fetch of the new value by a host,
+    through Get, GetAll or IconPixmapDelta.
+
+    Several changes before a fetch are measured from the first of them,
+    i.e. the time the host has been showing a stale value.
+*/
+class SNILatencyTracker
+{
+public:
+    enum Update : quint8 {
+        Status,
+        Title,
+        Icon,
+        OverlayIcon,
+        AttentionIcon,
+        ToolTip,
+        IconThemePath,
+        UpdateCount
+    };
+    enum Stage : quint8 {
+        SetToEmit,
+        EmitToFetch,
+        SetToFetch,
+        StageCount
+    };
+
+    SNILatencyTracker();
+
+    void changed(Update);
+    void emitted(Update);
+    void fetched(Update);
+
+    QVariantMap statistics() const;
+    QString     report() const;
+    qint64      memoryUsage() const;
+
+    static const char* updateName(Update);
+    static const char* stageName(Stage);
+
+private:
+    struct Pending {
+        qint64 changed { -1 };     // first change not fetched yet
+        qint64 lastChanged { -1 }; // last change not emitted yet
+        qint64 emitted { -1 };     // first emission not fetched yet
+    };
+
+    qint64 now() const;
+    void   record(Update, Stage, qint64 usec);
+
+    QElapsedTimer                        clock;
+    Pending                              pending[UpdateCount];
+    std::unique_ptr<SNILatencyHistogram> histograms[UpdateCount][StageCount];
+};
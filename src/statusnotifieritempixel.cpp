@@ -0,0 +1,349 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritempixel_p.hpp"
+
+#include <QImage>
+#include <QtEndian>
+
+#include <array>
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SNI_QT_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+using RowKernel  = void (*)(const uchar* src, uchar* dst, int width);
+using WireKernel = void (*)(const uchar* src, quint32* dst, int count);
+
+struct SNIPixelKernels
+{
+    SNIPixelConverter::Isa isa;
+    RowKernel              argb32;
+    RowKernel              argb32Premultiplied;
+    RowKernel              rgb32;
+    RowKernel              rgba8888;
+    RowKernel              grayscale8;
+    WireKernel             fromWire;
+};
+
+// 0x00ff00ff / alpha, the factors of qUnpremultiply()
+const quint32* inverseAlpha()
+{
+    static const std::array<quint32, 256> factors = [] {
+        std::array<quint32, 256> table {};
+        for (quint32 alpha = 1; alpha < 256; ++alpha)
+            table[alpha] = 0x00ff00ffu / alpha;
+        return table;
+    }();
+    return factors.data();
+}
+
+inline quint32 unpremultiply(quint32 p, const quint32* factors)
+{
+    const quint32 a = p >> 24;
+    const quint32 f = factors[a];
+    const quint32 r = ((((p >> 16) & 0xff) * f + 0x8000) >> 16) & 0xff;
+    const quint32 g = ((((p >> 8) & 0xff) * f + 0x8000) >> 16) & 0xff;
+    const quint32 b = (((p & 0xff) * f + 0x8000) >> 16) & 0xff;
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+//--------------------------------------------------------------------------------------------------
+// scalar kernels, for any CPU and the tails of the vector ones
+//--------------------------------------------------------------------------------------------------
+void argb32Scalar(const uchar* src, uchar* dst, int width)
+{
+    const quint32* s = reinterpret_cast<const quint32*>(src);
+    for (int x = 0; x < width; ++x)
+        qToBigEndian(s[x], dst + 4 * x);
+}
+
+void argb32PremultipliedScalar(const uchar* src, uchar* dst, int width)
+{
+    const quint32* s       = reinterpret_cast<const quint32*>(src);
+    const quint32* factors = inverseAlpha();
+    for (int x = 0; x < width; ++x)
+        qToBigEndian(unpremultiply(s[x], factors), dst + 4 * x);
+}
+
+void rgb32Scalar(const uchar* src, uchar* dst, int width)
+{
+    const quint32* s = reinterpret_cast<const quint32*>(src);
+    for (int x = 0; x < width; ++x)
+        qToBigEndian(s[x] | 0xff000000u, dst + 4 * x);
+}
+
+void rgba8888Scalar(const uchar* src, uchar* dst, int width)
+{
+    // bytes R, G, B, A whatever the byte order
+    for (int x = 0; x < width; ++x, src += 4, dst += 4) {
+        dst[0] = src[3];
+        dst[1] = src[0];
+        dst[2] = src[1];
+        dst[3] = src[2];
+    }
+}
+
+void grayscale8Scalar(const uchar* src, uchar* dst, int width)
+{
+    for (int x = 0; x < width; ++x, dst += 4) {
+        dst[0] = 0xff;
+        dst[1] = dst[2] = dst[3] = src[x];
+    }
+}
+
+void fromWireScalar(const uchar* src, quint32* dst, int count)
+{
+    for (int x = 0; x < count; ++x)
+        dst[x] = qFromBigEndian<quint32>(src + 4 * x);
+}
+
+const SNIPixelKernels scalarKernels = {
+    SNIPixelConverter::Scalar,
+    argb32Scalar,
+    argb32PremultipliedScalar,
+    rgb32Scalar,
+    rgba8888Scalar,
+    grayscale8Scalar,
+    fromWireScalar
+};
+
+#ifdef SNI_QT_AVX2_KERNELS
+//--------------------------------------------------------------------------------------------------
+// AVX2 kernels, 8 pixels at a time
+//--------------------------------------------------------------------------------------------------
+#define SNI_QT_AVX2 __attribute__((target("avx2")))
+
+SNI_QT_AVX2 inline __m256i load8(const uchar* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+SNI_QT_AVX2 inline void store8(uchar* p, __m256i v)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+}
+
+// native ARGB32 to network order, and back
+SNI_QT_AVX2 inline __m256i byteSwap(__m256i v)
+{
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    return _mm256_shuffle_epi8(v, mask);
+}
+
+SNI_QT_AVX2 void argb32Avx2(const uchar* src, uchar* dst, int width)
+{
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+        store8(dst + 4 * x, byteSwap(load8(src + 4 * x)));
+
+    argb32Scalar(src + 4 * x, dst + 4 * x, width - x);
+}
+
+SNI_QT_AVX2 void argb32PremultipliedAvx2(const uchar* src, uchar* dst, int width)
+{
+    const int*    factors = reinterpret_cast<const int*>(inverseAlpha());
+    const __m256i byte    = _mm256_set1_epi32(0xff);
+    const __m256i opaque  = _mm256_set1_epi32(int(0xff000000u));
+    const __m256i half    = _mm256_set1_epi32(0x8000);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256i p = load8(src + 4 * x);
+
+        // opaque pixels, the most common ones, are left as they are
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(p, opaque), opaque)) == -1) {
+            store8(dst + 4 * x, byteSwap(p));
+            continue;
+        }
+        const __m256i a = _mm256_srli_epi32(p, 24);
+        const __m256i f = _mm256_i32gather_epi32(factors, a, 4);
+
+        // products fit in 32 bits: 255 * 0x00ff00ff + 0x8000 < 2^32
+        __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 16), byte);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 8), byte);
+        __m256i b = _mm256_and_si256(p, byte);
+        r = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(r, f), half), 16), byte);
+        g = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(g, f), half), 16), byte);
+        b = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b, f), half), 16), byte);
+
+        const __m256i argb = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(a, 24), _mm256_slli_epi32(r, 16)),
+                                             _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+        store8(dst + 4 * x, byteSwap(argb));
+    }
+    argb32PremultipliedScalar(src + 4 * x, dst + 4 * x, width - x);
+}
+
+SNI_QT_AVX2 void rgb32Avx2(const uchar* src, uchar* dst, int width)
+{
+    const __m256i opaque = _mm256_set1_epi32(int(0xff000000u));
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+        store8(dst + 4 * x, byteSwap(_mm256_or_si256(load8(src + 4 * x), opaque)));
+
+    rgb32Scalar(src + 4 * x, dst + 4 * x, width - x);
+}
+
+SNI_QT_AVX2 void rgba8888Avx2(const uchar* src, uchar* dst, int width)
+{
+    // R, G, B, A to A, R, G, B
+    const __m256i mask = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+        store8(dst + 4 * x, _mm256_shuffle_epi8(load8(src + 4 * x), mask));
+
+    rgba8888Scalar(src + 4 * x, dst + 4 * x, width - x);
+}
+
+SNI_QT_AVX2 void grayscale8Avx2(const uchar* src, uchar* dst, int width)
+{
+    // g * 0x01010100 | 0xff is 0xff, g, g, g in memory
+    const __m256i spread = _mm256_set1_epi32(0x01010100);
+    const __m256i alpha  = _mm256_set1_epi32(0xff);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256i g = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+        store8(dst + 4 * x, _mm256_or_si256(_mm256_mullo_epi32(g, spread), alpha));
+    }
+    grayscale8Scalar(src + x, dst + 4 * x, width - x);
+}
+
+SNI_QT_AVX2 void fromWireAvx2(const uchar* src, quint32* dst, int count)
+{
+    uchar* out = reinterpret_cast<uchar*>(dst);
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+        store8(out + 4 * x, byteSwap(load8(src + 4 * x)));
+
+    fromWireScalar(src + 4 * x, dst + x, count - x);
+}
+
+const SNIPixelKernels avx2Kernels = {
+    SNIPixelConverter::AVX2,
+    argb32Avx2,
+    argb32PremultipliedAvx2,
+    rgb32Avx2,
+    rgba8888Avx2,
+    grayscale8Avx2,
+    fromWireAvx2
+};
+#endif
+
+bool isSupported(SNIPixelConverter::Isa isa)
+{
+    switch (isa) {
+    case SNIPixelConverter::Scalar:
+        return true;
+    case SNIPixelConverter::AVX2:
+#ifdef SNI_QT_AVX2_KERNELS
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const SNIPixelKernels* kernelsOf(SNIPixelConverter::Isa isa)
+{
+#ifdef SNI_QT_AVX2_KERNELS
+    if (isa == SNIPixelConverter::AVX2)
+        return &avx2Kernels;
+#endif
+    Q_UNUSED(isa)
+    return &scalarKernels;
+}
+
+std::atomic<const SNIPixelKernels*>& activeKernels()
+{
+    static std::atomic<const SNIPixelKernels*> kernels {
+        kernelsOf(isSupported(SNIPixelConverter::AVX2) ? SNIPixelConverter::AVX2 : SNIPixelConverter::Scalar)
+    };
+    return kernels;
+}
+} // namespace
+
+QByteArray SNIPixelConverter::toWire(const QImage& source)
+{
+    const SNIPixelKernels* kernels = activeKernels().load(std::memory_order_relaxed);
+
+    QImage    image = source;
+    RowKernel kernel;
+    switch (image.format()) {
+    case QImage::Format_ARGB32:
+        kernel = kernels->argb32;
+        break;
+    case QImage::Format_ARGB32_Premultiplied:
+        kernel = kernels->argb32Premultiplied;
+        break;
+    case QImage::Format_RGB32:
+        kernel = kernels->rgb32;
+        break;
+    case QImage::Format_RGBA8888:
+        kernel = kernels->rgba8888;
+        break;
+    case QImage::Format_Grayscale8:
+        kernel = kernels->grayscale8;
+        break;
+    default:
+        image  = image.convertToFormat(QImage::Format_ARGB32);
+        kernel = kernels->argb32;
+        break;
+    }
+    const int       width   = image.width();
+    const int       height  = image.height();
+    const qsizetype rowSize = qsizetype(width) * 4;
+
+    QByteArray bytes(rowSize * height, Qt::Uninitialized);
+    uchar*     dst = reinterpret_cast<uchar*>(bytes.data());
+    for (int y = 0; y < height; ++y)
+        kernel(image.constScanLine(y), dst + y * rowSize, width);
+
+    return bytes;
+}
+
+void SNIPixelConverter::fromPremultiplied(const quint32* src, uchar* dst, int count)
+{
+    activeKernels().load(std::memory_order_relaxed)->argb32Premultiplied(
+        reinterpret_cast<const uchar*>(src), dst, count);
+}
+
+void SNIPixelConverter::fromWire(const uchar* src, quint32* dst, int count)
+{
+    activeKernels().load(std::memory_order_relaxed)->fromWire(src, dst, count);
+}
+
+SNIPixelConverter::Isa SNIPixelConverter::isa()
+{
+    return activeKernels().load(std::memory_order_relaxed)->isa;
+}
+
+bool SNIPixelConverter::setIsa(Isa isa)
+{
+    if (!isSupported(isa))
+        return false;
+
+    activeKernels().store(kernelsOf(isa), std::memory_order_relaxed);
+    return true;
+}
+
+const char* SNIPixelConverter::isaName(Isa isa)
+{
+    switch (isa) {
+    case Scalar: return "scalar";
+    case AVX2:   return "AVX2";
+    }
+    return "";
+}
@@ -0,0 +1,63 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QtGlobal>
+
+QT_BEGIN_NAMESPACE
+class QImage;
+QT_END_NAMESPACE
+
+/*!
+    Conversions between images and the pixels sent over the bus:
+    ARGB32, not premultiplied, in network byte order.
+
+    The common source formats (ARGB32, ARGB32_Premultiplied, RGB32,
+    RGBA8888 and Grayscale8) are converted row by row in a single pass,
+    without an intermediate image; other formats are converted to ARGB32
+    first. The kernels are picked at run time from the instruction sets
+    of the CPU, and all of them give the same bytes: premultiplied pixels
+    are restored as qUnpremultiply() does.
+*/
+class SNIPixelConverter
+{
+public:
+    enum Isa : quint8 {
+        Scalar,
+        AVX2
+    };
+
+    /*!
+        @return the pixels of @p image in the format of the bus.
+    */
+    static QByteArray toWire(const QImage& image);
+
+    /*!
+        Converts @p count premultiplied ARGB32 pixels to the format of the bus.
+    */
+    static void fromPremultiplied(const quint32* src, uchar* dst, int count);
+
+    /*!
+        Converts @p count pixels in the format of the bus to ARGB32.
+    */
+    static void fromWire(const uchar* src, quint32* dst, int count);
+
+    /*!
+        @return the instruction set of the kernels in use.
+    */
+    static Isa isa();
+
+    /*!
+        Selects the kernels of @p isa, if the CPU supports it,
+        e.g. to compare them. The best ones are used by default.
+        @return whether @p isa is supported.
+    */
+    static bool setIsa(Isa isa);
+
+    static const char* isaName(Isa);
+};
@@ -0,0 +1,128 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritempool_p.hpp"
+
+#include <QMutexLocker>
+#include <QtEndian>
+
+namespace {
+constexpr quint64 prime1 = 0x9E3779B185EBCA87ULL;
+constexpr quint64 prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr quint64 prime3 = 0x165667B19E3779F9ULL;
+constexpr quint64 prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr quint64 prime5 = 0x27D4EB2F165667C5ULL;
+
+inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline quint64 mixRound(quint64 acc, quint64 input)
+{
+    acc += input * prime2;
+    return rotl(acc, 31) * prime1;
+}
+
+inline quint64 mergeRound(quint64 acc, quint64 value)
+{
+    acc ^= mixRound(0, value);
+    return acc * prime1 + prime4;
+}
+} // namespace
+
+Q_GLOBAL_STATIC(SNIPayloadPool, payloadPool)
+
+SNIPayloadPool* SNIPayloadPool::instance()
+{
+    return payloadPool();
+}
+
+quint64 SNIPayloadPool::hash(const void* data, qsizetype size, quint64 seed)
+{
+    const uchar* p   = static_cast<const uchar*>(data);
+    const uchar* end = p + size;
+    quint64      h;
+
+    // four independent lanes over 32-byte stripes, which the CPU runs in parallel
+    if (size >= 32) {
+        quint64 v1 = seed + prime1 + prime2;
+        quint64 v2 = seed + prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - prime1;
+
+        for (const uchar* limit = end - 32; p <= limit; p += 32) {
+            v1 = mixRound(v1, qFromLittleEndian<quint64>(p));
+            v2 = mixRound(v2, qFromLittleEndian<quint64>(p + 8));
+            v3 = mixRound(v3, qFromLittleEndian<quint64>(p + 16));
+            v4 = mixRound(v4, qFromLittleEndian<quint64>(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + prime5;
+    }
+    h += quint64(size);
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= mixRound(0, qFromLittleEndian<quint64>(p));
+        h  = rotl(h, 27) * prime1 + prime4;
+    }
+    if (p + 4 <= end) {
+        h ^= quint64(qFromLittleEndian<quint32>(p)) * prime1;
+        h  = rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * prime5;
+        h  = rotl(h, 11) * prime1;
+    }
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+QByteArray SNIPayloadPool::share(const QByteArray& bytes, quint64 hash, bool insert)
+{
+    QMutexLocker locker(&mutex);
+
+    const auto it = payloads.find(hash);
+    if (it != payloads.end()) {
+        // a collision keeps its own buffer
+        if (it->bytes.size() != bytes.size() || it->bytes != bytes)
+            return bytes;
+
+        order.splice(order.end(), order, it->position);
+        return it->bytes;
+    }
+    if (!insert || bytes.size() > capacity / 16)
+        return bytes;
+
+    order.push_back(hash);
+    payloads.insert(hash, Entry { bytes, std::prev(order.end()) });
+    size += bytes.size();
+
+    while (size > capacity) {
+        size -= payloads.take(order.front()).bytes.size();
+        order.pop_front();
+    }
+    return bytes;
+}
+
+qint64 SNIPayloadPool::memoryUsage()
+{
+    QMutexLocker locker(&mutex);
+
+    // the payloads, plus per entry a hash node, a list node and a buffer header
+    constexpr qint64 entry = 2 * sizeof(quint64) + sizeof(Entry) + 4 * sizeof(void*) + sizeof(QArrayData);
+    return sizeof(SNIPayloadPool) + size + payloads.size() * entry;
+}
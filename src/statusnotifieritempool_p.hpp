@@ -0,0 +1,63 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+#include <list>
+
+/*!
+    Serialized pixmaps shared by all the items of the process, keyed by
+    the hash of their content.
+
+    Applications often build new QIcon objects with the pixels of the
+    previous ones, e.g. from resources, so payloads are deduplicated by
+    content: an item gets back the buffer of an earlier identical payload,
+    its own or another item's, and can tell that an icon didn't change by
+    comparing buffers. The pool keeps the most recently used payloads up to
+    a fixed total size; buffers still used by items outlive their entries.
+
+    The pool may be used by items of several threads.
+*/
+class SNIPayloadPool
+{
+public:
+    static SNIPayloadPool* instance();
+
+    /*!
+        @return the XXH64 hash of @p size bytes at @p data.
+    */
+    static quint64 hash(const void* data, qsizetype size, quint64 seed = 0);
+
+    /*!
+        @return a payload equal to @p bytes, whose hash is @p hash,
+        sharing the buffer of an earlier one if any. Unless @p insert,
+        @p bytes is not kept for later calls.
+    */
+    QByteArray share(const QByteArray& bytes, quint64 hash, bool insert = true);
+
+    /*!
+        @return the heap memory held by the pool, in bytes.
+    */
+    qint64 memoryUsage();
+
+private:
+    static constexpr qint64 capacity = 8 * 1024 * 1024;
+
+    struct Entry
+    {
+        QByteArray                   bytes;
+        std::list<quint64>::iterator position; // in order
+    };
+
+    QMutex                mutex;    // guards the members below
+    QHash<quint64, Entry> payloads;
+    std::list<quint64>    order;    // of use, least recent first
+    qint64                size { 0 };
+};
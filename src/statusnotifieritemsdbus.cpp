@@ -0,0 +1,528 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritemtransport_p.hpp"
+#include "statusnotifieritemdbus_p.hpp"
+#include "statusnotifieritemdbus_p_p.hpp"
+
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <systemd/sd-bus.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstring>
+
+#include <poll.h>
+#include <time.h>
+
+/*
+    The item on sd-bus: a private connection to the session bus, watched by
+    socket notifiers and a timer for the sd-bus timeouts, exporting the item
+    through vtables whose callbacks marshal the values of
+    StatusNotifierItemDBus straight into the messages.
+
+    DBusMenuExporter only works on a QDBusConnection: SNITransport::create()
+    doesn't pick this transport for items with a context menu, and
+    StatusNotifierItemDBus::setContextMenu() moves them back to QtDBus.
+*/
+namespace {
+constexpr char itemPath[]          = "/StatusNotifierItem";
+constexpr char itemInterface[]     = "org.kde.StatusNotifierItem";
+constexpr char extInterface[]      = "io.github.qtilities.StatusNotifierItem";
+constexpr char watcherService[]    = "org.kde.StatusNotifierWatcher";
+constexpr char watcherPath[]       = "/StatusNotifierWatcher";
+
+class SNISdBusTransport : public SNITransport
+{
+public:
+    explicit SNISdBusTransport(StatusNotifierItemDBusPrivate* owner) : SNITransport(owner) {}
+    ~SNISdBusTransport() override;
+
+    bool open();
+
+    const char*      name() const override { return "sd-bus"; }
+    QString          uniqueName() const override;
+    QDBusConnection* menuConnection() override { return nullptr; }
+
+    void emitSignal(Signal, const QString& argument) override;
+    void emitIconRevision(uint revision) override;
+    void emitRevision(const QString& group, uint revision) override;
+    void registerItem() override;
+    void queryHost() override;
+
+    qint64 memoryUsage() const override;
+
+private:
+    using Reply = void (*)(SNISdBusTransport*, sd_bus_message*);
+
+    void process();
+    void arm();
+    void call(const char* interface, const char* member, Reply, const char* types, ...);
+
+    static int  onReply(sd_bus_message*, void* userdata, sd_bus_error*);
+    static int  onWatcherSignal(sd_bus_message*, void* userdata, sd_bus_error*);
+    static int  onNameOwnerChanged(sd_bus_message*, void* userdata, sd_bus_error*);
+
+    // vtable callbacks, userdata is the transport
+    static int  getProperty(sd_bus*, const char*, const char*, const char* property,
+                            sd_bus_message* reply, void* userdata, sd_bus_error*);
+    static int  callMethod(sd_bus_message*, void* userdata, sd_bus_error*);
+    static int  iconPixmapDelta(sd_bus_message*, void* userdata, sd_bus_error*);
+
+    static const sd_bus_vtable itemVTable[];
+    static const sd_bus_vtable extVTable[];
+
+    sd_bus*                          bus { nullptr };
+    sd_bus_slot*                     busSlots[4] {};
+    std::unique_ptr<QSocketNotifier> reader;
+    std::unique_ptr<QSocketNotifier> writer;
+    QTimer                           timer;
+    bool                             registrationPending { false }; // until Hello is answered
+};
+
+// a pending call, freed with its floating slot
+struct SNISdBusCall
+{
+    SNISdBusTransport* transport;
+    void (*reply)(SNISdBusTransport*, sd_bus_message*);
+};
+
+int appendString(sd_bus_message* m, const QString& string)
+{
+    return sd_bus_message_append_basic(m, 's', string.toUtf8().constData());
+}
+
+int appendIconList(sd_bus_message* m, const SNIIconList& list)
+{
+    int r = sd_bus_message_open_container(m, 'a', "(iiay)");
+    for (const SNIIcon& pix : list) {
+        if (r < 0)
+            return r;
+
+        r = sd_bus_message_open_container(m, 'r', "iiay");
+        if (r >= 0)
+            r = sd_bus_message_append(m, "ii", pix.width, pix.height);
+        if (r >= 0)
+            r = sd_bus_message_append_array(m, 'y', pix.bytes.constData(), size_t(pix.bytes.size()));
+        if (r >= 0)
+            r = sd_bus_message_close_container(m);
+    }
+    return r < 0 ? r : sd_bus_message_close_container(m);
+}
+
+qint64 monotonicUsec()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+} // namespace
+
+const sd_bus_vtable SNISdBusTransport::itemVTable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_PROPERTY("Category",            "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("Id",                  "s",            getProperty, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_PROPERTY("Title",               "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("Status",              "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("WindowId",            "i",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("IconThemePath",       "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("Menu",                "o",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("ItemIsMenu",          "b",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("IconName",            "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("IconPixmap",          "a(iiay)",      getProperty, 0, 0),
+    SD_BUS_PROPERTY("OverlayIconName",     "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("OverlayIconPixmap",   "a(iiay)",      getProperty, 0, 0),
+    SD_BUS_PROPERTY("AttentionIconName",   "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("AttentionIconPixmap", "a(iiay)",      getProperty, 0, 0),
+    SD_BUS_PROPERTY("AttentionMovieName",  "s",            getProperty, 0, 0),
+    SD_BUS_PROPERTY("ToolTip",             "(sa(iiay)ss)", getProperty, 0, 0),
+    SD_BUS_METHOD("ContextMenu",       "ii", "", callMethod, 0),
+    SD_BUS_METHOD("Activate",          "ii", "", callMethod, 0),
+    SD_BUS_METHOD("SecondaryActivate", "ii", "", callMethod, 0),
+    SD_BUS_METHOD("Scroll",            "is", "", callMethod, 0),
+    SD_BUS_SIGNAL("NewTitle",         "",  0),
+    SD_BUS_SIGNAL("NewIcon",          "",  0),
+    SD_BUS_SIGNAL("NewAttentionIcon", "",  0),
+    SD_BUS_SIGNAL("NewOverlayIcon",   "",  0),
+    SD_BUS_SIGNAL("NewToolTip",       "",  0),
+    SD_BUS_SIGNAL("NewIconThemePath", "s", 0),
+    SD_BUS_SIGNAL("NewStatus",        "s", 0),
+    SD_BUS_VTABLE_END
+};
+
+const sd_bus_vtable SNISdBusTransport::extVTable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_PROPERTY("IconRevision", "u",     getProperty, 0, 0),
+    SD_BUS_PROPERTY("Revisions",    "a{su}", getProperty, 0, 0),
+    SD_BUS_METHOD("IconPixmapDelta", "u", "ua(iiiiiiay)", iconPixmapDelta, 0),
+    SD_BUS_SIGNAL("NewIconRevision", "u",  0),
+    SD_BUS_SIGNAL("NewRevision",     "su", 0),
+    SD_BUS_VTABLE_END
+};
+
+SNISdBusTransport::~SNISdBusTransport()
+{
+    if (!bus)
+        return;
+
+    reader.reset();
+    writer.reset();
+
+    for (sd_bus_slot* slot : busSlots)
+        sd_bus_slot_unref(slot);
+
+    sd_bus_flush_close_unref(bus);
+}
+
+bool SNISdBusTransport::open()
+{
+    if (sd_bus_open_user(&bus) < 0)
+        return false;
+
+    if (sd_bus_add_object_vtable(bus, &busSlots[0], itemPath, itemInterface, itemVTable, this) < 0
+        || sd_bus_add_object_vtable(bus, &busSlots[1], itemPath, extInterface, extVTable, this) < 0) {
+        return false;
+    }
+
+    // follow the hosts, to tell whether the item is shown
+    const QByteArray hosts = QByteArray("type='signal',sender='") + watcherService
+                           + "',path='" + watcherPath + "',interface='" + watcherService + '\'';
+    if (sd_bus_add_match(bus, &busSlots[2], hosts.constData(), onWatcherSignal, this) < 0)
+        return false;
+
+    // monitor the watcher service in case the host restarts
+    const QByteArray owner = QByteArray("type='signal',sender='org.freedesktop.DBus',"
+                                        "member='NameOwnerChanged',arg0='") + watcherService + '\'';
+    if (sd_bus_add_match(bus, &busSlots[3], owner.constData(), onNameOwnerChanged, this) < 0)
+        return false;
+
+    const int fd = sd_bus_get_fd(bus);
+    if (fd < 0)
+        return false;
+
+    reader = std::make_unique<QSocketNotifier>(fd, QSocketNotifier::Read);
+    writer = std::make_unique<QSocketNotifier>(fd, QSocketNotifier::Write);
+    QObject::connect(reader.get(), &QSocketNotifier::activated, d->q, [this] { process(); });
+    QObject::connect(writer.get(), &QSocketNotifier::activated, d->q, [this] { process(); });
+
+    timer.setSingleShot(true);
+    QObject::connect(&timer, &QTimer::timeout, d->q, [this] { process(); });
+
+    // the connection handshake is pending
+    arm();
+    return true;
+}
+
+QString SNISdBusTransport::uniqueName() const
+{
+    // sd_bus_get_unique_name() blocks until the Hello reply otherwise
+    const char* name = nullptr;
+    if (sd_bus_is_ready(bus) > 0)
+        sd_bus_get_unique_name(bus, &name);
+    return QString::fromLatin1(name);
+}
+
+void SNISdBusTransport::process()
+{
+    // fails with -EBUSY when reentered from a callback, the outer loop goes on
+    while (sd_bus_process(bus, nullptr) > 0) {}
+
+    // not once hidden, the item is registered again by the next transport
+    if (registrationPending && isAttached() && sd_bus_is_ready(bus) > 0) {
+        registrationPending = false;
+        registerItem();
+    }
+    arm();
+}
+
+void SNISdBusTransport::arm()
+{
+    writer->setEnabled(sd_bus_get_events(bus) & POLLOUT);
+
+    uint64_t usec = 0;
+    if (sd_bus_get_timeout(bus, &usec) < 0 || usec == UINT64_MAX) {
+        timer.stop();
+        return;
+    }
+    // an absolute CLOCK_MONOTONIC time, 0 when messages are waiting
+    const qint64 remaining = qint64(usec) - monotonicUsec();
+    timer.start(remaining <= 0 ? 0 : int(qMin<qint64>((remaining + 999) / 1000, INT_MAX)));
+}
+
+void SNISdBusTransport::call(const char* interface, const char* member, Reply reply, const char* types, ...)
+{
+    sd_bus_message* m = nullptr;
+    if (sd_bus_message_new_method_call(bus, &m, watcherService, watcherPath, interface, member) < 0)
+        return;
+
+    va_list args;
+    va_start(args, types);
+    const int r = sd_bus_message_appendv(m, types, args);
+    va_end(args);
+
+    sd_bus_slot* slot = nullptr;
+    auto* pending = new SNISdBusCall { this, reply };
+    if (r < 0 || sd_bus_call_async(bus, &slot, m, onReply, pending, 0) < 0) {
+        delete pending;
+        sd_bus_message_unref(m);
+        reply(this, nullptr);
+        return;
+    }
+    sd_bus_message_unref(m);
+
+    // dropped with the bus if no reply came, which frees the call
+    sd_bus_slot_set_destroy_callback(slot, [](void* userdata) {
+        delete static_cast<SNISdBusCall*>(userdata);
+    });
+    sd_bus_slot_set_floating(slot, 1);
+    sd_bus_slot_unref(slot);
+    arm();
+}
+
+int SNISdBusTransport::onReply(sd_bus_message* m, void* userdata, sd_bus_error*)
+{
+    // a hidden item no longer waits for the replies
+    const SNISdBusCall* pending = static_cast<SNISdBusCall*>(userdata);
+    if (pending->transport->isAttached())
+        pending->reply(pending->transport, sd_bus_message_is_method_error(m, nullptr) ? nullptr : m);
+    return 0;
+}
+
+int SNISdBusTransport::onWatcherSignal(sd_bus_message* m, void* userdata, sd_bus_error*)
+{
+    // a host leaving doesn't tell whether others remain
+    SNISdBusTransport* transport = static_cast<SNISdBusTransport*>(userdata);
+    if (!transport->isAttached())
+        return 0;
+
+    if (sd_bus_message_is_signal(m, watcherService, "StatusNotifierHostRegistered")
+        || sd_bus_message_is_signal(m, watcherService, "StatusNotifierHostUnregistered")) {
+        transport->queryHost();
+    }
+    return 0;
+}
+
+int SNISdBusTransport::onNameOwnerChanged(sd_bus_message* m, void* userdata, sd_bus_error*)
+{
+    SNISdBusTransport* transport = static_cast<SNISdBusTransport*>(userdata);
+    const char *name = nullptr, *oldOwner = nullptr, *newOwner = nullptr;
+    if (!transport->isAttached() || sd_bus_message_read(m, "sss", &name, &oldOwner, &newOwner) < 0)
+        return 0;
+
+    transport->d->onServiceOwnerChanged(
+        QString::fromUtf8(name), QString::fromUtf8(oldOwner), QString::fromUtf8(newOwner));
+    return 0;
+}
+
+void SNISdBusTransport::emitSignal(Signal signal, const QString& argument)
+{
+    static const char* const names[] = {
+        "NewStatus", "NewTitle", "NewIcon", "NewOverlayIcon",
+        "NewAttentionIcon", "NewToolTip", "NewIconThemePath"
+    };
+    if (signal == NewStatus || signal == NewIconThemePath)
+        sd_bus_emit_signal(bus, itemPath, itemInterface, names[signal], "s", argument.toUtf8().constData());
+    else
+        sd_bus_emit_signal(bus, itemPath, itemInterface, names[signal], "");
+
+    arm();
+}
+
+void SNISdBusTransport::emitIconRevision(uint revision)
+{
+    sd_bus_emit_signal(bus, itemPath, extInterface, "NewIconRevision", "u", uint32_t(revision));
+    arm();
+}
+
+void SNISdBusTransport::emitRevision(const QString& group, uint revision)
+{
+    sd_bus_emit_signal(bus, itemPath, extInterface, "NewRevision", "su",
+                       group.toLatin1().constData(), uint32_t(revision));
+    arm();
+}
+
+void SNISdBusTransport::registerItem()
+{
+    // registered from process() once the connection handshake is done
+    if (sd_bus_is_ready(bus) <= 0) {
+        registrationPending = true;
+        return;
+    }
+    const QByteArray service = uniqueName().toLatin1();
+    call(watcherService, "RegisterStatusNotifierItem",
+         [](SNISdBusTransport* transport, sd_bus_message* reply) {
+             transport->d->setRegistration(reply ? StatusNotifierItemDBusPrivate::Registered
+                                                 : StatusNotifierItemDBusPrivate::RegistrationFailed);
+             transport->d->queryHost();
+         },
+         "s", service.constData());
+}
+
+void SNISdBusTransport::queryHost()
+{
+    call("org.freedesktop.DBus.Properties", "Get",
+         [](SNISdBusTransport* transport, sd_bus_message* reply) {
+             int available = 0;
+             if (reply && sd_bus_message_read(reply, "v", "b", &available) < 0)
+                 available = 0;
+
+             transport->d->setHostAvailable(available);
+         },
+         "ss", watcherService, "IsStatusNotifierHostRegistered");
+}
+
+int SNISdBusTransport::getProperty(sd_bus*, const char*, const char*, const char* property,
+                                   sd_bus_message* reply, void* userdata, sd_bus_error*)
+{
+    const StatusNotifierItemDBus* item = static_cast<SNISdBusTransport*>(userdata)->d->q;
+    const QByteArray name(property);
+
+    if (name == "Category")
+        return appendString(reply, item->category());
+    if (name == "Id")
+        return appendString(reply, item->id());
+    if (name == "Title")
+        return appendString(reply, item->title());
+    if (name == "Status")
+        return appendString(reply, item->status());
+    if (name == "WindowId")
+        return sd_bus_message_append(reply, "i", int32_t(item->windowId()));
+    if (name == "IconThemePath")
+        return appendString(reply, item->iconThemePath());
+    if (name == "Menu")
+        return sd_bus_message_append(reply, "o", item->menuPath().path().toUtf8().constData());
+    if (name == "ItemIsMenu")
+        return sd_bus_message_append(reply, "b", int(item->itemIsMenu()));
+    if (name == "IconName")
+        return appendString(reply, item->iconName());
+    if (name == "IconPixmap")
+        return appendIconList(reply, item->iconPixmap());
+    if (name == "OverlayIconName")
+        return appendString(reply, item->overlayIconName());
+    if (name == "OverlayIconPixmap")
+        return appendIconList(reply, item->overlayIconPixmap());
+    if (name == "AttentionIconName")
+        return appendString(reply, item->attentionIconName());
+    if (name == "AttentionIconPixmap")
+        return appendIconList(reply, item->attentionIconPixmap());
+    if (name == "AttentionMovieName")
+        return appendString(reply, QString());
+    if (name == "IconRevision")
+        return sd_bus_message_append(reply, "u", uint32_t(item->iconRevision()));
+
+    if (name == "Revisions") {
+        const SNIRevisionMap revisions = item->revisions();
+
+        int r = sd_bus_message_open_container(reply, 'a', "{su}");
+        for (auto it = revisions.cbegin(); r >= 0 && it != revisions.cend(); ++it)
+            r = sd_bus_message_append(reply, "{su}", it.key().toLatin1().constData(), uint32_t(it.value()));
+        return r < 0 ? r : sd_bus_message_close_container(reply);
+    }
+
+    if (name == "ToolTip") {
+        const SNIToolTip toolTip = item->toolTip();
+
+        int r = sd_bus_message_open_container(reply, 'r', "sa(iiay)ss");
+        if (r >= 0)
+            r = appendString(reply, toolTip.iconName);
+        if (r >= 0)
+            r = appendIconList(reply, toolTip.iconPixmap);
+        if (r >= 0)
+            r = appendString(reply, toolTip.title);
+        if (r >= 0)
+            r = appendString(reply, toolTip.description);
+        return r < 0 ? r : sd_bus_message_close_container(reply);
+    }
+    return -ENOENT;
+}
+
+int SNISdBusTransport::callMethod(sd_bus_message* m, void* userdata, sd_bus_error*)
+{
+    StatusNotifierItemDBus* item = static_cast<SNISdBusTransport*>(userdata)->d->q;
+    const char* member = sd_bus_message_get_member(m);
+
+    int r;
+    if (std::strcmp(member, "Scroll") == 0) {
+        int32_t     delta = 0;
+        const char* orientation = nullptr;
+        r = sd_bus_message_read(m, "is", &delta, &orientation);
+        if (r < 0)
+            return r;
+
+        item->Scroll(delta, QString::fromUtf8(orientation));
+    } else {
+        int32_t x = 0, y = 0;
+        r = sd_bus_message_read(m, "ii", &x, &y);
+        if (r < 0)
+            return r;
+
+        if (std::strcmp(member, "Activate") == 0)
+            item->Activate(x, y);
+        else if (std::strcmp(member, "SecondaryActivate") == 0)
+            item->SecondaryActivate(x, y);
+        else
+            item->ContextMenu(x, y);
+    }
+    return sd_bus_reply_method_return(m, "");
+}
+
+int SNISdBusTransport::iconPixmapDelta(sd_bus_message* m, void* userdata, sd_bus_error*)
+{
+    StatusNotifierItemDBus* item = static_cast<SNISdBusTransport*>(userdata)->d->q;
+
+    uint32_t revision = 0;
+    int r = sd_bus_message_read(m, "u", &revision);
+    if (r < 0)
+        return r;
+
+    SNIIconDeltaList deltaList;
+    const uint current = item->IconPixmapDelta(revision, deltaList);
+
+    sd_bus_message* reply = nullptr;
+    r = sd_bus_message_new_method_return(m, &reply);
+    if (r >= 0)
+        r = sd_bus_message_append(reply, "u", uint32_t(current));
+    if (r >= 0)
+        r = sd_bus_message_open_container(reply, 'a', "(iiiiiiay)");
+
+    for (const SNIIconDelta& delta : std::as_const(deltaList)) {
+        if (r < 0)
+            break;
+
+        r = sd_bus_message_open_container(reply, 'r', "iiiiiiay");
+        if (r >= 0)
+            r = sd_bus_message_append(reply, "iiiiii", delta.width, delta.height,
+                                      delta.x, delta.y, delta.rectWidth, delta.rectHeight);
+        if (r >= 0)
+            r = sd_bus_message_append_array(reply, 'y', delta.bytes.constData(), size_t(delta.bytes.size()));
+        if (r >= 0)
+            r = sd_bus_message_close_container(reply);
+    }
+    if (r >= 0)
+        r = sd_bus_message_close_container(reply);
+    if (r >= 0)
+        r = sd_bus_send(nullptr, reply, nullptr);
+
+    sd_bus_message_unref(reply);
+    return r < 0 ? r : 1;
+}
+
+qint64 SNISdBusTransport::memoryUsage() const
+{
+    return sizeof(SNISdBusTransport) + 2 * sizeof(QSocketNotifier);
+}
+
+std::unique_ptr<SNITransport> createSdBusTransport(StatusNotifierItemDBusPrivate* owner)
+{
+    auto transport = std::make_unique<SNISdBusTransport>(owner);
+    if (!transport->open())
+        return nullptr;
+
+    return transport;
+}
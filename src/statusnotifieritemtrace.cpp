@@ -0,0 +1,335 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritemtrace_p.hpp"
+
+#include <QBuffer>
+#include <QImage>
+#include <QPixmap>
+#include <QtEndian>
+
+#include <cstring>
+
+const char* SNITrace::signature(Event event)
+{
+    switch (event) {
+    case DefineIcon:                return "";
+    case SetCategory:               return "i";
+    case SetStatus:                 return "i";
+    case SetTitle:                  return "s";
+    case SetIconByName:             return "s";
+    case SetIconByPixmap:           return "p";
+    case SetIconThemePath:          return "s";
+    case SetProgress:               return "d";
+    case SetProgressSteps:          return "i";
+    case SetProgressUpdateInterval: return "i";
+    case SetOverlayIconByName:      return "s";
+    case SetOverlayIconByPixmap:    return "p";
+    case SetBadgeText:              return "s";
+    case SetAttentionIconByName:    return "s";
+    case SetAttentionIconByPixmap:  return "p";
+    case SetToolTip:                return "sss";
+    case SetToolTipWithIcon:        return "pss";
+    case SetToolTipIconByName:      return "s";
+    case SetToolTipIconByPixmap:    return "p";
+    case SetToolTipTitle:           return "s";
+    case SetToolTipSubTitle:        return "s";
+    case Activate:                  return "ii";
+    case SecondaryActivate:         return "ii";
+    case ContextMenu:               return "ii";
+    case Scroll:                    return "ii";
+    case PropertyRead:              return "i";
+    case SetToolTipTemplate:        return "s";
+    case SetToolTipField:           return "ss";
+    case SetToolTipNumber:          return "sdi";
+    case SetVisible:                return "i";
+    case EventCount:                break;
+    }
+    return nullptr;
+}
+
+const char* SNITrace::eventName(Event event)
+{
+    switch (event) {
+    case DefineIcon:                return "DefineIcon";
+    case SetCategory:               return "SetCategory";
+    case SetStatus:                 return "SetStatus";
+    case SetTitle:                  return "SetTitle";
+    case SetIconByName:             return "SetIconByName";
+    case SetIconByPixmap:           return "SetIconByPixmap";
+    case SetIconThemePath:          return "SetIconThemePath";
+    case SetProgress:               return "SetProgress";
+    case SetProgressSteps:          return "SetProgressSteps";
+    case SetProgressUpdateInterval: return "SetProgressUpdateInterval";
+    case SetOverlayIconByName:      return "SetOverlayIconByName";
+    case SetOverlayIconByPixmap:    return "SetOverlayIconByPixmap";
+    case SetBadgeText:              return "SetBadgeText";
+    case SetAttentionIconByName:    return "SetAttentionIconByName";
+    case SetAttentionIconByPixmap:  return "SetAttentionIconByPixmap";
+    case SetToolTip:                return "SetToolTip";
+    case SetToolTipWithIcon:        return "SetToolTipWithIcon";
+    case SetToolTipIconByName:      return "SetToolTipIconByName";
+    case SetToolTipIconByPixmap:    return "SetToolTipIconByPixmap";
+    case SetToolTipTitle:           return "SetToolTipTitle";
+    case SetToolTipSubTitle:        return "SetToolTipSubTitle";
+    case Activate:                  return "Activate";
+    case SecondaryActivate:         return "SecondaryActivate";
+    case ContextMenu:               return "ContextMenu";
+    case Scroll:                    return "Scroll";
+    case PropertyRead:              return "PropertyRead";
+    case SetToolTipTemplate:        return "SetToolTipTemplate";
+    case SetToolTipField:           return "SetToolTipField";
+    case SetToolTipNumber:          return "SetToolTipNumber";
+    case SetVisible:                return "SetVisible";
+    case EventCount:                break;
+    }
+    return "";
+}
+//==============================================================================
+// SNITraceWriter
+//==============================================================================
+SNITraceWriter::~SNITraceWriter()
+{
+    close();
+}
+
+bool SNITraceWriter::open(const QString& fileName, const QString& id)
+{
+    close();
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    buffer.append(SNITrace::magic, int(std::strlen(SNITrace::magic)));
+    buffer.append(char(SNITrace::version));
+    put(id);
+
+    clock.start();
+    last = 0;
+    icons.clear();
+    return true;
+}
+
+void SNITraceWriter::close()
+{
+    if (!file.isOpen())
+        return;
+
+    flush();
+    file.close();
+}
+
+void SNITraceWriter::define(const QIcon& icon)
+{
+    if (icon.isNull() || icons.contains(icon.cacheKey()))
+        return;
+
+    const quint32 id = quint32(icons.size() + 1);
+    icons.insert(icon.cacheKey(), id);
+
+    QList<QSize> sizes = icon.availableSizes();
+    if (sizes.isEmpty())
+        sizes.append(QSize(64, 64));
+
+    begin(SNITrace::DefineIcon);
+    putVarint(id);
+    putVarint(quint64(sizes.size()));
+    for (const QSize& size : std::as_const(sizes)) {
+        QByteArray png;
+        QBuffer    device(&png);
+        device.open(QIODevice::WriteOnly);
+        icon.pixmap(size).save(&device, "PNG");
+        putBytes(png);
+    }
+}
+
+void SNITraceWriter::begin(SNITrace::Event event)
+{
+    const qint64 now = clock.nsecsElapsed() / 1000;
+    putVarint(quint64(now - last));
+    buffer.append(char(event));
+    last = now;
+}
+
+void SNITraceWriter::put(int value)
+{
+    // zigzag encoding, so small negative values stay short
+    putVarint((quint64(qint64(value)) << 1) ^ quint64(qint64(value) >> 63));
+}
+
+void SNITraceWriter::put(double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    char bytes[sizeof(bits)];
+    qToLittleEndian(bits, bytes);
+    buffer.append(bytes, sizeof(bytes));
+}
+
+void SNITraceWriter::put(const QString& value)
+{
+    putBytes(value.toUtf8());
+}
+
+void SNITraceWriter::put(const QIcon& icon)
+{
+    putVarint(icon.isNull() ? 0 : icons.value(icon.cacheKey()));
+}
+
+void SNITraceWriter::putVarint(quint64 value)
+{
+    while (value >= 0x80) {
+        buffer.append(char(value | 0x80));
+        value >>= 7;
+    }
+    buffer.append(char(value));
+}
+
+void SNITraceWriter::putBytes(const QByteArray& bytes)
+{
+    putVarint(quint64(bytes.size()));
+    buffer.append(bytes);
+}
+
+void SNITraceWriter::flush()
+{
+    file.write(buffer);
+    file.flush();
+    buffer.clear();
+}
+//==============================================================================
+// SNITraceReader
+//==============================================================================
+bool SNITraceReader::open(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+
+    data = file.readAll();
+    pos  = int(std::strlen(SNITrace::magic));
+    time = 0;
+    icons.clear();
+
+    if (!data.startsWith(SNITrace::magic) || data.size() <= pos)
+        return fail(QStringLiteral("not a trace file"));
+
+    if (quint8(data.at(pos++)) != SNITrace::version)
+        return fail(QStringLiteral("unsupported trace version"));
+
+    QByteArray id;
+    if (!readBytes(id))
+        return false;
+
+    traceId = QString::fromUtf8(id);
+    return true;
+}
+
+bool SNITraceReader::next(Record& record)
+{
+    while (pos < data.size()) {
+        quint64 delta;
+        if (!readVarint(delta) || pos >= data.size())
+            return fail(QStringLiteral("truncated record"));
+
+        time += qint64(delta);
+
+        const auto event = SNITrace::Event(quint8(data.at(pos++)));
+        if (event >= SNITrace::EventCount)
+            return fail(QStringLiteral("unknown event %1").arg(int(event)));
+
+        if (event == SNITrace::DefineIcon) {
+            quint64 id, count;
+            if (!readVarint(id) || !readVarint(count))
+                return false;
+
+            QIcon icon;
+            for (quint64 i = 0; i < count; ++i) {
+                QByteArray png;
+                if (!readBytes(png))
+                    return false;
+
+                icon.addPixmap(QPixmap::fromImage(QImage::fromData(png, "PNG")));
+            }
+            icons.insert(quint32(id), icon);
+            continue;
+        }
+
+        record.time  = time;
+        record.event = event;
+        record.arguments.clear();
+
+        for (const char* type = SNITrace::signature(event); *type; ++type) {
+            if (*type == 'd') {
+                if (pos + 8 > data.size())
+                    return fail(QStringLiteral("truncated record"));
+
+                const quint64 bits = qFromLittleEndian<quint64>(data.constData() + pos);
+                pos += 8;
+
+                double value;
+                std::memcpy(&value, &bits, sizeof(value));
+                record.arguments.append(value);
+                continue;
+            }
+            if (*type == 's') {
+                QByteArray bytes;
+                if (!readBytes(bytes))
+                    return false;
+
+                record.arguments.append(QString::fromUtf8(bytes));
+                continue;
+            }
+            quint64 value;
+            if (!readVarint(value))
+                return false;
+
+            if (*type == 'p')
+                record.arguments.append(QVariant::fromValue(icons.value(quint32(value))));
+            else
+                record.arguments.append(int(qint64(value >> 1) ^ -qint64(value & 1)));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool SNITraceReader::readVarint(quint64& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size())
+            return fail(QStringLiteral("truncated varint"));
+
+        const quint8 byte = quint8(data.at(pos++));
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return fail(QStringLiteral("invalid varint"));
+}
+
+bool SNITraceReader::readBytes(QByteArray& bytes)
+{
+    quint64 size;
+    if (!readVarint(size))
+        return false;
+
+    if (size > quint64(data.size() - pos))
+        return fail(QStringLiteral("truncated string"));
+
+    bytes = data.mid(pos, int(size));
+    pos  += int(size);
+    return true;
+}
+
+bool SNITraceReader::fail(const QString& message)
+{
+    error = message;
+    return false;
+}
@@ -0,0 +1,149 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QIcon>
+#include <QString>
+#include <QVariantList>
+
+/*!
+    Binary trace of the calls made to an item, by the application through
+    its setters and by hosts through D-Bus.
+
+    A trace starts with the magic "SNITRACE", a version byte and the item id.
+    Each record holds the time elapsed since the previous one in microseconds,
+    the event and its arguments. Integers are LEB128 varints, signed ones
+    zigzag encoded; doubles are 8 bytes in little-endian order; strings are
+    UTF-8, prefixed by their length. Icons set by pixmap are stored once,
+    as PNG images in a DefineIcon record, and referenced by id afterwards.
+
+    The argument types of each event are given by signature(): 'i' for an
+    integer, 'd' for a double, 's' for a string and 'p' for an icon.
+*/
+namespace SNITrace
+{
+enum Event : quint8 {
+    DefineIcon,
+    SetCategory,
+    SetStatus,
+    SetTitle,
+    SetIconByName,
+    SetIconByPixmap,
+    SetIconThemePath,
+    SetProgress,
+    SetProgressSteps,
+    SetProgressUpdateInterval,
+    SetOverlayIconByName,
+    SetOverlayIconByPixmap,
+    SetBadgeText,
+    SetAttentionIconByName,
+    SetAttentionIconByPixmap,
+    SetToolTip,
+    SetToolTipWithIcon,
+    SetToolTipIconByName,
+    SetToolTipIconByPixmap,
+    SetToolTipTitle,
+    SetToolTipSubTitle,
+    Activate,
+    SecondaryActivate,
+    ContextMenu,
+    Scroll,
+    PropertyRead,   // the kind of the update read, see SNILatencyTracker::Update
+    SetToolTipTemplate,
+    SetToolTipField,
+    SetToolTipNumber,
+    SetVisible,
+    EventCount
+};
+
+constexpr char   magic[] = "SNITRACE";
+constexpr quint8 version = 1;
+
+const char* signature(Event);
+const char* eventName(Event);
+} // namespace SNITrace
+
+class SNITraceWriter
+{
+public:
+    ~SNITraceWriter();
+
+    bool open(const QString& fileName, const QString& id);
+    void close();
+
+    template<typename... Args>
+    void write(SNITrace::Event event, const Args&... args)
+    {
+        // icons are defined before the record using them
+        (define(args), ...);
+        begin(event);
+        (put(args), ...);
+
+        if (buffer.size() >= flushThreshold)
+            flush();
+    }
+
+private:
+    static constexpr int flushThreshold = 64 * 1024;
+
+    template<typename T>
+    void define(const T&) {}
+    void define(const QIcon&);
+
+    void begin(SNITrace::Event);
+    void put(int);
+    void put(double);
+    void put(const QString&);
+    void put(const QIcon&);
+    void putVarint(quint64);
+    void putBytes(const QByteArray&);
+    void flush();
+
+    QFile                  file;
+    QByteArray             buffer;
+    QElapsedTimer          clock;
+    qint64                 last { 0 };
+    QHash<qint64, quint32> icons; // ids by cache key
+};
+
+class SNITraceReader
+{
+public:
+    struct Record {
+        qint64          time { 0 }; // microseconds since the start of the trace
+        SNITrace::Event event { SNITrace::EventCount };
+        QVariantList    arguments;  // int, double, QString or QIcon
+    };
+
+    bool    open(const QString& fileName);
+    QString id() const { return traceId; }
+    QString errorString() const { return error; }
+
+    /*!
+        Reads the next record, DefineIcon records are handled internally.
+
+        @return false at the end of the trace or on error,
+        in which case errorString() is set.
+    */
+    bool next(Record&);
+
+private:
+    bool    readVarint(quint64&);
+    bool    readBytes(QByteArray&);
+    bool    fail(const QString&);
+
+    QByteArray             data;
+    int                    pos { 0 };
+    qint64                 time { 0 };
+    QString                traceId;
+    QString                error;
+    QHash<quint32, QIcon>  icons;
+};
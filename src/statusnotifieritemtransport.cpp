@@ -0,0 +1,273 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritemtransport_p.hpp"
+#include "statusnotifieritemdbus_p.hpp"
+#include "statusnotifieritemdbus_p_p.hpp"
+#include "statusnotifieritemdispatcher_p.hpp"
+#include "statusnotifieritemadaptor.h"
+#include "statusnotifieritemextadaptor.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QDBusVariant>
+
+namespace {
+const QString itemPath      = QStringLiteral("/StatusNotifierItem");
+const QString itemInterface = QStringLiteral("org.kde.StatusNotifierItem");
+const QString extInterface  = QStringLiteral("io.github.qtilities.StatusNotifierItem");
+
+// the item is served by SNIDispatcher, or by the generated adaptors on request
+class SNIQtDBusTransport : public SNITransport
+{
+public:
+    SNIQtDBusTransport(StatusNotifierItemDBusPrivate*, bool useAdaptors);
+    ~SNIQtDBusTransport() override;
+
+    const char*      name() const override { return adaptor ? "QtDBus adaptors" : "QtDBus"; }
+    QString          uniqueName() const override { return sessionBus->baseService(); }
+    QDBusConnection* menuConnection() override { return sessionBus.get(); }
+
+    void emitSignal(Signal, const QString& argument) override;
+    void emitIconRevision(uint revision) override;
+    void emitRevision(const QString& group, uint revision) override;
+    void registerItem() override;
+    void queryHost() override;
+
+    qint64 memoryUsage() const override;
+
+private:
+    // items may be created from several threads
+    static QAtomicInt serviceCounter;
+
+    void send(const QString& interface, const char* signal, const QVariantList& arguments);
+
+    // the context of the pending calls and of the watcher, gone with the transport
+    QObject                          scope;
+    StatusNotifierItemAdaptor*       adaptor { nullptr };
+    StatusNotifierItemExtAdaptor*    extensionAdaptor { nullptr };
+    std::unique_ptr<SNIDispatcher>   dispatcher;
+    QString                          service; // the name of the connection
+    std::unique_ptr<QDBusConnection> sessionBus;
+};
+
+QAtomicInt SNIQtDBusTransport::serviceCounter;
+
+SNIQtDBusTransport::SNIQtDBusTransport(StatusNotifierItemDBusPrivate* owner, bool useAdaptors)
+    : SNITransport(owner)
+    , service(QString::fromLatin1("org.freedesktop.StatusNotifierItem-%1-%2")
+                  .arg(QCoreApplication::applicationPid()).arg(serviceCounter.fetchAndAddRelaxed(1) + 1))
+{
+    // Separate DBus connection to the session bus is created, because QDbus does not provide
+    // a way to register different objects for different services with the same paths.
+    // For status notifiers we need different /StatusNotifierItem for each service.
+    sessionBus = std::make_unique<QDBusConnection>(
+        QDBusConnection::connectToBus(QDBusConnection::SessionBus, service)
+    );
+
+    // register service
+    if (useAdaptors) {
+        adaptor          = new StatusNotifierItemAdaptor(owner->q);
+        extensionAdaptor = new StatusNotifierItemExtAdaptor(owner->q);
+        sessionBus->registerObject(itemPath, d->q);
+    } else {
+        dispatcher = std::make_unique<SNIDispatcher>(owner->q);
+        sessionBus->registerVirtualObject(itemPath, dispatcher.get());
+    }
+
+    // follow the hosts, to tell whether the item is shown
+    for (const char *signal : { "StatusNotifierHostRegistered", "StatusNotifierHostUnregistered" }) {
+        sessionBus->connect(
+            QLatin1String("org.kde.StatusNotifierWatcher"),
+            QLatin1String("/StatusNotifierWatcher"),
+            QLatin1String("org.kde.StatusNotifierWatcher"),
+            QLatin1String(signal),
+            d->q, SLOT(onHostsChanged())
+        );
+    }
+
+    // monitor the watcher service in case the host restarts
+    QDBusServiceWatcher *watcher = new QDBusServiceWatcher(
+        QLatin1String("org.kde.StatusNotifierWatcher"),
+        *sessionBus.get(),
+        QDBusServiceWatcher::WatchForOwnerChange,
+        &scope
+    );
+    QObject::connect(
+        watcher, &QDBusServiceWatcher::serviceOwnerChanged,
+        &scope, [this](const QString &name, const QString &oldOwner, const QString &newOwner) {
+            if (isAttached())
+                d->onServiceOwnerChanged(name, oldOwner, newOwner);
+        }
+    );
+}
+
+SNIQtDBusTransport::~SNIQtDBusTransport()
+{
+    sessionBus->unregisterObject(itemPath);
+    QDBusConnection::disconnectFromBus(service);
+
+    // the adaptors are children of the item, which outlives hidden transports
+    delete adaptor;
+    delete extensionAdaptor;
+}
+
+void SNIQtDBusTransport::send(const QString& interface, const char* signal, const QVariantList& arguments)
+{
+    QDBusMessage message = QDBusMessage::createSignal(itemPath, interface, QLatin1String(signal));
+    message.setArguments(arguments);
+    sessionBus->send(message);
+}
+
+void SNIQtDBusTransport::emitSignal(Signal signal, const QString& argument)
+{
+    if (dispatcher) {
+        static const char* const names[] = {
+            "NewStatus", "NewTitle", "NewIcon", "NewOverlayIcon",
+            "NewAttentionIcon", "NewToolTip", "NewIconThemePath"
+        };
+        if (signal == NewStatus || signal == NewIconThemePath)
+            send(itemInterface, names[signal], { argument });
+        else
+            send(itemInterface, names[signal], {});
+        return;
+    }
+    switch (signal) {
+    case NewStatus:
+        Q_EMIT adaptor->NewStatus(argument);
+        break;
+    case NewTitle:
+        Q_EMIT adaptor->NewTitle();
+        break;
+    case NewIcon:
+        Q_EMIT adaptor->NewIcon();
+        break;
+    case NewOverlayIcon:
+        Q_EMIT adaptor->NewOverlayIcon();
+        break;
+    case NewAttentionIcon:
+        Q_EMIT adaptor->NewAttentionIcon();
+        break;
+    case NewToolTip:
+        Q_EMIT adaptor->NewToolTip();
+        break;
+    case NewIconThemePath:
+        Q_EMIT adaptor->NewIconThemePath(argument);
+        break;
+    }
+}
+
+void SNIQtDBusTransport::emitIconRevision(uint revision)
+{
+    if (dispatcher)
+        send(extInterface, "NewIconRevision", { revision });
+    else
+        Q_EMIT extensionAdaptor->NewIconRevision(revision);
+}
+
+void SNIQtDBusTransport::emitRevision(const QString& group, uint revision)
+{
+    if (dispatcher)
+        send(extInterface, "NewRevision", { group, revision });
+    else
+        Q_EMIT extensionAdaptor->NewRevision(group, revision);
+}
+
+void SNIQtDBusTransport::registerItem()
+{
+    // a plain message, QDBusInterface would introspect the watcher synchronously
+    QDBusMessage message = QDBusMessage::createMethodCall(
+        QLatin1String("org.kde.StatusNotifierWatcher"),
+        QLatin1String("/StatusNotifierWatcher"),
+        QLatin1String("org.kde.StatusNotifierWatcher"),
+        QLatin1String("RegisterStatusNotifierItem")
+    );
+    message << sessionBus->baseService();
+
+    QDBusPendingCallWatcher *watcher =
+        new QDBusPendingCallWatcher(sessionBus->asyncCall(message), &scope);
+    QObject::connect(
+        watcher, &QDBusPendingCallWatcher::finished,
+        &scope, [this](QDBusPendingCallWatcher *call) {
+            call->deleteLater();
+            if (!isAttached())
+                return;
+
+            d->setRegistration(call->isError() ? StatusNotifierItemDBusPrivate::RegistrationFailed
+                                               : StatusNotifierItemDBusPrivate::Registered);
+            d->queryHost();
+        }
+    );
+}
+
+void SNIQtDBusTransport::queryHost()
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(
+        QLatin1String("org.kde.StatusNotifierWatcher"),
+        QLatin1String("/StatusNotifierWatcher"),
+        QLatin1String("org.freedesktop.DBus.Properties"),
+        QLatin1String("Get")
+    );
+    message << QLatin1String("org.kde.StatusNotifierWatcher")
+            << QLatin1String("IsStatusNotifierHostRegistered");
+
+    QDBusPendingCallWatcher *watcher =
+        new QDBusPendingCallWatcher(sessionBus->asyncCall(message), &scope);
+    QObject::connect(
+        watcher, &QDBusPendingCallWatcher::finished,
+        &scope, [this](QDBusPendingCallWatcher *call) {
+            call->deleteLater();
+            if (!isAttached())
+                return;
+
+            const QDBusPendingReply<QDBusVariant> reply = *call;
+            d->setHostAvailable(!reply.isError() && reply.value().variant().toBool());
+        }
+    );
+}
+
+qint64 SNIQtDBusTransport::memoryUsage() const
+{
+    const qint64 exporter = dispatcher ? sizeof(SNIDispatcher)
+                                       : sizeof(StatusNotifierItemAdaptor) + sizeof(StatusNotifierItemExtAdaptor);
+
+    return sizeof(SNIQtDBusTransport) + exporter + sizeof(QDBusConnection)
+         + (service.capacity() + 1) * qint64(sizeof(QChar));
+}
+} // namespace
+
+std::unique_ptr<SNITransport> SNITransport::create(StatusNotifierItemDBusPrivate* owner)
+{
+    // read once for all the items
+    static const QString requested = qEnvironmentVariable("SNI_QT_TRANSPORT");
+
+#ifdef SNI_QT_WITH_SDBUS
+    if (requested == QLatin1String("sd-bus")) {
+        // DBusMenuExporter needs a QDBusConnection, items with a menu stay on QtDBus
+        static QAtomicInt menuWarned;
+        if (owner->menu) {
+            if (menuWarned.testAndSetRelaxed(0, 1))
+                qWarning("StatusNotifierItem: sd-bus can't export context menus, using QtDBus for items with one");
+        } else if (std::unique_ptr<SNITransport> transport = createSdBusTransport(owner)) {
+            return transport;
+        } else {
+            qWarning("StatusNotifierItem: cannot connect to the session bus with sd-bus, using QtDBus");
+        }
+    }
+#endif
+    const bool useAdaptors = requested == QLatin1String("adaptor");
+    return std::make_unique<SNIQtDBusTransport>(owner, useAdaptors);
+}
+
+bool SNITransport::isAttached() const
+{
+    return d->transport.get() == this;
+}
@@ -0,0 +1,80 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#pragma once
+
+#include <QString>
+
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+class QDBusConnection;
+QT_END_NAMESPACE
+
+class StatusNotifierItemDBusPrivate;
+
+/*!
+    Bus I/O of an item: the export of its object, the emission of its
+    signals and the calls to the StatusNotifierWatcher.
+
+    Property reads and method calls are answered by StatusNotifierItemDBus,
+    answers of the watcher are given to StatusNotifierItemDBusPrivate.
+
+    QtDBus is the default transport, serving the item through SNIDispatcher;
+    `SNI_QT_TRANSPORT=adaptor` serves it through the generated adaptors
+    instead, e.g. to compare both. When the library is built with
+    SNI_QT_WITH_SDBUS, the environment variable `SNI_QT_TRANSPORT=sd-bus`
+    selects a transport on sd-bus, which reads and writes messages from
+    the event loop directly, without meta-object dispatch nor QVariant.
+    It can't export context menus, so items with one are kept on QtDBus.
+*/
+class SNITransport
+{
+public:
+    enum Signal : quint8 {
+        NewStatus,        // with the status
+        NewTitle,
+        NewIcon,
+        NewOverlayIcon,
+        NewAttentionIcon,
+        NewToolTip,
+        NewIconThemePath  // with the path
+    };
+
+    virtual ~SNITransport() = default;
+
+    static std::unique_ptr<SNITransport> create(StatusNotifierItemDBusPrivate*);
+
+    virtual const char* name() const = 0;
+    virtual QString     uniqueName() const = 0;
+
+    // the connection exporting the menu, nullptr if the transport has none
+    virtual QDBusConnection* menuConnection() = 0;
+
+    virtual void emitSignal(Signal, const QString& argument = QString()) = 0;
+    virtual void emitIconRevision(uint revision) = 0;
+    virtual void emitRevision(const QString& group, uint revision) = 0;
+
+    // answered through StatusNotifierItemDBusPrivate::setRegistration()
+    virtual void registerItem() = 0;
+    // answered through StatusNotifierItemDBusPrivate::setHostAvailable()
+    virtual void queryHost() = 0;
+
+    virtual qint64 memoryUsage() const = 0;
+
+    // false once the item is hidden, until the transport is deleted
+    bool isAttached() const;
+
+protected:
+    explicit SNITransport(StatusNotifierItemDBusPrivate* owner) : d(owner) {}
+
+    StatusNotifierItemDBusPrivate* const d;
+};
+
+#ifdef SNI_QT_WITH_SDBUS
+// nullptr if the session bus cannot be reached through sd-bus
+std::unique_ptr<SNITransport> createSdBusTransport(StatusNotifierItemDBusPrivate*);
+#endif
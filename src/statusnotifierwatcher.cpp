@@ -0,0 +1,262 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifierwatcher.h"
+#include "statusnotifierwatcher_p.h"
+#include "statusnotifierwatcheradaptor.h"
+
+#include <QAtomicInt>
+#include <QDBusConnectionInterface>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+
+namespace {
+const QString watcherService = QStringLiteral("org.kde.StatusNotifierWatcher");
+const QString watcherPath    = QStringLiteral("/StatusNotifierWatcher");
+
+// RequestName flag and replies, from the D-Bus specification
+constexpr uint nameDoNotQueue    = 0x4;
+constexpr uint replyPrimaryOwner = 1;
+constexpr uint replyAlreadyOwner = 4;
+
+// a connection per instance, closing one leaves the others connected
+QAtomicInt connectionCounter;
+}
+
+StatusNotifierWatcher::StatusNotifierWatcher(QObject *parent)
+    : QObject(parent)
+    , d(new StatusNotifierWatcherPrivate(this))
+{
+    d->init();
+}
+
+StatusNotifierWatcher::~StatusNotifierWatcher()
+{
+    if (d->registered)
+        d->sessionBus.unregisterService(watcherService);
+
+    d->sessionBus.unregisterObject(watcherPath);
+    QDBusConnection::disconnectFromBus(d->connectionName);
+}
+
+bool StatusNotifierWatcher::isServiceRegistered() const
+{
+    return d->registered;
+}
+
+QStringList StatusNotifierWatcher::registeredItems() const
+{
+    return d->registeredItems();
+}
+
+bool StatusNotifierWatcher::isHostRegistered() const
+{
+    return d->isHostRegistered();
+}
+
+void StatusNotifierWatcher::registerHost(const QString &service)
+{
+    d->addHost(service);
+}
+//==================================================================================================
+// StatusNotifierWatcherPrivate
+//==================================================================================================
+StatusNotifierWatcherPrivate::StatusNotifierWatcherPrivate(StatusNotifierWatcher *owner)
+    : q(owner)
+    , connectionName(watcherService + QLatin1Char('-') + QString::number(connectionCounter.fetchAndAddRelaxed(1) + 1))
+    , sessionBus(QDBusConnection::connectToBus(QDBusConnection::SessionBus, connectionName))
+{
+}
+
+void StatusNotifierWatcherPrivate::init()
+{
+    adaptor = new StatusNotifierWatcherAdaptor(this);
+
+    serviceWatcher = new QDBusServiceWatcher(this);
+    serviceWatcher->setConnection(sessionBus);
+    serviceWatcher->setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+    QObject::connect(
+        serviceWatcher, &QDBusServiceWatcher::serviceUnregistered,
+        this, &StatusNotifierWatcherPrivate::onServiceUnregistered
+    );
+
+    // take over the service if its current owner goes away
+    ownerWatcher = new QDBusServiceWatcher(
+        watcherService,
+        sessionBus,
+        QDBusServiceWatcher::WatchForOwnerChange,
+        this
+    );
+    QObject::connect(
+        ownerWatcher, &QDBusServiceWatcher::serviceOwnerChanged,
+        this, &StatusNotifierWatcherPrivate::onOwnerChanged
+    );
+
+    sessionBus.registerObject(watcherPath, this);
+    registerService();
+}
+
+void StatusNotifierWatcherPrivate::registerService()
+{
+    if (registered)
+        return;
+
+    // the owner went away while a request was on its way, ask again once it is answered
+    if (requesting) {
+        requestAgain = true;
+        return;
+    }
+    requesting   = true;
+    requestAgain = false;
+
+    // never queue for the name nor replace a running watcher,
+    // nor block the caller until the bus answers
+    auto *call = new QDBusPendingCallWatcher(
+        sessionBus.interface()->asyncCall(QStringLiteral("RequestName"), watcherService, nameDoNotQueue), this);
+    QObject::connect(call, &QDBusPendingCallWatcher::finished, this,
+                     [this](QDBusPendingCallWatcher *call) {
+        call->deleteLater();
+        requesting = false;
+
+        const QDBusPendingReply<uint> reply = *call;
+        if (reply.isError() || (reply.value() != replyPrimaryOwner && reply.value() != replyAlreadyOwner)) {
+            if (requestAgain)
+                registerService();
+            return;
+        }
+        registered = true;
+        Q_EMIT q->serviceRegistered();
+    });
+}
+
+void StatusNotifierWatcherPrivate::addItem(const QString &service, const QString &path)
+{
+    auto it = items.find(service);
+    if (it == items.end()) {
+        if (!hosts.contains(service))
+            watch(service);
+        it = items.insert(service, QSet<QString>());
+    }
+    const QString item = service + path;
+    if (it->contains(item))
+        return;
+
+    it->insert(item);
+
+    Q_EMIT adaptor->StatusNotifierItemRegistered(item);
+    Q_EMIT q->itemRegistered(item);
+}
+
+void StatusNotifierWatcherPrivate::addHost(const QString &service)
+{
+    if (service.isEmpty() || hosts.contains(service))
+        return;
+
+    if (!items.contains(service))
+        watch(service);
+
+    hosts.insert(service);
+
+    Q_EMIT adaptor->StatusNotifierHostRegistered();
+    Q_EMIT q->hostRegistered();
+}
+
+void StatusNotifierWatcherPrivate::watch(const QString &service)
+{
+    serviceWatcher->addWatchedService(service);
+
+    // the service may have left the bus before being watched
+    auto *call = new QDBusPendingCallWatcher(
+        sessionBus.interface()->asyncCall(QStringLiteral("NameHasOwner"), service), this);
+    QObject::connect(call, &QDBusPendingCallWatcher::finished, this,
+                     [this, service](QDBusPendingCallWatcher *call) {
+        call->deleteLater();
+
+        const QDBusPendingReply<bool> reply = *call;
+        if (!reply.isError() && !reply.value())
+            onServiceUnregistered(service);
+    });
+}
+
+void StatusNotifierWatcherPrivate::unwatch(const QString &service)
+{
+    serviceWatcher->removeWatchedService(service);
+}
+
+QStringList StatusNotifierWatcherPrivate::registeredItems() const
+{
+    QStringList list;
+    for (const QSet<QString> &serviceItems : items) {
+        for (const QString &item : serviceItems)
+            list.append(item);
+    }
+    return list;
+}
+
+bool StatusNotifierWatcherPrivate::isHostRegistered() const
+{
+    return !hosts.isEmpty();
+}
+
+int StatusNotifierWatcherPrivate::protocolVersion() const
+{
+    return 0;
+}
+
+void StatusNotifierWatcherPrivate::RegisterStatusNotifierItem(const QString &service)
+{
+    // Some implementations register the object path and expect
+    // the watcher to use the service of the caller.
+    if (service.startsWith(QLatin1Char('/'))) {
+        if (calledFromDBus())
+            addItem(message().service(), service);
+        return;
+    }
+    if (!service.isEmpty())
+        addItem(service, QStringLiteral("/StatusNotifierItem"));
+}
+
+void StatusNotifierWatcherPrivate::RegisterStatusNotifierHost(const QString &service)
+{
+    addHost(service);
+}
+
+void StatusNotifierWatcherPrivate::onServiceUnregistered(const QString &service)
+{
+    const auto it = items.find(service);
+    const bool isHost = hosts.remove(service);
+    if (it == items.end() && !isHost)
+        return;
+
+    unwatch(service);
+
+    if (it != items.end()) {
+        const QSet<QString> serviceItems = *it;
+        items.erase(it);
+
+        for (const QString &item : serviceItems) {
+            Q_EMIT adaptor->StatusNotifierItemUnregistered(item);
+            Q_EMIT q->itemUnregistered(item);
+        }
+    }
+    if (isHost) {
+        Q_EMIT adaptor->StatusNotifierHostUnregistered();
+        Q_EMIT q->hostUnregistered();
+    }
+}
+
+void StatusNotifierWatcherPrivate::onOwnerChanged(
+    const QString &service,
+    const QString &oldOwner,
+    const QString &newOwner
+) {
+    Q_UNUSED(service)
+    Q_UNUSED(oldOwner)
+
+    if (newOwner.isEmpty())
+        registerService();
+}
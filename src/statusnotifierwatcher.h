@@ -0,0 +1,108 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#ifndef STATUS_NOTIFIER_WATCHER_H
+#define STATUS_NOTIFIER_WATCHER_H
+
+#include "statusnotifieritem_export.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <memory>
+
+class StatusNotifierWatcherPrivate;
+/*!
+    In-process implementation of the StatusNotifierWatcher service.
+
+    Sessions without a StatusNotifierWatcher leave every item invisible.
+    An application providing its own host, e.g. a kiosk panel, can create
+    an instance of this class instead of running a separate watcher process.
+
+    The service org.kde.StatusNotifierWatcher is registered on the session bus
+    only if no other process owns it; otherwise the instance stays inactive
+    and takes over as soon as the current owner goes away. The name is
+    requested without blocking: serviceRegistered() is emitted once the bus
+    has granted it, from the event loop.
+
+    Items and hosts are dropped when their service leaves the bus.
+*/
+class SNI_QT_EXPORT StatusNotifierWatcher : public QObject
+{
+    Q_OBJECT
+
+    friend class StatusNotifierWatcherPrivate;
+
+public:
+    /**
+        Construct a new status notifier watcher.
+
+        @param parent The parent object.
+    */
+    explicit StatusNotifierWatcher(QObject *parent = nullptr);
+
+    ~StatusNotifierWatcher() override;
+
+    /*!
+        @return whether this instance owns the watcher service,
+        false until serviceRegistered() has been emitted.
+    */
+    bool isServiceRegistered() const;
+
+    /*!
+        @return the registered items, as "service/path" strings.
+    */
+    QStringList registeredItems() const;
+
+    /*!
+        @return whether at least one host is registered.
+    */
+    bool isHostRegistered() const;
+
+    /*!
+        Registers a host living in this process,
+        without a round-trip through the bus.
+
+        @param service The service name of the host.
+    */
+    void registerHost(const QString &service);
+
+Q_SIGNALS:
+    /*!
+        Emitted when the watcher service has been registered.
+    */
+    void serviceRegistered();
+
+    /*!
+        Emitted when a new item has been registered.
+
+        @param item The item, as "service/path".
+    */
+    void itemRegistered(const QString &item);
+
+    /*!
+        Emitted when an item has been unregistered.
+
+        @param item The item, as "service/path".
+    */
+    void itemUnregistered(const QString &item);
+
+    /*!
+        Emitted when a host has been registered.
+    */
+    void hostRegistered();
+
+    /*!
+        Emitted when a host has been unregistered.
+    */
+    void hostUnregistered();
+
+private:
+    std::unique_ptr<StatusNotifierWatcherPrivate> const d;
+};
+
+#endif
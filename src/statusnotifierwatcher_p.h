@@ -0,0 +1,75 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#ifndef SNI_QT_WATCHER_PRIVATE_H
+#define SNI_QT_WATCHER_PRIVATE_H
+
+#include <QDBusConnection>
+#include <QDBusContext>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+QT_BEGIN_NAMESPACE
+class QDBusServiceWatcher;
+QT_END_NAMESPACE
+
+class StatusNotifierWatcher;
+class StatusNotifierWatcherAdaptor;
+
+class StatusNotifierWatcherPrivate : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+
+    //! The registered items, as "service/path" strings.
+    Q_PROPERTY(QStringList RegisteredStatusNotifierItems READ registeredItems)
+
+    //! Whether at least one host is registered.
+    Q_PROPERTY(bool IsStatusNotifierHostRegistered READ isHostRegistered)
+
+    //! Version of the protocol implemented by the watcher.
+    Q_PROPERTY(int ProtocolVersion READ protocolVersion)
+
+public:
+    StatusNotifierWatcherPrivate(StatusNotifierWatcher*);
+    StatusNotifierWatcherPrivate() = delete;
+
+    void init();
+    void registerService();
+    void addItem(const QString &service, const QString &path);
+    void addHost(const QString &service);
+    void watch(const QString &service);
+    void unwatch(const QString &service);
+
+    QStringList registeredItems() const;
+    bool        isHostRegistered() const;
+    int         protocolVersion() const;
+
+    StatusNotifierWatcher*          q;
+    StatusNotifierWatcherAdaptor*   adaptor;
+    QString                         connectionName;
+    QDBusConnection                 sessionBus;
+    QDBusServiceWatcher*            serviceWatcher;
+    QDBusServiceWatcher*            ownerWatcher;
+    bool                            registered { false };
+    bool                            requesting { false };
+    bool                            requestAgain { false };
+
+    // Items by service, so a service leaving the bus is a single lookup
+    QHash<QString, QSet<QString>>   items;
+    QSet<QString>                   hosts;
+
+public Q_SLOTS:
+    void RegisterStatusNotifierItem(const QString &service);
+    void RegisterStatusNotifierHost(const QString &service);
+
+    void onServiceUnregistered(const QString &service);
+    void onOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner);
+};
+
+#endif // SNI_QT_WATCHER_PRIVATE_H
@@ -0,0 +1,1332 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include <statusnotifieritem.h>
+#include <statusnotifieritemclient.h>
+#include <statusnotifierwatcher.h>
+
+#include "statusnotifieritemlatency_p.hpp"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+#include <QDBusVariant>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QPixmap>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QtEndian>
+#include <QTimer>
+#include <QVector>
+
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <utility>
+
+/*
+    Drives many items at a given rate and mix of updates, with an in-process
+    watcher and a StatusNotifierItemClient per item standing in for the panel.
+    With --tracking, it reports the latencies tracked by the first item too.
+    With --calls, it then times the round trip of property reads and method
+    calls to an item, e.g. to compare `SNI_QT_TRANSPORT=adaptor` to the default.
+    With --threads, it only creates the items, from several threads at once.
+    With --toggles, it creates them hidden and shows and hides them in turn,
+    with --reentrant from their registration slot as well.
+    With --watcher-check, it checks the in-process watcher and fails on errors.
+    With --cold-start, it times the first icons set by pixmap in new processes.
+    With --progress-check, it compares IconPixmap to IconPixmapDelta on progress
+    frames, and fails unless the client reassembles each frame bit-identically.
+    With --progress-cost, it times setProgress() against repainting each frame.
+
+    Run it on a private bus, e.g. `dbus-run-session sni-loadgen --items 50`,
+    so that no other watcher or host takes part in the measure.
+*/
+// resident set size of the process in bytes, -1 where /proc is not available
+qint64 residentMemory()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly))
+        return -1;
+
+    for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()) {
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).trimmed().split(' ').constFirst().toLongLong() * 1024;
+    }
+    return -1;
+}
+
+class SNILoadGenerator : public QObject
+{
+public:
+    enum Kind { Icon, ToolTip, Status, KindCount };
+    enum Call { GetStatus, GetIconPixmap, GetAll, IconPixmapDelta, CallCount };
+
+    struct Options {
+        int        items { 50 };
+        double     rate { 100.0 };           // updates per second, all items together
+        int        duration { 10 };          // seconds
+        int        weights[KindCount] { 50, 30, 20 };
+        double     pixmapRatio { 0.5 };      // of the icon updates, the rest by name
+        QList<int> sizes { 16, 22, 32, 48, 64 };
+        int        refreshDelay { 50 };      // of the stand-in hosts
+        bool       withHost { true };
+        int        calls { 0 };              // timed calls of each kind after the updates
+        bool       lean { false };           // memory-lean mode on every item
+        bool       tracking { false };       // latency tracking of the library on every item
+    };
+
+    explicit SNILoadGenerator(const Options& options);
+
+private:
+    struct Item {
+        StatusNotifierItem* item;
+        qint64              pending[KindCount] { -1, -1, -1 }; // first update not seen by the host
+        int                 serial { 0 };
+    };
+
+    void onItemRegistered(const QString& service);
+    void onHostReady(StatusNotifierItemClient* host);
+    void onChanged(const QString& id, StatusNotifierItemClient* host,
+                   StatusNotifierItemClient::Properties properties);
+    void start();
+    void tick();
+    void update(Item& item);
+    void finish();
+    void nextCall();
+    void finishCalls();
+
+    static const char* kindName(Kind);
+    static const char* callName(Call);
+
+    Options                        options_;
+    StatusNotifierWatcher          watcher_;
+    QVector<Item>                  items_;
+    QHash<QString, int>            indexes_; // by item id
+    QString                        service_; // of an item, for the timed calls
+    QVector<QIcon>                 pixmaps_;
+    QStringList                    names_;
+    int                            hostsReady_ { 0 };
+    bool                           started_ { false };
+    QTimer                         timer_;
+    QElapsedTimer                  clock_;
+    QElapsedTimer                  attachClock_;           // from the creation of the items
+    qint64                         hostsReadyAt_ { -1 };   // ms, when all the hosts were ready
+    qint64                         refreshes_ { 0 };       // changes reported by the hosts
+    qint64                         iconNs_ { 0 };          // converting the icons, as a panel would
+    qint64                         iconConversions_ { 0 };
+    std::clock_t                   cpuStart_ { 0 };
+    qint64                         updates_ { 0 };
+    qint64                         counts_[KindCount] {};
+    int                            next_ { 0 };
+    QRandomGenerator               random_;
+    SNILatencyHistogram            latencies_[KindCount];
+    SNILatencyHistogram            callLatencies_[CallCount];
+    int                            callsDone_ { 0 };
+    int                            callErrors_ { 0 };
+};
+
+SNILoadGenerator::SNILoadGenerator(const Options& options)
+    : options_(options)
+    , watcher_(this)
+    , random_(42)
+{
+    // pixmaps of a few colors, at every size, so that each update changes the icon
+    for (const QColor& color : { QColor(Qt::red), QColor(Qt::green), QColor(Qt::blue), QColor(Qt::yellow),
+                                 QColor(Qt::cyan), QColor(Qt::magenta), QColor(Qt::gray), QColor(Qt::white) }) {
+        QIcon icon;
+        for (int size : std::as_const(options_.sizes)) {
+            QPixmap pixmap(size, size);
+            pixmap.fill(Qt::transparent);
+
+            QPainter painter(&pixmap);
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.setBrush(color);
+            painter.drawEllipse(pixmap.rect().adjusted(1, 1, -1, -1));
+            painter.end();
+
+            icon.addPixmap(pixmap);
+        }
+        pixmaps_.append(icon);
+    }
+    names_ = QStringList { QStringLiteral("dialog-information"), QStringLiteral("dialog-warning"),
+                           QStringLiteral("mail-unread"), QStringLiteral("network-wireless"),
+                           QStringLiteral("audio-volume-high"), QStringLiteral("battery-good") };
+
+    connect(&watcher_, &StatusNotifierWatcher::itemRegistered, this, &SNILoadGenerator::onItemRegistered);
+
+    attachClock_.start();
+    items_.reserve(options_.items);
+    for (int i = 0; i < options_.items; ++i) {
+        const QString id = QStringLiteral("sni-loadgen-%1").arg(i);
+        indexes_.insert(id, i);
+
+        Item item;
+        item.item = new StatusNotifierItem(id, this);
+        item.item->setMemoryLeanModeEnabled(options_.lean);
+        item.item->setLatencyTrackingEnabled(options_.tracking);
+        item.item->setTitle(id);
+        item.item->setIconByName(names_.at(i % names_.size()));
+        items_.append(item);
+    }
+
+    // without a host, or when another watcher owns the service, start anyway
+    QTimer::singleShot(options_.withHost ? 5000 : 0, this, [this] {
+        if (!started_ && options_.withHost)
+            QTextStream(stderr) << hostsReady_ << " of " << items_.size() << " hosts attached, starting anyway\n";
+        start();
+    });
+
+    connect(&timer_, &QTimer::timeout, this, &SNILoadGenerator::tick);
+}
+
+void SNILoadGenerator::onItemRegistered(const QString& service)
+{
+    if (service_.isEmpty())
+        service_ = service;
+
+    if (!options_.withHost)
+        return;
+
+    // a registered host, for the items in idle mode
+    if (!watcher_.isHostRegistered())
+        watcher_.registerHost(QDBusConnection::sessionBus().baseService());
+
+    auto *host = new StatusNotifierItemClient(service, this);
+    host->setRefreshDelay(options_.refreshDelay);
+
+    connect(host, &StatusNotifierItemClient::ready, this, [this, host] { onHostReady(host); });
+}
+
+void SNILoadGenerator::onHostReady(StatusNotifierItemClient* host)
+{
+    const QString id = host->id();
+    connect(host, &StatusNotifierItemClient::changed, this,
+            [this, id, host](StatusNotifierItemClient::Properties properties) { onChanged(id, host, properties); });
+
+    if (++hostsReady_ == items_.size()) {
+        hostsReadyAt_ = attachClock_.elapsed();
+        start();
+    }
+}
+
+void SNILoadGenerator::onChanged(const QString& id, StatusNotifierItemClient* host,
+                                 StatusNotifierItemClient::Properties properties)
+{
+    const auto it = indexes_.constFind(id);
+    if (it == indexes_.constEnd() || !started_)
+        return;
+
+    ++refreshes_;
+    if (properties & StatusNotifierItemClient::IconProperty) {
+        const qint64 start = clock_.nsecsElapsed();
+        host->icon();
+        iconNs_ += clock_.nsecsElapsed() - start;
+        ++iconConversions_;
+    }
+
+    Item&        item = items_[*it];
+    const qint64 now  = clock_.nsecsElapsed() / 1000;
+
+    const StatusNotifierItemClient::Properties kinds[KindCount] = {
+        StatusNotifierItemClient::IconProperty,
+        StatusNotifierItemClient::ToolTipProperty,
+        StatusNotifierItemClient::StatusProperty
+    };
+    for (int kind = 0; kind < KindCount; ++kind) {
+        if (!(properties & kinds[kind]) || item.pending[kind] < 0)
+            continue;
+
+        latencies_[kind].record(now - item.pending[kind]);
+        item.pending[kind] = -1;
+    }
+}
+
+void SNILoadGenerator::start()
+{
+    if (started_)
+        return;
+
+    started_  = true;
+    cpuStart_ = std::clock();
+    clock_.start();
+    timer_.start(1);
+
+    QTimer::singleShot(options_.duration * 1000, this, &SNILoadGenerator::finish);
+}
+
+void SNILoadGenerator::tick()
+{
+    // catch up with the rate, whatever the timer resolution
+    const qint64 due = qint64(options_.rate * clock_.nsecsElapsed() / 1e9);
+    while (updates_ < due && !items_.isEmpty()) {
+        update(items_[next_]);
+        next_ = (next_ + 1) % items_.size();
+        ++updates_;
+    }
+}
+
+void SNILoadGenerator::update(Item& item)
+{
+    int total = 0;
+    for (int weight : options_.weights)
+        total += weight;
+
+    int  pick = int(random_.bounded(qMax(1, total)));
+    Kind kind = Icon;
+    while (kind < Status && pick >= options_.weights[kind]) {
+        pick -= options_.weights[kind];
+        kind = Kind(kind + 1);
+    }
+
+    if (item.pending[kind] < 0)
+        item.pending[kind] = clock_.nsecsElapsed() / 1000;
+
+    ++counts_[kind];
+    ++item.serial;
+
+    switch (kind) {
+    case Icon:
+        if (random_.generateDouble() < options_.pixmapRatio)
+            item.item->setIconByPixmap(pixmaps_.at(item.serial % pixmaps_.size()));
+        else
+            item.item->setIconByName(names_.at(item.serial % names_.size()));
+        break;
+    case ToolTip:
+        item.item->setToolTip(QString(), QStringLiteral("Update %1").arg(item.serial),
+                              QStringLiteral("<b>%1</b> pending").arg(item.serial % 100));
+        break;
+    case Status:
+        item.item->setStatus(item.item->status() == StatusNotifierItem::Active
+                             ? StatusNotifierItem::NeedsAttention : StatusNotifierItem::Active);
+        break;
+    case KindCount:
+        break;
+    }
+}
+
+void SNILoadGenerator::finish()
+{
+    timer_.stop();
+
+    const double cpuMs  = 1000.0 * double(std::clock() - cpuStart_) / CLOCKS_PER_SEC;
+    const qint64 wallMs = qMax(qint64(1), clock_.elapsed());
+
+    qint64 memory = 0;
+    for (const Item& item : std::as_const(items_))
+        memory += item.item->memoryUsage();
+
+    QTextStream out(stdout);
+    out << "transport:   " << qEnvironmentVariable("SNI_QT_TRANSPORT", QStringLiteral("QtDBus")) << '\n'
+        << "items:       " << items_.size() << " (" << hostsReady_ << " hosts)\n"
+        << "updates:     " << updates_ << " (icon " << counts_[Icon] << ", tooltip " << counts_[ToolTip]
+                           << ", status " << counts_[Status] << ")\n"
+        << "rate:        " << 1000.0 * updates_ / wallMs << " updates/s, " << options_.rate << " requested\n"
+        << "cpu time:    " << cpuMs << " ms\n";
+
+    if (updates_ > 0)
+        out << "cpu/update:  " << 1000.0 * cpuMs / updates_ << " us\n";
+
+    out << "item memory: " << memory << " bytes, " << memory / qMax(1, int(items_.size())) << " per item"
+                           << (options_.lean ? " (lean)\n" : "\n")
+        << "shared:      " << StatusNotifierItem::sharedMemoryUsage() << " bytes\n"
+        << "resident:    " << residentMemory() << " bytes, the whole process\n";
+
+    if (StatusNotifierItem::pixmapBandwidthBudget() > 0) {
+        const QVariantMap budget = StatusNotifierItem::pixmapBandwidthStatistics();
+        out << "pixmap budget: " << budget.value(QStringLiteral("budget")).toLongLong() << " bytes/s\n"
+            << "  sent:      " << budget.value(QStringLiteral("sentSignals")).toLongLong() << " signals, "
+                               << budget.value(QStringLiteral("sentBytes")).toLongLong() << " bytes ("
+                               << budget.value(QStringLiteral("urgentSignals")).toLongLong() << " urgent)\n"
+            << "  deferred:  " << budget.value(QStringLiteral("deferredSignals")).toLongLong() << " signals, "
+                               << budget.value(QStringLiteral("deferredBytes")).toLongLong() << " bytes, "
+                               << budget.value(QStringLiteral("coalescedSignals")).toLongLong() << " coalesced\n"
+            << "  delay:     " << budget.value(QStringLiteral("averageDelay")).toDouble() << " ms average, "
+                               << budget.value(QStringLiteral("maxDelay")).toLongLong() << " ms max\n";
+    }
+
+    if (options_.withHost) {
+        // the cost on the side of the panel
+        out << "hosts:       " << hostsReady_ << " ready";
+        if (hostsReadyAt_ >= 0)
+            out << " in " << hostsReadyAt_ << " ms";
+        out << '\n'
+            << "refreshes:   " << refreshes_ << " for " << updates_ << " updates\n";
+        if (iconConversions_ > 0)
+            out << "host icon:   " << iconNs_ / 1000.0 / iconConversions_ << " us per conversion\n";
+
+        out << "latency, from the setter to the host (us):\n"
+            << "  update        count      p50      p90      p99    p99.9      max\n";
+        for (int kind = 0; kind < KindCount; ++kind) {
+            const SNILatencyHistogram& h = latencies_[kind];
+            out << "  " << qSetFieldWidth(9) << Qt::left << kindName(Kind(kind))
+                << qSetFieldWidth(9) << Qt::right
+                << h.count() << h.percentile(50.0) << h.percentile(90.0)
+                << h.percentile(99.0) << h.percentile(99.9) << h.max()
+                << qSetFieldWidth(0) << '\n';
+        }
+    }
+    // the stages inside the library: setter, New* signal and Get by the host
+    if (options_.tracking && !items_.isEmpty())
+        out << "tracked latencies of " << items_.constFirst().item->id() << ":\n"
+            << items_.constFirst().item->latencyReport();
+    out.flush();
+
+    if (options_.calls <= 0) {
+        qApp->quit();
+        return;
+    }
+    if (service_.isEmpty()) {
+        QTextStream(stderr) << "no item registered to the watcher, skipping the calls\n";
+        qApp->quit();
+        return;
+    }
+    nextCall();
+}
+
+void SNILoadGenerator::nextCall()
+{
+    if (callsDone_ == options_.calls * CallCount) {
+        finishCalls();
+        return;
+    }
+    const int     slash   = service_.indexOf(QLatin1Char('/'));
+    const QString service = slash < 0 ? service_ : service_.left(slash);
+    const QString path    = slash < 0 ? QStringLiteral("/StatusNotifierItem") : service_.mid(slash);
+    const QString item    = QStringLiteral("org.kde.StatusNotifierItem");
+
+    // one call of each kind in turn
+    const Call   call = Call(callsDone_ % CallCount);
+    QDBusMessage message;
+    switch (call) {
+    case GetStatus:
+    case GetIconPixmap:
+        message = QDBusMessage::createMethodCall(service, path, QStringLiteral("org.freedesktop.DBus.Properties"),
+                                                 QStringLiteral("Get"));
+        message << item << (call == GetStatus ? QStringLiteral("Status") : QStringLiteral("IconPixmap"));
+        break;
+    case GetAll:
+        message = QDBusMessage::createMethodCall(service, path, QStringLiteral("org.freedesktop.DBus.Properties"),
+                                                 QStringLiteral("GetAll"));
+        message << item;
+        break;
+    case IconPixmapDelta:
+        message = QDBusMessage::createMethodCall(service, path, QStringLiteral("io.github.qtilities.StatusNotifierItem"),
+                                                 QStringLiteral("IconPixmapDelta"));
+        message << uint(0);
+        break;
+    case CallCount:
+        break;
+    }
+    const qint64 start = clock_.nsecsElapsed() / 1000;
+
+    auto *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, call, start](QDBusPendingCallWatcher *w) {
+        w->deleteLater();
+        if (w->isError())
+            ++callErrors_;
+        else
+            callLatencies_[call].record(clock_.nsecsElapsed() / 1000 - start);
+
+        ++callsDone_;
+        nextCall();
+    });
+}
+
+void SNILoadGenerator::finishCalls()
+{
+    QTextStream out(stdout);
+    out << "calls, round trip to " << service_ << " (us):\n"
+        << "  call                count      p50      p90      p99    p99.9      max\n";
+    for (int call = 0; call < CallCount; ++call) {
+        const SNILatencyHistogram& h = callLatencies_[call];
+        out << "  " << qSetFieldWidth(17) << Qt::left << callName(Call(call))
+            << qSetFieldWidth(9) << Qt::right
+            << h.count() << h.percentile(50.0) << h.percentile(90.0)
+            << h.percentile(99.0) << h.percentile(99.9) << h.max()
+            << qSetFieldWidth(0) << '\n';
+    }
+    if (callErrors_ > 0)
+        out << "call errors: " << callErrors_ << '\n';
+    out.flush();
+
+    qApp->quit();
+}
+
+const char* SNILoadGenerator::kindName(Kind kind)
+{
+    switch (kind) {
+    case Icon:      return "icon";
+    case ToolTip:   return "tooltip";
+    case Status:    return "status";
+    case KindCount: break;
+    }
+    return "";
+}
+
+/*
+    Creates items from several threads at once, each running an event loop,
+    and times their construction and their registration to the watcher.
+*/
+class SNIConstructionBenchmark : public QObject
+{
+public:
+    SNIConstructionBenchmark(int items, int threads);
+
+private:
+    void onCreated(qint64 usec, const QString& types);
+    void finish();
+
+    // the D-Bus types of the library as seen from the calling thread
+    static QString dbusTypes();
+
+    StatusNotifierWatcher watcher_;
+    QVector<QThread*>     threads_;
+    QVector<QObject*>     owners_;      // parents of the items of each thread, living in it
+    QElapsedTimer         clock_;
+    int                   items_;
+    int                   threadsDone_ { 0 };
+    QSet<QString>         services_;    // registered, one per item
+    QStringList           types_;       // dbusTypes() of each thread
+    int                   registered_ { 0 };
+    qint64                constructed_ { -1 }; // when the last thread was done, in us
+    qint64                registeredAt_ { -1 };
+    bool                  finished_ { false };
+};
+
+SNIConstructionBenchmark::SNIConstructionBenchmark(int items, int threads)
+    : watcher_(this)
+    , items_(items)
+{
+    connect(&watcher_, &StatusNotifierWatcher::itemRegistered, this, [this](const QString& item) {
+        services_.insert(item.left(item.indexOf(QLatin1Char('/'))));
+        if (++registered_ == items_) {
+            registeredAt_ = clock_.nsecsElapsed() / 1000;
+            finish();
+        }
+    });
+    // when another watcher owns the service, or items fail to register
+    QTimer::singleShot(10000, this, &SNIConstructionBenchmark::finish);
+
+    for (int t = 0; t < threads; ++t) {
+        auto *thread = new QThread(this);
+        auto *owner  = new QObject;
+        owner->moveToThread(thread);
+        thread->start();
+
+        threads_.append(thread);
+        owners_.append(owner);
+    }
+    clock_.start();
+
+    for (int t = 0; t < threads; ++t) {
+        const int first = int(qint64(items) * t / threads);
+        const int last  = int(qint64(items) * (t + 1) / threads);
+
+        QObject *owner = owners_.at(t);
+        QMetaObject::invokeMethod(owner, [this, owner, t, first, last] {
+            for (int i = first; i < last; ++i)
+                new StatusNotifierItem(QStringLiteral("sni-loadgen-%1-%2").arg(t).arg(i), owner);
+
+            const qint64  usec  = clock_.nsecsElapsed() / 1000;
+            const QString types = last > first ? dbusTypes() : QString();
+            QMetaObject::invokeMethod(this, [this, usec, types] { onCreated(usec, types); });
+        });
+    }
+}
+
+QString SNIConstructionBenchmark::dbusTypes()
+{
+    QString types;
+    for (const char* name : { "SNIIcon", "SNIIconList", "SNIToolTip", "SNIIconDeltaList" }) {
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+        const int        id        = QMetaType::type(name);
+        const QByteArray signature = id == QMetaType::UnknownType ? QByteArray() : QDBusMetaType::typeToSignature(id);
+#else
+        const QMetaType  type      = QMetaType::fromName(name);
+        const int        id        = type.id();
+        const QByteArray signature = type.isValid() ? QByteArray(QDBusMetaType::typeToSignature(type)) : QByteArray();
+#endif
+        types += QStringLiteral("%1=%2:%3 ").arg(QLatin1String(name)).arg(id).arg(QLatin1String(signature));
+    }
+    return types.trimmed();
+}
+
+void SNIConstructionBenchmark::onCreated(qint64 usec, const QString& types)
+{
+    if (!types.isEmpty())
+        types_.append(types);
+
+    if (++threadsDone_ == threads_.size())
+        constructed_ = usec;
+}
+
+void SNIConstructionBenchmark::finish()
+{
+    if (finished_)
+        return;
+
+    finished_ = true;
+
+    QTextStream out(stdout);
+    out << "transport:     " << qEnvironmentVariable("SNI_QT_TRANSPORT", QStringLiteral("QtDBus")) << '\n'
+        << "threads:       " << threads_.size() << '\n'
+        << "items:         " << items_ << '\n';
+
+    if (constructed_ >= 0) {
+        out << "construction:  " << constructed_ / 1000.0 << " ms, "
+            << 1e6 * items_ / qMax(qint64(1), constructed_) << " items/s\n";
+    } else {
+        out << "construction:  " << threadsDone_ << " of " << threads_.size() << " threads done\n";
+    }
+    out << "registered:    " << registered_ << " of " << items_;
+    if (registeredAt_ >= 0)
+        out << " in " << registeredAt_ / 1000.0 << " ms";
+    out << '\n';
+
+    // a service per item, and the same registered types from every thread
+    const bool unique = services_.size() == items_;
+    bool       types  = !types_.isEmpty();
+    for (const QString& seen : std::as_const(types_))
+        types = types && seen == types_.constFirst();
+    for (const char* signature : { ":(iiay)", ":a(iiay)", ":(sa(iiay)ss)", ":a(iiiiiiay)" })
+        types = types && types_.constFirst().contains(QLatin1String(signature));
+
+    out << (unique ? "PASS " : "FAIL ") << services_.size() << " distinct services for " << items_ << " items\n"
+        << (types ? "PASS " : "FAIL ") << "D-Bus types the same from " << types_.size() << " threads: "
+        << (types_.isEmpty() ? QString() : types_.constFirst()) << '\n';
+    out.flush();
+
+    // the items are destroyed in their threads
+    for (int t = 0; t < threads_.size(); ++t) {
+        QObject *owner = owners_.at(t);
+        QMetaObject::invokeMethod(owner, [owner] { delete owner; }, Qt::BlockingQueuedConnection);
+        threads_.at(t)->quit();
+        threads_.at(t)->wait();
+    }
+    qApp->exit(registered_ == items_ && unique && types ? 0 : 1);
+}
+
+/*
+    Creates hidden items, then shows them all, waits for their registration
+    and hides them again, a given number of times, timing each step.
+    In reentrant mode, each item is first hidden and shown twice from the
+    slot of its registration, while the transport answering it is running.
+*/
+class SNIVisibilityBenchmark : public QObject
+{
+public:
+    SNIVisibilityBenchmark(int items, int toggles, bool reentrant);
+
+private:
+    void showAll();
+    void hideAll();
+    void finish();
+    void onRegistered(StatusNotifierItem* item);
+
+    StatusNotifierWatcher        watcher_;
+    QVector<StatusNotifierItem*> items_;
+    QSet<StatusNotifierItem*>    toggled_; // from their slot, this round
+    QElapsedTimer                clock_;
+    int                          toggles_;
+    bool                         reentrant_;
+    int                          done_ { 0 };
+    int                          registered_ { 0 };
+    qint64                       constructNs_ { 0 };
+    qint64                       showNs_ { 0 };
+    qint64                       hideNs_ { 0 };
+    qint64                       registrationNs_ { 0 }; // from show() to the last registration
+    qint64                       shownAt_ { 0 };
+};
+
+SNIVisibilityBenchmark::SNIVisibilityBenchmark(int items, int toggles, bool reentrant)
+    : watcher_(this)
+    , toggles_(toggles)
+    , reentrant_(reentrant)
+{
+    clock_.start();
+    for (int i = 0; i < items; ++i)
+        items_.append(new StatusNotifierItem(QStringLiteral("sni-loadgen-%1").arg(i), false, this));
+    constructNs_ = clock_.nsecsElapsed();
+
+    for (StatusNotifierItem* item : std::as_const(items_))
+        connect(item, &StatusNotifierItem::registrationFinished, this, [this, item] { onRegistered(item); });
+    // when another watcher owns the service, or items fail to register
+    QTimer::singleShot(10000 + 1000 * toggles_, this, &SNIVisibilityBenchmark::finish);
+    QTimer::singleShot(0, this, &SNIVisibilityBenchmark::showAll);
+}
+
+void SNIVisibilityBenchmark::showAll()
+{
+    if (done_ == toggles_) {
+        finish();
+        return;
+    }
+    toggled_.clear();
+    registered_ = 0;
+    shownAt_    = clock_.nsecsElapsed();
+    for (StatusNotifierItem* item : std::as_const(items_))
+        item->show();
+    showNs_ += clock_.nsecsElapsed() - shownAt_;
+}
+
+void SNIVisibilityBenchmark::onRegistered(StatusNotifierItem* item)
+{
+    // the transports retired here are still on the stack
+    if (reentrant_ && !toggled_.contains(item)) {
+        toggled_.insert(item);
+        item->hide();
+        item->show();
+        item->hide();
+        item->show();
+        return;
+    }
+    if (++registered_ < items_.size())
+        return;
+
+    registrationNs_ += clock_.nsecsElapsed() - shownAt_;
+    hideAll();
+}
+
+void SNIVisibilityBenchmark::hideAll()
+{
+    const qint64 start = clock_.nsecsElapsed();
+    for (StatusNotifierItem* item : std::as_const(items_))
+        item->hide();
+    hideNs_ += clock_.nsecsElapsed() - start;
+
+    ++done_;
+    // the hosts see the items go before they come back
+    QTimer::singleShot(0, this, &SNIVisibilityBenchmark::showAll);
+}
+
+void SNIVisibilityBenchmark::finish()
+{
+    const double calls = double(qMax(1, done_)) * qMax(1, int(items_.size()));
+
+    QTextStream out(stdout);
+    out << "transport:     " << qEnvironmentVariable("SNI_QT_TRANSPORT", QStringLiteral("QtDBus")) << '\n'
+        << "items:         " << items_.size() << '\n'
+        << "toggles:       " << done_ << " of " << toggles_ << (reentrant_ ? " (reentrant)\n" : "\n")
+        << "hidden ctor:   " << constructNs_ / 1000.0 / qMax(1, int(items_.size())) << " us/item\n"
+        << "show():        " << showNs_ / 1000.0 / calls << " us/item\n"
+        << "hide():        " << hideNs_ / 1000.0 / calls << " us/item\n"
+        << "registration:  " << registrationNs_ / 1e6 / qMax(1, done_) << " ms for all the items\n";
+    out.flush();
+
+    qApp->exit(done_ == toggles_ ? 0 : 1);
+}
+
+/*
+    Checks the in-process watcher against the private bus: two instances in
+    one process, items coming and going, and the takeover of the service by
+    the second instance once the first one is destroyed.
+*/
+class SNIWatcherCheck : public QObject
+{
+public:
+    SNIWatcherCheck();
+
+private:
+    // runs the next step once @p signal of @p watcher is emitted, or fails after a while
+    template<typename Signal>
+    void expect(StatusNotifierWatcher* watcher, Signal signal, const char* step, std::function<void()> next);
+    void check(bool ok, const char* step);
+    void finish();
+
+    StatusNotifierWatcher* first_;
+    StatusNotifierWatcher* second_;
+    StatusNotifierItem*    item_ { nullptr };
+    QTimer                 deadline_;
+    const char*            step_ { nullptr };
+    int                    failures_ { 0 };
+};
+
+SNIWatcherCheck::SNIWatcherCheck()
+    : first_(new StatusNotifierWatcher(this))
+    , second_(nullptr)
+{
+    deadline_.setSingleShot(true);
+    deadline_.setInterval(5000);
+    connect(&deadline_, &QTimer::timeout, this, [this] {
+        check(false, step_);
+        finish();
+    });
+
+    // the name is requested without blocking the constructor
+    check(!first_->isServiceRegistered(), "constructor doesn't wait for the bus");
+    expect(first_, &StatusNotifierWatcher::serviceRegistered, "first instance owns the service", [this] {
+        second_ = new StatusNotifierWatcher(this);
+
+        // its request is answered before the item registration sent after it
+        item_ = new StatusNotifierItem(QStringLiteral("sni-loadgen-check"), this);
+        expect(first_, &StatusNotifierWatcher::itemRegistered, "item registered", [this] {
+            check(!second_->isServiceRegistered(), "second instance stays inactive");
+            check(first_->registeredItems().size() == 1, "one registered item");
+
+            delete item_;
+            item_ = nullptr;
+            expect(first_, &StatusNotifierWatcher::itemUnregistered, "item leaving the bus unregistered", [this] {
+                // the second instance has its own connection and takes over
+                delete first_;
+                first_ = nullptr;
+                expect(second_, &StatusNotifierWatcher::serviceRegistered, "second instance takes over", [this] {
+                    item_ = new StatusNotifierItem(QStringLiteral("sni-loadgen-check"), this);
+                    expect(second_, &StatusNotifierWatcher::itemRegistered, "item registered to the second instance",
+                           [this] { finish(); });
+                });
+            });
+        });
+    });
+}
+
+template<typename Signal>
+void SNIWatcherCheck::expect(StatusNotifierWatcher* watcher, Signal signal, const char* step, std::function<void()> next)
+{
+    step_ = step;
+    deadline_.start();
+
+    auto connection = std::make_shared<QMetaObject::Connection>();
+    *connection = connect(watcher, signal, this, [this, step, next, connection] {
+        disconnect(*connection);
+        deadline_.stop();
+        check(true, step);
+        next();
+    });
+}
+
+void SNIWatcherCheck::check(bool ok, const char* step)
+{
+    QTextStream(stdout) << (ok ? "PASS " : "FAIL ") << step << '\n';
+    if (!ok)
+        ++failures_;
+}
+
+void SNIWatcherCheck::finish()
+{
+    deadline_.stop();
+    qApp->exit(failures_ == 0 ? 0 : 1);
+}
+
+/*
+    Steps the progress of an item with icon deltas, comparing the bytes a host
+    reads with Get IconPixmap and with IconPixmapDelta for each frame. The icon
+    of a StatusNotifierItemClient, reassembled from the deltas, must then match
+    IconPixmap bit for bit: the base icon is opaque, so that going through
+    a QPixmap loses nothing.
+*/
+class SNIProgressCheck : public QObject
+{
+public:
+    SNIProgressCheck(int steps, const QList<int>& sizes);
+
+private:
+    void onItemRegistered(const QString& registered);
+    void step();
+    void onReference(QDBusPendingCallWatcher* call);
+    void compare();
+    void onDelta(QDBusPendingCallWatcher* call);
+    void finish(bool ok, const QString& failure = QString());
+
+    QDBusMessage methodCall(const QString& interface, const QString& member) const;
+
+    StatusNotifierWatcher     watcher_;
+    StatusNotifierItem*       item_;
+    StatusNotifierItemClient* client_ { nullptr };
+    QString                   service_;
+    QString                   path_;
+    QString                   sizes_;
+    int                       steps_;
+    int                       step_ { -1 };
+    QVector<QImage>           expected_;          // the current frame, from IconPixmap
+    bool                      matched_ { false };
+    uint                      revision_ { ~0u };  // of the last delta, unknown at first
+    qint64                    fullBytes_ { 0 };
+    qint64                    deltaBytes_ { 0 };
+    QTimer                    deadline_;
+};
+
+SNIProgressCheck::SNIProgressCheck(int steps, const QList<int>& sizes)
+    : item_(new StatusNotifierItem(QStringLiteral("sni-loadgen-progress"), this))
+    , steps_(steps)
+{
+    QIcon base;
+    for (int size : sizes) {
+        QPixmap pixmap(size, size);
+        pixmap.fill(QColor(40, 90, 160));
+
+        QPainter painter(&pixmap);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setBrush(Qt::white);
+        painter.drawEllipse(pixmap.rect().adjusted(size / 4, size / 4, -size / 4, -size / 4));
+        painter.end();
+
+        base.addPixmap(pixmap);
+        sizes_ += (sizes_.isEmpty() ? QString() : QStringLiteral(",")) + QString::number(size);
+    }
+    item_->setIconDeltaUpdatesEnabled(true);
+    item_->setProgressUpdateInterval(0);
+    item_->setProgressSteps(steps_);
+    item_->setIconByPixmap(base);
+
+    deadline_.setSingleShot(true);
+    deadline_.setInterval(5000);
+    connect(&deadline_, &QTimer::timeout, this, [this] {
+        finish(false, step_ < 0 ? QStringLiteral("no client ready")
+                                : QStringLiteral("client icon differs from IconPixmap at step %1").arg(step_));
+    });
+    deadline_.start();
+
+    connect(&watcher_, &StatusNotifierWatcher::itemRegistered, this, &SNIProgressCheck::onItemRegistered);
+}
+
+void SNIProgressCheck::onItemRegistered(const QString& registered)
+{
+    if (client_)
+        return;
+
+    const int slash = registered.indexOf(QLatin1Char('/'));
+    service_ = slash < 0 ? registered : registered.left(slash);
+    path_    = slash < 0 ? QStringLiteral("/StatusNotifierItem") : registered.mid(slash);
+
+    if (!watcher_.isHostRegistered())
+        watcher_.registerHost(QDBusConnection::sessionBus().baseService());
+
+    client_ = new StatusNotifierItemClient(registered, this);
+    client_->setRefreshDelay(0);
+    connect(client_, &StatusNotifierItemClient::ready, this, &SNIProgressCheck::step);
+    connect(client_, &StatusNotifierItemClient::changed, this, [this](StatusNotifierItemClient::Properties properties) {
+        if (properties & StatusNotifierItemClient::IconProperty)
+            compare();
+    });
+}
+
+QDBusMessage SNIProgressCheck::methodCall(const QString& interface, const QString& member) const
+{
+    return QDBusMessage::createMethodCall(service_, path_, interface, member);
+}
+
+void SNIProgressCheck::step()
+{
+    if (++step_ > steps_) {
+        finish(true);
+        return;
+    }
+    matched_ = false;
+    expected_.clear();
+    deadline_.start();
+
+    item_->setProgress(double(step_) / steps_);
+
+    // the frame as a host without deltas reads it
+    QDBusMessage get = methodCall(QStringLiteral("org.freedesktop.DBus.Properties"), QStringLiteral("Get"));
+    get << QStringLiteral("org.kde.StatusNotifierItem") << QStringLiteral("IconPixmap");
+    auto *call = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(get), this);
+    connect(call, &QDBusPendingCallWatcher::finished, this, &SNIProgressCheck::onReference);
+}
+
+void SNIProgressCheck::onReference(QDBusPendingCallWatcher* call)
+{
+    call->deleteLater();
+    if (call->isError()) {
+        finish(false, call->error().message());
+        return;
+    }
+    const QDBusArgument argument = call->reply().arguments().at(0).value<QDBusVariant>().variant().value<QDBusArgument>();
+    argument.beginArray();
+    while (!argument.atEnd()) {
+        int        width  = 0;
+        int        height = 0;
+        QByteArray bytes;
+        argument.beginStructure();
+        argument >> width >> height >> bytes;
+        argument.endStructure();
+
+        // (iiay) and the length of the array
+        fullBytes_ += 12 + bytes.size();
+        if (width <= 0 || height <= 0 || bytes.size() != qsizetype(width) * height * 4) {
+            argument.endArray();
+            finish(false, QStringLiteral("malformed IconPixmap at step %1").arg(step_));
+            return;
+        }
+
+        // ARGB32 in network byte order
+        QImage image(width, height, QImage::Format_ARGB32);
+        const uchar* pixel = reinterpret_cast<const uchar*>(bytes.constData());
+        for (int y = 0; y < height; ++y) {
+            QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+            for (int x = 0; x < width; ++x, pixel += 4)
+                line[x] = qFromBigEndian<quint32>(pixel);
+        }
+        expected_.append(QPixmap::fromImage(image).toImage().convertToFormat(QImage::Format_ARGB32));
+    }
+    argument.endArray();
+
+    compare();
+}
+
+void SNIProgressCheck::compare()
+{
+    if (expected_.isEmpty() || matched_)
+        return;
+
+    // an older frame, the change of this one is still on its way
+    const QIcon icon = client_->icon();
+    for (const QImage& expected : std::as_const(expected_)) {
+        if (icon.pixmap(expected.size()).toImage().convertToFormat(QImage::Format_ARGB32) != expected)
+            return;
+    }
+    matched_ = true;
+
+    // the same frame as a host with deltas reads it
+    QDBusMessage delta = methodCall(QStringLiteral("io.github.qtilities.StatusNotifierItem"),
+                                    QStringLiteral("IconPixmapDelta"));
+    delta << revision_;
+    auto *call = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(delta), this);
+    connect(call, &QDBusPendingCallWatcher::finished, this, &SNIProgressCheck::onDelta);
+}
+
+void SNIProgressCheck::onDelta(QDBusPendingCallWatcher* call)
+{
+    call->deleteLater();
+    if (call->isError()) {
+        finish(false, call->error().message());
+        return;
+    }
+    const QList<QVariant> arguments = call->reply().arguments();
+    revision_ = arguments.at(0).toUInt();
+
+    // the revision, then (iiiiiiay) and the length of the array per image
+    deltaBytes_ += 4;
+    const QDBusArgument argument = arguments.at(1).value<QDBusArgument>();
+    argument.beginArray();
+    while (!argument.atEnd()) {
+        int        header[6] {};
+        QByteArray bytes;
+        argument.beginStructure();
+        for (int& value : header)
+            argument >> value;
+        argument >> bytes;
+        argument.endStructure();
+
+        deltaBytes_ += 28 + bytes.size();
+    }
+    argument.endArray();
+
+    step();
+}
+
+void SNIProgressCheck::finish(bool ok, const QString& failure)
+{
+    deadline_.stop();
+
+    const int frames = qMax(1, step_);
+    QTextStream out(stdout);
+    out << "transport:       " << qEnvironmentVariable("SNI_QT_TRANSPORT", QStringLiteral("QtDBus")) << '\n'
+        << "progress:        " << steps_ + 1 << " frames at " << sizes_ << '\n'
+        << "IconPixmap:      " << fullBytes_ << " bytes, " << fullBytes_ / frames << " per frame\n"
+        << "IconPixmapDelta: " << deltaBytes_ << " bytes, " << deltaBytes_ / frames << " per frame, "
+                               << (fullBytes_ > 0 ? 100.0 * deltaBytes_ / fullBytes_ : 0.0) << "% of IconPixmap\n";
+    if (ok)
+        out << "PASS client icon bit-identical to IconPixmap for " << steps_ + 1 << " frames\n";
+    else
+        out << "FAIL " << failure << '\n';
+    out.flush();
+
+    qApp->exit(ok ? 0 : 1);
+}
+
+/*
+    Times setProgress() over every frame, the first call drawing the frame
+    table, against repainting a bar over the icon and setIconByPixmap() for
+    each frame, as applications do without it. The updates are sent from
+    the event loop, which is run after each frame in both cases.
+*/
+int progressCost(int steps, const QList<int>& sizes)
+{
+    QIcon base;
+    for (int size : sizes) {
+        QPixmap pixmap(size, size);
+        pixmap.fill(Qt::transparent);
+
+        QPainter painter(&pixmap);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setBrush(QColor(40, 90, 160));
+        painter.drawEllipse(pixmap.rect().adjusted(1, 1, -1, -1));
+        painter.end();
+
+        base.addPixmap(pixmap);
+    }
+
+    StatusNotifierItem table(QStringLiteral("sni-loadgen-progress-table"));
+    table.setProgressUpdateInterval(0);
+    table.setProgressSteps(steps);
+    table.setIconByPixmap(base);
+
+    StatusNotifierItem repainted(QStringLiteral("sni-loadgen-progress-repainted"));
+    repainted.setIconByPixmap(base);
+    QCoreApplication::processEvents();
+
+    QElapsedTimer clock;
+    clock.start();
+    table.setProgress(0.0);
+    QCoreApplication::processEvents();
+    const qint64 firstNs = clock.nsecsElapsed();
+
+    clock.restart();
+    for (int step = 1; step <= steps; ++step) {
+        table.setProgress(double(step) / steps);
+        QCoreApplication::processEvents();
+    }
+    const qint64 tableNs = clock.nsecsElapsed();
+
+    clock.restart();
+    for (int step = 0; step <= steps; ++step) {
+        QIcon frame;
+        for (int size : sizes) {
+            QPixmap pixmap = base.pixmap(size, size);
+
+            QPainter painter(&pixmap);
+            const int height = qMax(2, size / 6);
+            painter.fillRect(0, size - height, size, height, Qt::darkGray);
+            painter.fillRect(0, size - height, size * step / steps, height, QColor(60, 180, 75));
+            painter.end();
+
+            frame.addPixmap(pixmap);
+        }
+        repainted.setIconByPixmap(frame);
+        QCoreApplication::processEvents();
+    }
+    const qint64 repaintedNs = clock.nsecsElapsed();
+
+    QTextStream out(stdout);
+    out << "transport:   " << qEnvironmentVariable("SNI_QT_TRANSPORT", QStringLiteral("QtDBus")) << '\n'
+        << "progress:    " << steps + 1 << " frames at " << sizes.size() << " sizes, us per frame\n"
+        << "  first setProgress(), with the table: " << firstNs / 1000.0 << '\n'
+        << "  setProgress():                       " << tableNs / 1000.0 / steps << '\n'
+        << "  repaint and setIconByPixmap():       " << repaintedNs / 1000.0 / (steps + 1) << '\n'
+        << "  table memory:                        " << table.memoryUsage() - repainted.memoryUsage() << " bytes more\n";
+    return 0;
+}
+
+/*
+    Times the first setIconByPixmap() of the 40 state icons of an application,
+    as on its start: each run is a new process, without the icon cache, with
+    an empty cache, then with the cache left by the previous run.
+*/
+constexpr int coldStartIcons = 40;
+
+QIcon coldStartIcon(int index, const QList<int>& sizes)
+{
+    QIcon icon;
+    for (int size : sizes) {
+        QImage image(size, size, QImage::Format_ARGB32);
+        image.fill(Qt::transparent);
+
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setBrush(QColor::fromHsv(index * 359 / coldStartIcons, 200, 230));
+        painter.drawEllipse(image.rect().adjusted(1, 1, -1, -1));
+        painter.setPen(Qt::white);
+        painter.drawText(image.rect(), Qt::AlignCenter, QString::number(index));
+        painter.end();
+
+        icon.addPixmap(QPixmap::fromImage(image));
+    }
+    return icon;
+}
+
+// a run in this process, printing the time of the calls in us
+int coldStartRun(bool cache, const QList<int>& sizes)
+{
+    StatusNotifierItem::setIconCacheEnabled(cache);
+
+    QVector<QIcon>               icons;
+    QVector<StatusNotifierItem*> items;
+    for (int i = 0; i < coldStartIcons; ++i) {
+        icons.append(coldStartIcon(i, sizes));
+        items.append(new StatusNotifierItem(QStringLiteral("sni-loadgen-%1").arg(i)));
+    }
+
+    // visible items serialize their icon in the setter
+    QElapsedTimer clock;
+    clock.start();
+    for (int i = 0; i < coldStartIcons; ++i)
+        items.at(i)->setIconByPixmap(icons.at(i));
+    const qint64 usec = clock.nsecsElapsed() / 1000;
+
+    qDeleteAll(items);
+    QTextStream(stdout) << usec << '\n';
+    return 0;
+}
+
+int coldStart(const QString& sizes)
+{
+    QTemporaryDir cache;
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QStringLiteral("XDG_CACHE_HOME"), cache.path());
+
+    QTextStream out(stdout);
+    out << "transport:     " << qEnvironmentVariable("SNI_QT_TRANSPORT", QStringLiteral("QtDBus")) << '\n'
+        << "first setIconByPixmap() of " << coldStartIcons << " icons at " << sizes << ", new process each:\n";
+
+    const struct { const char* mode; const char* name; } runs[] = {
+        { "none", "  without cache: " },
+        { "cold", "  cold cache:    " },
+        { "warm", "  warm cache:    " },
+    };
+    for (const auto& run : runs) {
+        QProcess process;
+        process.setProcessEnvironment(environment);
+        process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        process.start(QCoreApplication::applicationFilePath(),
+                      { QStringLiteral("--cold-start-run"), QLatin1String(run.mode), QStringLiteral("--sizes"), sizes });
+
+        bool         parsed = false;
+        const bool   ok     = process.waitForFinished(60000) && process.exitCode() == 0;
+        const qint64 usec   = process.readAllStandardOutput().trimmed().toLongLong(&parsed);
+        if (!ok || !parsed) {
+            QTextStream(stderr) << "the " << run.mode << " run failed\n";
+            return 1;
+        }
+        out << run.name << usec / 1000.0 << " ms\n";
+        out.flush();
+    }
+    return 0;
+}
+
+const char* SNILoadGenerator::callName(Call call)
+{
+    switch (call) {
+    case GetStatus:       return "Get Status";
+    case GetIconPixmap:   return "Get IconPixmap";
+    case GetAll:          return "GetAll";
+    case IconPixmapDelta: return "IconPixmapDelta";
+    case CallCount:       break;
+    }
+    return "";
+}
+
+int main(int argc, char **argv)
+{
+    QApplication::setQuitOnLastWindowClosed(false);
+    QApplication app(argc, argv);
+    QApplication::setApplicationName(QStringLiteral("sni-loadgen"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Drives StatusNotifierItems at a given rate"));
+    parser.addHelpOption();
+    parser.addOptions({
+        { QStringLiteral("items"), QStringLiteral("Number of items [default: 50]."),
+          QStringLiteral("count"), QStringLiteral("50") },
+        { QStringLiteral("rate"), QStringLiteral("Updates per second, all items together [default: 100]."),
+          QStringLiteral("rate"), QStringLiteral("100") },
+        { QStringLiteral("duration"), QStringLiteral("Duration of the run in seconds [default: 10]."),
+          QStringLiteral("seconds"), QStringLiteral("10") },
+        { QStringLiteral("mix"), QStringLiteral("Weights of icon, tooltip and status updates [default: 50,30,20]."),
+          QStringLiteral("weights"), QStringLiteral("50,30,20") },
+        { QStringLiteral("pixmap-ratio"), QStringLiteral("Part of the icons set by pixmap, the rest by name [default: 0.5]."),
+          QStringLiteral("ratio"), QStringLiteral("0.5") },
+        { QStringLiteral("sizes"), QStringLiteral("Sizes of the pixmaps [default: 16,22,32,48,64]."),
+          QStringLiteral("sizes"), QStringLiteral("16,22,32,48,64") },
+        { QStringLiteral("refresh-delay"), QStringLiteral("Coalescing delay of the hosts in ms [default: 50]."),
+          QStringLiteral("msec"), QStringLiteral("50") },
+        { QStringLiteral("no-host"), QStringLiteral("Don't attach stand-in hosts.") },
+        { QStringLiteral("calls"), QStringLiteral("Timed calls of each kind to an item after the updates [default: 0]."),
+          QStringLiteral("count"), QStringLiteral("0") },
+        { QStringLiteral("lean"), QStringLiteral("Enable the memory-lean mode of the items.") },
+        { QStringLiteral("tracking"), QStringLiteral("Enable the latency tracking of the items, and report it for the first one.") },
+        { QStringLiteral("budget"), QStringLiteral("Bandwidth budget of the pixmaps in bytes/s [default: 0, unlimited]."),
+          QStringLiteral("bytes"), QStringLiteral("0") },
+        { QStringLiteral("toggles"), QStringLiteral("Only create hidden items, and show and hide them this many times."),
+          QStringLiteral("count"), QStringLiteral("0") },
+        { QStringLiteral("reentrant"), QStringLiteral("With --toggles, also hide and show the items from their registration slot.") },
+        { QStringLiteral("threads"), QStringLiteral("Only create the items, from this many threads at once."),
+          QStringLiteral("count"), QStringLiteral("0") },
+        { QStringLiteral("watcher-check"), QStringLiteral("Only check the in-process watcher, on a private bus.") },
+        { QStringLiteral("cold-start"), QStringLiteral("Only time the first icons set by pixmap, with and without the icon cache.") },
+        { QStringLiteral("progress-cost"), QStringLiteral("Only time setProgress() against repainting the frames."),
+          QStringLiteral("steps") },
+        { QStringLiteral("progress-check"), QStringLiteral("Only compare IconPixmap to IconPixmapDelta on progress frames, and check them."),
+          QStringLiteral("steps") },
+    });
+    QCommandLineOption coldStartRunOption(QStringLiteral("cold-start-run"), QString(), QStringLiteral("mode"));
+    coldStartRunOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(coldStartRunOption);
+    parser.process(app);
+
+    if (parser.isSet(QStringLiteral("watcher-check"))) {
+        SNIWatcherCheck check;
+        return app.exec();
+    }
+
+    SNILoadGenerator::Options options;
+    options.items        = qMax(1, parser.value(QStringLiteral("items")).toInt());
+    options.rate         = qMax(0.0, parser.value(QStringLiteral("rate")).toDouble());
+    options.duration     = qMax(1, parser.value(QStringLiteral("duration")).toInt());
+    options.pixmapRatio  = qBound(0.0, parser.value(QStringLiteral("pixmap-ratio")).toDouble(), 1.0);
+    options.refreshDelay = qMax(0, parser.value(QStringLiteral("refresh-delay")).toInt());
+    options.withHost     = !parser.isSet(QStringLiteral("no-host"));
+    options.calls        = qMax(0, parser.value(QStringLiteral("calls")).toInt());
+    options.lean         = parser.isSet(QStringLiteral("lean"));
+    options.tracking     = parser.isSet(QStringLiteral("tracking"));
+
+    const QStringList weights = parser.value(QStringLiteral("mix")).split(QLatin1Char(','));
+    if (weights.size() != SNILoadGenerator::KindCount) {
+        QTextStream(stderr) << "--mix takes " << int(SNILoadGenerator::KindCount) << " weights\n";
+        return 1;
+    }
+    for (int i = 0; i < weights.size(); ++i)
+        options.weights[i] = qMax(0, weights.at(i).toInt());
+
+    options.sizes.clear();
+    for (const QString& size : parser.value(QStringLiteral("sizes")).split(QLatin1Char(','))) {
+        if (size.toInt() > 0)
+            options.sizes.append(size.toInt());
+    }
+    if (options.sizes.isEmpty()) {
+        QTextStream(stderr) << "--sizes takes at least one size\n";
+        return 1;
+    }
+
+    if (parser.isSet(coldStartRunOption))
+        return coldStartRun(parser.value(coldStartRunOption) != QLatin1String("none"), options.sizes);
+    if (parser.isSet(QStringLiteral("cold-start")))
+        return coldStart(parser.value(QStringLiteral("sizes")));
+    if (parser.isSet(QStringLiteral("progress-cost")))
+        return progressCost(qMax(1, parser.value(QStringLiteral("progress-cost")).toInt()), options.sizes);
+    if (parser.isSet(QStringLiteral("progress-check"))) {
+        SNIProgressCheck check(qMax(1, parser.value(QStringLiteral("progress-check")).toInt()), options.sizes);
+        return app.exec();
+    }
+
+    StatusNotifierItem::setPixmapBandwidthBudget(parser.value(QStringLiteral("budget")).toLongLong());
+
+    const int toggles = parser.value(QStringLiteral("toggles")).toInt();
+    if (toggles > 0) {
+        SNIVisibilityBenchmark benchmark(options.items, toggles, parser.isSet(QStringLiteral("reentrant")));
+        return app.exec();
+    }
+    const int threads = parser.value(QStringLiteral("threads")).toInt();
+    if (threads > 0) {
+        SNIConstructionBenchmark benchmark(options.items, threads);
+        return app.exec();
+    }
+    SNILoadGenerator generator(options);
+    return app.exec();
+}
@@ -0,0 +1,236 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include "statusnotifieritembadge_p.hpp"
+#include "statusnotifieritemiconcache_p.hpp"
+#include "statusnotifieritempixel_p.hpp"
+#include "statusnotifieritempool_p.hpp"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFont>
+#include <QFontMetrics>
+#include <QGuiApplication>
+#include <QImage>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QtEndian>
+
+/*
+    Times the conversion of images to the pixels sent over the bus, per
+    source format and size: the former two-step path (convertToFormat()
+    to ARGB32, then a byte swap) against the fused kernels of
+    SNIPixelConverter, with each of the instruction sets of the CPU.
+    The hash of the converted pixels, which items compare to skip
+    unchanged icons, is timed as well, and so is the cold start with the
+    icon cache: the key of the image plus the mapping of its entry by a
+    cache that has not seen it yet in the process, as on the next start.
+    With --badges, it times the badges of setBadgeCount() instead, rendered
+    from the glyph atlas against painting the same pill and text with QPainter.
+*/
+namespace {
+QByteArray twoStep(QImage image)
+{
+    if (image.format() != QImage::Format_ARGB32)
+        image = image.convertToFormat(QImage::Format_ARGB32);
+
+    QByteArray bytes(reinterpret_cast<const char*>(image.constBits()), image.sizeInBytes());
+    quint32*   pixels = reinterpret_cast<quint32*>(bytes.data());
+    for (qsizetype i = 0; i < bytes.size() / qsizetype(sizeof(quint32)); ++i)
+        pixels[i] = qToBigEndian(pixels[i]);
+
+    return bytes;
+}
+
+// random pixels, half of them opaque as in most icons
+QImage testImage(QImage::Format format, int size)
+{
+    QImage image(size, size, QImage::Format_ARGB32);
+    QRandomGenerator random(size);
+    for (int y = 0; y < size; ++y) {
+        quint32* line = reinterpret_cast<quint32*>(image.scanLine(y));
+        for (int x = 0; x < size; ++x)
+            line[x] = (x < size / 2) ? (random.generate() | 0xff000000u) : random.generate();
+    }
+    return image.convertToFormat(format);
+}
+
+// nanoseconds per conversion
+template<typename Convert>
+double timeOf(Convert convert, int iterations)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qsizetype sink = 0;
+    for (int i = 0; i < iterations; ++i)
+        sink += convert().size();
+
+    const double ns = double(timer.nsecsElapsed()) / iterations;
+    return sink > 0 ? ns : 0.0;
+}
+
+// a badge as painted before SNIBadgeRenderer, then converted like any icon
+QByteArray paintedBadge(const QString& text, int size)
+{
+    QImage image(size, size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    const int badgeHeight = qMax(7, size * 9 / 16);
+    QFont font;
+    font.setBold(true);
+    font.setPixelSize(qMax(6, badgeHeight * 3 / 4));
+
+    const int    padding = badgeHeight / 4;
+    const int    width   = qMin(size, qMax(badgeHeight, QFontMetrics(font).horizontalAdvance(text) + 2 * padding));
+    const QRectF pill(size - width, size - badgeHeight, width, badgeHeight);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(218, 68, 83));
+    painter.drawRoundedRect(pill, badgeHeight / 2.0, badgeHeight / 2.0);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    painter.drawText(pill, Qt::AlignCenter, text);
+    painter.end();
+
+    return SNIPixelConverter::toWire(image);
+}
+
+// ns per badge, the glyph atlas of each size being ready as after the first count
+void badges(QTextStream& out, const QStringList& sizes, qint64 pixels)
+{
+    out << "ns per badge, in the format of the bus\n"
+        << qSetFieldWidth(8) << Qt::left << "text" << qSetFieldWidth(6) << "size"
+        << qSetFieldWidth(12) << Qt::right << "QPainter" << "renderer"
+        << qSetFieldWidth(9) << "speedup" << qSetFieldWidth(0) << '\n';
+
+    for (const QString& text : { QStringLiteral("7"), QStringLiteral("42"), QStringLiteral("99+") }) {
+        for (const QString& value : sizes) {
+            const int size = value.toInt();
+            if (size <= 0)
+                continue;
+
+            const QList<QSize> badgeSize { QSize(size, size) };
+            SNIBadgeRenderer::render(text, badgeSize);
+
+            const int    iterations = int(qBound(qint64(1), pixels / (qint64(size) * size), qint64(100000)));
+            const double painted    = timeOf([&] { return paintedBadge(text, size); }, iterations);
+            const double rendered   = timeOf([&] {
+                return SNIBadgeRenderer::render(text, badgeSize).constFirst().bytes;
+            }, iterations);
+
+            out << qSetFieldWidth(8) << Qt::left << text << qSetFieldWidth(6) << size
+                << qSetFieldWidth(12) << Qt::right << qRound64(painted) << qRound64(rendered)
+                << qSetFieldWidth(9) << QString::number(painted / qMax(rendered, 1.0), 'f', 2)
+                << qSetFieldWidth(0) << '\n';
+        }
+    }
+}
+
+// the largest difference of a channel, as the Qt conversions may round differently
+int maxDifference(const QByteArray& a, const QByteArray& b)
+{
+    if (a.size() != b.size())
+        return 256;
+
+    int difference = 0;
+    for (qsizetype i = 0; i < a.size(); ++i)
+        difference = qMax(difference, qAbs(int(uchar(a.at(i))) - int(uchar(b.at(i)))));
+    return difference;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    QGuiApplication app(argc, argv);
+    QGuiApplication::setApplicationName(QStringLiteral("sni-pixelbench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Times the conversion of icons to the D-Bus format"));
+    parser.addHelpOption();
+    parser.addOption({ QStringLiteral("sizes"), QStringLiteral("Sizes of the images [default: 16,22,32,48,64,128,256]."),
+                       QStringLiteral("sizes"), QStringLiteral("16,22,32,48,64,128,256") });
+    parser.addOption({ QStringLiteral("pixels"), QStringLiteral("Pixels converted per measure [default: 20000000]."),
+                       QStringLiteral("count"), QStringLiteral("20000000") });
+    parser.addOption({ QStringLiteral("badges"), QStringLiteral("Only time the badges of setBadgeCount() against QPainter.") });
+    parser.process(app);
+
+    const qint64 pixels = qMax(qint64(1), parser.value(QStringLiteral("pixels")).toLongLong());
+
+    QTextStream out(stdout);
+    if (parser.isSet(QStringLiteral("badges"))) {
+        badges(out, parser.value(QStringLiteral("sizes")).split(QLatin1Char(',')), pixels);
+        return 0;
+    }
+
+    const struct { QImage::Format format; const char* name; } formats[] = {
+        { QImage::Format_ARGB32,               "ARGB32" },
+        { QImage::Format_ARGB32_Premultiplied, "ARGB32_Premultiplied" },
+        { QImage::Format_RGB32,                "RGB32" },
+        { QImage::Format_RGBA8888,             "RGBA8888" },
+        { QImage::Format_Grayscale8,           "Grayscale8" },
+    };
+    const SNIPixelConverter::Isa best = SNIPixelConverter::isa();
+
+    out << "ns per image; diff is the largest channel difference to the two-step path,\n"
+        << "hash the time to hash the converted pixels, key the time to compute the cache key\n"
+        << "of the image and cached the time to find its entry on a cold start, key included\n"
+        << qSetFieldWidth(22) << Qt::left << "format" << qSetFieldWidth(6) << "size"
+        << qSetFieldWidth(12) << Qt::right << "two-step";
+    for (int isa = SNIPixelConverter::Scalar; isa <= best; ++isa)
+        out << SNIPixelConverter::isaName(SNIPixelConverter::Isa(isa));
+    out << qSetFieldWidth(9) << "speedup" << "diff" << "hash" << "key" << "cached" << qSetFieldWidth(0) << '\n';
+
+    QTemporaryDir directory;
+    SNIIconCache  populated(directory.path());
+
+    for (const auto& format : formats) {
+        for (const QString& value : parser.value(QStringLiteral("sizes")).split(QLatin1Char(','))) {
+            const int size = value.toInt();
+            if (size <= 0)
+                continue;
+
+            const QImage image      = testImage(format.format, size);
+            const int    iterations = int(qMax(qint64(1), pixels / (qint64(size) * size)));
+            const double reference  = timeOf([&] { return twoStep(image); }, iterations);
+
+            out << qSetFieldWidth(22) << Qt::left << format.name << qSetFieldWidth(6) << size
+                << qSetFieldWidth(12) << Qt::right << qRound64(reference);
+
+            double fused = reference;
+            int    difference = 0;
+            for (int isa = SNIPixelConverter::Scalar; isa <= best; ++isa) {
+                SNIPixelConverter::setIsa(SNIPixelConverter::Isa(isa));
+                fused = timeOf([&] { return SNIPixelConverter::toWire(image); }, iterations);
+                difference = qMax(difference, maxDifference(twoStep(image), SNIPixelConverter::toWire(image)));
+                out << qRound64(fused);
+            }
+            const QByteArray wire = SNIPixelConverter::toWire(image);
+            const double     hash = timeOf([&] {
+                return QByteArray::number(SNIPayloadPool::hash(wire.constData(), wire.size()));
+            }, iterations);
+
+            const QByteArray key = SNIIconCache::key(image);
+            populated.insert(key, size, size, wire);
+            populated.waitForWrites();
+
+            const double keyed  = timeOf([&] { return SNIIconCache::key(image); }, iterations);
+            const double cached = timeOf([&] {
+                SNIIconCache                cold(directory.path());
+                std::shared_ptr<const void> mapping;
+                return cold.find(SNIIconCache::key(image), size, size, mapping);
+            }, qMin(iterations, 10000));
+
+            out << qSetFieldWidth(9) << QString::number(reference / qMax(fused, 1.0), 'f', 2)
+                << difference << qRound64(hash) << qRound64(keyed) << qRound64(cached)
+                << qSetFieldWidth(0) << '\n';
+        }
+    }
+    return 0;
+}
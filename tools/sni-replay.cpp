@@ -0,0 +1,337 @@
+/*
+    SPDX-FileCopyrightText:  2024 Qtilities team
+    SPDX-License-Identifier: LGPL-2.1-or-later
+
+    This file is part of the statusnotifieritem-qt library
+*/
+#include <statusnotifieritem.h>
+#include <statusnotifieritemclient.h>
+#include <statusnotifierwatcher.h>
+
+#include "statusnotifieritemlatency_p.hpp"
+#include "statusnotifieritemtrace_p.hpp"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QTextStream>
+#include <QTimer>
+
+#include <ctime>
+#include <utility>
+
+/*
+    Replays a trace recorded with StatusNotifierItem::startRecording()
+    against a fresh item, hosted by an in-process watcher and a
+    StatusNotifierItemClient standing in for the panel.
+
+    Run it on a private bus, e.g. `dbus-run-session sni-replay trace.snitrace`,
+    so that no other watcher or host takes part in the measure.
+*/
+class SNIReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    SNIReplay(SNITraceReader& reader, double speed, bool withHost);
+
+public Q_SLOTS:
+    void onSignal(const QDBusMessage& message);
+
+private:
+    void onItemRegistered(const QString& item);
+    void start();
+    void scheduleNext();
+    void apply(const SNITraceReader::Record& record);
+    void finish();
+
+    static qint64 bytesWritten();
+
+    SNITraceReader&           reader_;
+    double                    speed_;
+    bool                      withHost_;
+    bool                      started_ { false };
+    StatusNotifierWatcher     watcher_;
+    StatusNotifierItem*       item_;
+    StatusNotifierItemClient* host_ { nullptr };
+    SNITraceReader::Record    record_;
+    QElapsedTimer             clock_;
+    std::clock_t              cpuStart_ { 0 };
+    qint64                    bytesStart_ { 0 };
+    int                       replayed_ { 0 };
+    QMap<QString, int>        signals_;
+    QMap<QString, int>        reads_;
+};
+
+SNIReplay::SNIReplay(SNITraceReader& reader, double speed, bool withHost)
+    : reader_(reader)
+    , speed_(speed)
+    , withHost_(withHost)
+    , watcher_(this)
+{
+    if (withHost_)
+        connect(&watcher_, &StatusNotifierWatcher::itemRegistered, this, &SNIReplay::onItemRegistered);
+
+    item_ = new StatusNotifierItem(reader_.id(), this);
+    item_->setLatencyTrackingEnabled(true);
+
+    // without a host, or when another watcher owns the service, start anyway
+    QTimer::singleShot(withHost_ ? 2000 : 0, this, [this] {
+        if (!started_ && withHost_)
+            QTextStream(stderr) << "no host could be attached, replaying without host\n";
+        start();
+    });
+}
+
+void SNIReplay::onSignal(const QDBusMessage& message)
+{
+    ++signals_[message.member()];
+}
+
+void SNIReplay::onItemRegistered(const QString& item)
+{
+    if (host_)
+        return;
+
+    const int     slash   = item.indexOf(QLatin1Char('/'));
+    const QString service = slash < 0 ? item : item.left(slash);
+    const QString path    = slash < 0 ? QStringLiteral("/StatusNotifierItem") : item.mid(slash);
+
+    for (const char* name : { "NewTitle", "NewIcon", "NewAttentionIcon", "NewOverlayIcon",
+                              "NewToolTip", "NewStatus", "NewIconThemePath", "NewMenu" }) {
+        QDBusConnection::sessionBus().connect(
+            service, path, QStringLiteral("org.kde.StatusNotifierItem"), QLatin1String(name),
+            this, SLOT(onSignal(QDBusMessage)));
+    }
+    // a registered host, for an item in idle mode
+    watcher_.registerHost(QDBusConnection::sessionBus().baseService());
+
+    host_ = new StatusNotifierItemClient(item, this);
+    connect(host_, &StatusNotifierItemClient::ready, this, &SNIReplay::start);
+}
+
+void SNIReplay::start()
+{
+    if (started_)
+        return;
+
+    started_    = true;
+    cpuStart_   = std::clock();
+    bytesStart_ = bytesWritten();
+    clock_.start();
+    scheduleNext();
+}
+
+void SNIReplay::scheduleNext()
+{
+    if (!reader_.next(record_)) {
+        if (!reader_.errorString().isEmpty())
+            QTextStream(stderr) << "trace error: " << reader_.errorString() << '\n';
+
+        // let the host fetch the last updates
+        QTimer::singleShot(500, this, &SNIReplay::finish);
+        return;
+    }
+    qint64 delay = 0;
+    if (speed_ > 0.0)
+        delay = qMax(qint64(0), qint64(record_.time / speed_ / 1000.0) - clock_.elapsed());
+
+    QTimer::singleShot(int(delay), this, [this] {
+        apply(record_);
+        ++replayed_;
+        scheduleNext();
+    });
+}
+
+void SNIReplay::apply(const SNITraceReader::Record& record)
+{
+    const QVariantList& a = record.arguments;
+
+    switch (record.event) {
+    case SNITrace::SetCategory:
+        item_->setCategory(StatusNotifierItem::SNICategory(a.at(0).toInt()));
+        break;
+    case SNITrace::SetStatus:
+        item_->setStatus(StatusNotifierItem::SNIStatus(a.at(0).toInt()));
+        break;
+    case SNITrace::SetTitle:
+        item_->setTitle(a.at(0).toString());
+        break;
+    case SNITrace::SetIconByName:
+        item_->setIconByName(a.at(0).toString());
+        break;
+    case SNITrace::SetIconByPixmap:
+        item_->setIconByPixmap(a.at(0).value<QIcon>());
+        break;
+    case SNITrace::SetIconThemePath:
+        item_->setIconThemePath(a.at(0).toString());
+        break;
+    case SNITrace::SetProgress:
+        item_->setProgress(a.at(0).toDouble());
+        break;
+    case SNITrace::SetProgressSteps:
+        item_->setProgressSteps(a.at(0).toInt());
+        break;
+    case SNITrace::SetProgressUpdateInterval:
+        item_->setProgressUpdateInterval(a.at(0).toInt());
+        break;
+    case SNITrace::SetOverlayIconByName:
+        item_->setOverlayIconByName(a.at(0).toString());
+        break;
+    case SNITrace::SetOverlayIconByPixmap:
+        item_->setOverlayIconByPixmap(a.at(0).value<QIcon>());
+        break;
+    case SNITrace::SetBadgeText:
+        item_->setBadgeText(a.at(0).toString());
+        break;
+    case SNITrace::SetAttentionIconByName:
+        item_->setAttentionIconByName(a.at(0).toString());
+        break;
+    case SNITrace::SetAttentionIconByPixmap:
+        item_->setAttentionIconByPixmap(a.at(0).value<QIcon>());
+        break;
+    case SNITrace::SetToolTip:
+        item_->setToolTip(a.at(0).toString(), a.at(1).toString(), a.at(2).toString());
+        break;
+    case SNITrace::SetToolTipWithIcon:
+        item_->setToolTip(a.at(0).value<QIcon>(), a.at(1).toString(), a.at(2).toString());
+        break;
+    case SNITrace::SetToolTipIconByName:
+        item_->setToolTipIconByName(a.at(0).toString());
+        break;
+    case SNITrace::SetToolTipIconByPixmap:
+        item_->setToolTipIconByPixmap(a.at(0).value<QIcon>());
+        break;
+    case SNITrace::SetToolTipTitle:
+        item_->setToolTipTitle(a.at(0).toString());
+        break;
+    case SNITrace::SetToolTipSubTitle:
+        item_->setToolTipSubTitle(a.at(0).toString());
+        break;
+    case SNITrace::SetToolTipTemplate:
+        item_->setToolTipTemplate(a.at(0).toString());
+        break;
+    case SNITrace::SetToolTipField:
+        item_->setToolTipField(a.at(0).toString(), a.at(1).toString());
+        break;
+    case SNITrace::SetToolTipNumber:
+        item_->setToolTipField(a.at(0).toString(), a.at(1).toDouble(), a.at(2).toInt());
+        break;
+    case SNITrace::SetVisible:
+        item_->setVisible(a.at(0).toBool());
+        break;
+    case SNITrace::Activate:
+        if (host_)
+            host_->activate(QPoint(a.at(0).toInt(), a.at(1).toInt()));
+        break;
+    case SNITrace::SecondaryActivate:
+        if (host_)
+            host_->secondaryActivate(QPoint(a.at(0).toInt(), a.at(1).toInt()));
+        break;
+    case SNITrace::ContextMenu:
+        if (host_)
+            host_->contextMenu(QPoint(a.at(0).toInt(), a.at(1).toInt()));
+        break;
+    case SNITrace::Scroll:
+        if (host_)
+            host_->scroll(a.at(0).toInt(), Qt::Orientation(a.at(1).toInt()));
+        break;
+    case SNITrace::PropertyRead:
+        // the stand-in host reads on its own, as the recorded one did
+        ++reads_[QLatin1String(SNILatencyTracker::updateName(SNILatencyTracker::Update(a.at(0).toInt())))];
+        break;
+    case SNITrace::DefineIcon:
+    case SNITrace::EventCount:
+        break;
+    }
+}
+
+void SNIReplay::finish()
+{
+    const double cpuMs = 1000.0 * double(std::clock() - cpuStart_) / CLOCKS_PER_SEC;
+
+    const qint64 wallMs = qMax(qint64(1), clock_.elapsed());
+
+    int signalCount = 0;
+    for (int count : std::as_const(signals_))
+        signalCount += count;
+
+    QTextStream out(stdout);
+    out << "transport:   " << qEnvironmentVariable("SNI_QT_TRANSPORT", QStringLiteral("QtDBus")) << '\n'
+        << "records:     " << replayed_ << '\n'
+        << "wall time:   " << wallMs << " ms\n"
+        << "cpu time:    " << cpuMs << " ms\n";
+
+    if (replayed_ > 0)
+        out << "cpu/update:  " << 1000.0 * cpuMs / replayed_ << " us\n";
+
+    out << "throughput:  " << 1000.0 * signalCount / wallMs << " signals/s\n";
+
+    const qint64 bytes = bytesWritten();
+    if (bytes >= 0)
+        out << "bus bytes:   " << bytes - bytesStart_ << " (written by item and host)\n";
+
+    out << "item memory: " << item_->memoryUsage() << " bytes\n";
+
+    out << "signals:\n";
+    for (auto it = signals_.cbegin(); it != signals_.cend(); ++it)
+        out << "  " << it.key() << ": " << it.value() << '\n';
+
+    out << "recorded reads:\n";
+    for (auto it = reads_.cbegin(); it != reads_.cend(); ++it)
+        out << "  " << it.key() << ": " << it.value() << '\n';
+
+    out << "latencies:\n" << item_->latencyReport();
+    out.flush();
+
+    qApp->quit();
+}
+
+qint64 SNIReplay::bytesWritten()
+{
+    // the bytes written by the process, almost all of them to the bus socket
+    QFile io(QStringLiteral("/proc/self/io"));
+    if (!io.open(QIODevice::ReadOnly))
+        return -1;
+
+    for (const QByteArray& line : io.readAll().split('\n')) {
+        if (line.startsWith("wchar:"))
+            return line.mid(6).trimmed().toLongLong();
+    }
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    QApplication::setQuitOnLastWindowClosed(false);
+    QApplication app(argc, argv);
+    QApplication::setApplicationName(QStringLiteral("sni-replay"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays a StatusNotifierItem trace"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("trace"), QStringLiteral("The trace file."));
+    parser.addOption({ QStringLiteral("speed"),
+                       QStringLiteral("Speed factor, 0 replays as fast as possible [default: 1]."),
+                       QStringLiteral("factor"), QStringLiteral("1") });
+    parser.addOption({ QStringLiteral("no-host"),
+                       QStringLiteral("Don't attach a stand-in host.") });
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+
+    SNITraceReader reader;
+    if (!reader.open(parser.positionalArguments().constFirst())) {
+        QTextStream(stderr) << "cannot open trace: " << reader.errorString() << '\n';
+        return 1;
+    }
+    SNIReplay replay(reader, parser.value(QStringLiteral("speed")).toDouble(),
+                     !parser.isSet(QStringLiteral("no-host")));
+    return app.exec();
+}
+#include "sni-replay.moc"